@@ -0,0 +1,150 @@
+//
+//  base64_bench.c
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Throughput and round trip check of the vendored ybase64 encoder and decoder.
+// Not part of the library, the podspec only compiles files under threeMF/.
+//
+// Build and run from the repository root, once per code path:
+//
+//   cc -O2 -IthreeMF/Vendor/ytoolkit Benchmarks/base64_bench.c threeMF/Vendor/ytoolkit/ybase64.c -o base64_bench && ./base64_bench
+//   cc -O2 -DYBASE64_NO_SIMD -IthreeMF/Vendor/ytoolkit Benchmarks/base64_bench.c threeMF/Vendor/ytoolkit/ybase64.c -o base64_bench_scalar && ./base64_bench_scalar
+//
+// Optional arguments: buffer size in bytes (default 8 MB) and iterations (default 20).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ybase64.h"
+
+static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// straightforward RFC 4648 encoder the library output is compared against
+static size_t reference_encode(const unsigned char *from, size_t len, char *to) {
+    size_t j = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        unsigned int n = (unsigned int)from[i] << 16;
+        if (i + 1 < len) n |= (unsigned int)from[i + 1] << 8;
+        if (i + 2 < len) n |= from[i + 2];
+        to[j++] = kAlphabet[(n >> 18) & 63];
+        to[j++] = kAlphabet[(n >> 12) & 63];
+        to[j++] = (i + 1 < len) ? kAlphabet[(n >> 6) & 63] : '=';
+        to[j++] = (i + 2 < len) ? kAlphabet[n & 63] : '=';
+    }
+    to[j] = '\0';
+    return j;
+}
+
+static void fill_random(unsigned char *buffer, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        buffer[i] = (unsigned char)rand();
+    }
+}
+
+// every length up to 600 bytes covers all block and remainder combinations
+static int check_round_trips(void) {
+    unsigned char input[600], decoded[600];
+    char encoded[801], expected[801];
+    int failures = 0;
+
+    for (size_t len = 1; len <= sizeof(input); len++) {
+        fill_random(input, len);
+        size_t encoded_len = ybase64_encode(input, len, encoded, sizeof(encoded));
+        size_t expected_len = reference_encode(input, len, expected);
+        if (encoded_len != expected_len + 1 || strcmp(encoded, expected) != 0) {
+            fprintf(stderr, "encode mismatch at %zu bytes\n", len);
+            failures++;
+            continue;
+        }
+
+        size_t decoded_len = ybase64_decode(encoded, expected_len, decoded, sizeof(decoded));
+        if (decoded_len != len || memcmp(decoded, input, len) != 0) {
+            fprintf(stderr, "decode mismatch at %zu bytes\n", len);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    size_t size = (argc > 1) ? strtoul(argv[1], NULL, 10) : 8 * 1024 * 1024;
+    int iterations = (argc > 2) ? atoi(argv[2]) : 20;
+    if (size == 0 || iterations <= 0) {
+        fprintf(stderr, "usage: %s [bytes] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    srand(42);
+    int failures = check_round_trips();
+    printf("round trips 1..600 bytes: %s\n", failures ? "FAILED" : "ok");
+
+    unsigned char *input = malloc(size);
+    size_t encoded_size = ybase64_encode(input, size, NULL, 0);
+    char *encoded = malloc(encoded_size);
+    size_t decoded_size = size + 3;
+    unsigned char *decoded = malloc(decoded_size);
+    if (!input || !encoded || !decoded) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    fill_random(input, size);
+
+    // warm up, also selects the code path
+    size_t encoded_len = ybase64_encode(input, size, encoded, encoded_size) - 1;
+    ybase64_decode(encoded, encoded_len, decoded, decoded_size);
+
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        ybase64_encode(input, size, encoded, encoded_size);
+    }
+    double encode_time = now() - start;
+
+    size_t decoded_len = 0;
+    start = now();
+    for (int i = 0; i < iterations; i++) {
+        decoded_len = ybase64_decode(encoded, encoded_len, decoded, decoded_size);
+    }
+    double decode_time = now() - start;
+
+    if (decoded_len != size || memcmp(decoded, input, size) != 0) {
+        fprintf(stderr, "decode mismatch at %zu bytes\n", size);
+        failures++;
+    }
+
+    double total = (double)size * iterations / 1e9;
+    printf("%zu bytes x %d: encode %.2f GB/s, decode %.2f GB/s (of binary data)\n",
+           size, iterations, total / encode_time, total / decode_time);
+
+    free(input);
+    free(encoded);
+    free(decoded);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+//
+//  compression_bench.c
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Measures the message compression of TMFProtocol on sample payloads.
+// Not part of the library, the podspec only compiles files under threeMF/.
+//
+// The decision mirrors -[TMFProtocol compressedData:], using the tunables of TMFProtocol.h:
+// zlib at Z_BEST_SPEED, a minimum body size, a probe of large bodies and a minimum saving.
+//
+// Build and run from the repository root:
+//
+//   cc -O2 Benchmarks/compression_bench.c -lz -o compression_bench && ./compression_bench [file ...]
+//
+// Without arguments synthetic payloads get measured: a capability list, a key-value blob and
+// incompressible JPEG-like data. Files given as arguments are measured as message bodies.
+// TMF_BENCH_MBIT sets the link speed used for the transfer time column (default 10 Mbit/s).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+// keep in sync with TMFProtocol.h
+#define TMF_COMPRESSION_THRESHOLD  1024
+#define TMF_COMPRESSION_PROBE      4096
+#define TMF_COMPRESSION_MIN_SAVING 8
+
+#define ITERATIONS 200
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char *capability_list(size_t *length) {
+    static const char *names[] = { "TMFAnnounceCommand", "TMFCapabilityCommand", "TMFHeartBeatCommand", "TMFSubscribeCommand",
+                                   "TMFUnsubscribeCommand", "TMFKeyValueCommand", "TMFMultiTouchCommand", "TMFMotionCommand",
+                                   "TMFImageCommand", "TMFLocationCommand", "TMFPresentationCommand", "TMFSlideCommand",
+                                   "TMFVolumeCommand", "TMFPlaybackCommand", "TMFTextInputCommand", "TMFScreenCommand",
+                                   "TMFAccelerometerCommand", "TMFGyroscopeCommand", "TMFRemoteControlCommand", "TMFPingCommand",
+                                   "TMFDocumentCommand", "TMFNoteCommand", "TMFTimerCommand", "TMFStatusCommand" };
+    size_t count = sizeof(names) / sizeof(names[0]);
+    char *text = malloc(4096);
+    size_t used = (size_t)sprintf(text, "{\"t\":\"req\",\"c\":\"cap\",\"a\":{\"commands\":[");
+    for (size_t i = 0; i < count; i++) {
+        used += (size_t)sprintf(text + used, "%s\"%s\"", i ? "," : "", names[i]);
+    }
+    used += (size_t)sprintf(text + used, "],\"ports\":[");
+    for (size_t i = 0; i < count; i++) {
+        used += (size_t)sprintf(text + used, "%s%u", i ? "," : "", 50000u + (unsigned)(rand() % 10000));
+    }
+    used += (size_t)sprintf(text + used, "]}}");
+    *length = used;
+    return (unsigned char *)text;
+}
+
+static unsigned char *key_value_blob(size_t *length) {
+    size_t capacity = 64 * 1024;
+    char *text = malloc(capacity + 128);
+    size_t used = (size_t)sprintf(text, "{\"t\":\"pub\",\"c\":\"kv\",\"a\":{");
+    for (unsigned i = 0; used < capacity; i++) {
+        used += (size_t)sprintf(text + used, "%s\"settings.item%u.value\":\"%08x-%u\"", i ? "," : "", i, (unsigned)rand(), (unsigned)(rand() % 1000));
+    }
+    used += (size_t)sprintf(text + used, "}}");
+    *length = used;
+    return (unsigned char *)text;
+}
+
+static unsigned char *jpeg_like(size_t *length) {
+    *length = 100 * 1024;
+    unsigned char *data = malloc(*length);
+    for (size_t i = 0; i < *length; i++) {
+        data[i] = (unsigned char)rand();
+    }
+    return data;
+}
+
+static unsigned char *read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *data = (size > 0) ? malloc((size_t)size) : NULL;
+    if (data && fread(data, 1, (size_t)size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *length = data ? (size_t)size : 0;
+    return data;
+}
+
+static int worth_compressing(uLong length, uLong compressed) {
+    return compressed <= length - length / TMF_COMPRESSION_MIN_SAVING;
+}
+
+static void measure(const char *name, const unsigned char *data, size_t length, double mbit) {
+    double link = length * 8.0 / (mbit * 1e6) * 1e3;
+    if (length < TMF_COMPRESSION_THRESHOLD) {
+        printf("%-22s %8zu B  below threshold, sent raw                      link %7.2f ms\n", name, length, link);
+        return;
+    }
+
+    // the probe a large body gets before the full deflate
+    double probe_time = 0;
+    if (length >= 4 * TMF_COMPRESSION_PROBE) {
+        unsigned char probe[TMF_COMPRESSION_PROBE + 64];
+        uLongf probe_length = sizeof(probe);
+        double start = now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            probe_length = sizeof(probe);
+            compress2(probe, &probe_length, data + length / 2, TMF_COMPRESSION_PROBE, Z_BEST_SPEED);
+        }
+        probe_time = (now() - start) / ITERATIONS * 1e3;
+        if (!worth_compressing(TMF_COMPRESSION_PROBE, probe_length)) {
+            printf("%-22s %8zu B  probe rejected after %.3f ms, sent raw        link %7.2f ms\n", name, length, probe_time, link);
+            return;
+        }
+    }
+
+    uLongf bound = compressBound(length);
+    unsigned char *compressed = malloc(bound);
+    unsigned char *inflated = malloc(length);
+    uLongf compressed_length = bound;
+    double start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        compressed_length = bound;
+        compress2(compressed, &compressed_length, data, length, Z_BEST_SPEED);
+    }
+    double deflate_time = (now() - start) / ITERATIONS * 1e3;
+
+    uLongf inflated_length = length;
+    start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        inflated_length = length;
+        uncompress(inflated, &inflated_length, compressed, compressed_length);
+    }
+    double inflate_time = (now() - start) / ITERATIONS * 1e3;
+
+    if (inflated_length != length || memcmp(inflated, data, length) != 0) {
+        printf("%-22s round trip FAILED\n", name);
+    }
+    else if (!worth_compressing(length, compressed_length)) {
+        printf("%-22s %8zu B  %3.0f%%, saving too small, sent raw after %.3f ms  link %7.2f ms\n",
+               name, length, 100.0 * compressed_length / length, probe_time + deflate_time, link);
+    }
+    else {
+        double compressed_link = compressed_length * 8.0 / (mbit * 1e6) * 1e3;
+        printf("%-22s %8zu B  %3.0f%%, deflate %.3f ms, inflate %.3f ms       link %7.2f ms -> %7.2f ms\n",
+               name, length, 100.0 * compressed_length / length, probe_time + deflate_time, inflate_time, link, compressed_link);
+    }
+    free(compressed);
+    free(inflated);
+}
+
+int main(int argc, char **argv) {
+    const char *env = getenv("TMF_BENCH_MBIT");
+    double mbit = env ? atof(env) : 10.0;
+    if (mbit <= 0) {
+        mbit = 10.0;
+    }
+    srand(42);
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            size_t length = 0;
+            unsigned char *data = read_file(argv[i], &length);
+            if (!data) {
+                fprintf(stderr, "could not read %s\n", argv[i]);
+                continue;
+            }
+            measure(argv[i], data, length, mbit);
+            free(data);
+        }
+        return 0;
+    }
+
+    size_t length = 0;
+    unsigned char *data = capability_list(&length);
+    measure("capability list", data, length, mbit);
+    free(data);
+
+    data = key_value_blob(&length);
+    measure("key-value blob", data, length, mbit);
+    // how the saving develops around the threshold
+    for (size_t size = 256; size <= 16 * 1024; size *= 2) {
+        char name[32];
+        snprintf(name, sizeof(name), "key-value %zu B", size);
+        measure(name, data, size, mbit);
+    }
+    free(data);
+
+    data = jpeg_like(&length);
+    measure("JPEG-like", data, length, mbit);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,240 @@
+//
+//  unix_socket_bench.c
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+// Compares loopback TCP with Unix domain stream sockets for the framing used by TMFTcpChannel and
+// TMFUnixChannel: an 8 byte length followed by the message body.
+// Not part of the library, the podspec only compiles files under threeMF/.
+//
+// Build and run from the repository root:
+//
+//   cc -O2 Benchmarks/unix_socket_bench.c -o unix_socket_bench && ./unix_socket_bench
+//
+// A forked server process echoes frames for the round trip test and consumes them for the streaming test.
+// The TCP sockets set TCP_NODELAY, like the TCP channels do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define MODE_ECHO 'E'
+#define MODE_SINK 'S'
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_all(int fd, const void *bytes, size_t length) {
+    const uint8_t *p = bytes;
+    while (length > 0) {
+        ssize_t written = write(fd, p, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *bytes, size_t length) {
+    uint8_t *p = bytes;
+    while (length > 0) {
+        ssize_t got = read(fd, p, length);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        p += got;
+        length -= (size_t)got;
+    }
+    return 0;
+}
+
+static int write_frame(int fd, const uint8_t *body, uint64_t length) {
+    return (write_all(fd, &length, sizeof(length)) == 0 && write_all(fd, body, (size_t)length) == 0) ? 0 : -1;
+}
+
+static int read_frame(int fd, uint8_t *body, uint64_t *length) {
+    return (read_all(fd, length, sizeof(*length)) == 0 && read_all(fd, body, (size_t)*length) == 0) ? 0 : -1;
+}
+
+// echoes frames or consumes them and acknowledges an empty frame, until the client disconnects
+static void serve(int listen_fd, int tcp) {
+    uint8_t *body = malloc(1 << 20);
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (tcp) {
+            int flag = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        }
+
+        char mode = 0;
+        uint64_t length = 0;
+        if (read_all(fd, &mode, 1) == 0) {
+            while (read_frame(fd, body, &length) == 0) {
+                if (mode == MODE_ECHO && write_frame(fd, body, length) != 0) break;
+                if (mode == MODE_SINK && length == 0 && write_all(fd, "a", 1) != 0) break;
+            }
+        }
+        close(fd);
+    }
+    free(body);
+    _exit(0);
+}
+
+static int connect_to(const struct sockaddr *address, socklen_t length, int tcp, char mode) {
+    int fd = socket(address->sa_family, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, address, length) != 0) {
+        perror("connect");
+        exit(1);
+    }
+    if (tcp) {
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+    write_all(fd, &mode, 1);
+    return fd;
+}
+
+static double round_trip_us(const struct sockaddr *address, socklen_t address_length, int tcp, size_t size, int iterations) {
+    int fd = connect_to(address, address_length, tcp, MODE_ECHO);
+    uint8_t *body = calloc(1, size);
+    uint64_t length = 0;
+
+    // warm up
+    for (int i = 0; i < 100; i++) {
+        write_frame(fd, body, size);
+        read_frame(fd, body, &length);
+    }
+
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        if (write_frame(fd, body, size) != 0 || read_frame(fd, body, &length) != 0 || length != size) {
+            fprintf(stderr, "round trip failed\n");
+            exit(1);
+        }
+    }
+    double elapsed = now() - start;
+    close(fd);
+    free(body);
+    return elapsed / iterations * 1e6;
+}
+
+static double streaming_mb_s(const struct sockaddr *address, socklen_t address_length, int tcp, size_t size, size_t total) {
+    int fd = connect_to(address, address_length, tcp, MODE_SINK);
+    uint8_t *body = calloc(1, size);
+    size_t count = total / size;
+    char ack = 0;
+
+    double start = now();
+    for (size_t i = 0; i < count; i++) {
+        if (write_frame(fd, body, size) != 0) {
+            fprintf(stderr, "streaming failed\n");
+            exit(1);
+        }
+    }
+    write_frame(fd, body, 0);
+    read_all(fd, &ack, 1);
+    double elapsed = now() - start;
+    close(fd);
+    free(body);
+    return (double)(count * size) / elapsed / 1e6;
+}
+
+int main(void) {
+    signal(SIGPIPE, SIG_IGN);
+
+    // loopback TCP on an ephemeral port
+    struct sockaddr_in tcp_address;
+    memset(&tcp_address, 0, sizeof(tcp_address));
+    tcp_address.sin_family = AF_INET;
+    tcp_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t tcp_length = sizeof(tcp_address);
+    int tcp_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (tcp_fd < 0 || bind(tcp_fd, (struct sockaddr *)&tcp_address, tcp_length) != 0 || listen(tcp_fd, 16) != 0 ||
+        getsockname(tcp_fd, (struct sockaddr *)&tcp_address, &tcp_length) != 0) {
+        perror("tcp");
+        return 1;
+    }
+
+    // unix socket in the temporary directory, like TMFUnixChannel
+    struct sockaddr_un unix_address;
+    memset(&unix_address, 0, sizeof(unix_address));
+    unix_address.sun_family = AF_UNIX;
+    snprintf(unix_address.sun_path, sizeof(unix_address.sun_path), "/tmp/tmf-bench-%d.sock", getpid());
+    unlink(unix_address.sun_path);
+    int unix_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (unix_fd < 0 || bind(unix_fd, (struct sockaddr *)&unix_address, sizeof(unix_address)) != 0 || listen(unix_fd, 16) != 0) {
+        perror("unix");
+        return 1;
+    }
+
+    pid_t tcp_server = fork();
+    if (tcp_server == 0) serve(tcp_fd, 1);
+    pid_t unix_server = fork();
+    if (unix_server == 0) serve(unix_fd, 0);
+
+    const size_t sizes[] = { 64, 1024, 65536 };
+    const struct sockaddr *tcp = (struct sockaddr *)&tcp_address;
+    const struct sockaddr *uds = (struct sockaddr *)&unix_address;
+
+    printf("round trip      %10s %10s %10s\n", "64B", "1KB", "64KB");
+    printf("loopback TCP   ");
+    for (int i = 0; i < 3; i++) printf(" %8.1fus", round_trip_us(tcp, tcp_length, 1, sizes[i], sizes[i] > 4096 ? 5000 : 20000));
+    printf("\nunix socket    ");
+    for (int i = 0; i < 3; i++) printf(" %8.1fus", round_trip_us(uds, sizeof(unix_address), 0, sizes[i], sizes[i] > 4096 ? 5000 : 20000));
+
+    printf("\n\nstreaming       %10s %10s %10s\n", "64B", "1KB", "64KB");
+    printf("loopback TCP   ");
+    for (int i = 0; i < 3; i++) printf(" %6.0fMB/s", streaming_mb_s(tcp, tcp_length, 1, sizes[i], sizes[i] * 50000));
+    printf("\nunix socket    ");
+    for (int i = 0; i < 3; i++) printf(" %6.0fMB/s", streaming_mb_s(uds, sizeof(unix_address), 0, sizes[i], sizes[i] * 50000));
+    printf("\n");
+
+    kill(tcp_server, SIGTERM);
+    kill(unix_server, SIGTERM);
+    waitpid(tcp_server, NULL, 0);
+    waitpid(unix_server, NULL, 0);
+    unlink(unix_address.sun_path);
+    return 0;
+}
@@ -48,6 +48,10 @@
     return YES;
 }
 
++ (TMFSendQueuePolicy)sendQueuePolicy {
+    return TMFSendQueuePolicyKeepLatest; // a live image stream only needs the latest frame
+}
+
 //............................................................................
 #pragma mark -
 #pragma mark Delegates
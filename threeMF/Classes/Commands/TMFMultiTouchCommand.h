@@ -48,6 +48,7 @@ typedef enum {
  - unique name: tmf_mt
  - reliable
  - real-time
+ - queued events are never replaced, every touch phase reaches subscribers
 
  Use this command as following. The self.view needs to be a subclass of MMMultiTouchView which is
  executing the command on touches.
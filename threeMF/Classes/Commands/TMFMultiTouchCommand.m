@@ -48,10 +48,14 @@
     return YES;
 }
 
-+ (BOOL)isRealtime {
++ (BOOL)isRealTime {
     return YES;
 }
 
++ (TMFSendQueuePolicy)sendQueuePolicy {
+    return TMFSendQueuePolicyReject; // replacing queued events would lose began, ended and cancelled phases
+}
+
 //............................................................................
 #pragma mark -
 #pragma mark Delegates
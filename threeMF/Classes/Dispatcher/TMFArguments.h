@@ -82,6 +82,7 @@
 /**
  An **alphabetical ordered** list of all serializable property values.
  This list is used for RPC transmission instead of key values pairs.
+ The order is computed once per class. Classes overriding [TMFSerializable serializedObject] must always serialize the same keys.
  */
 @property (nonatomic, readonly) NSArray *argumentList;
 
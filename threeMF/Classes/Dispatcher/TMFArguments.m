@@ -24,8 +24,11 @@
 //
 
 #import "TMFArguments.h"
+#import "TMFSerializationPlan.h"
 #import "TMFLog.h"
 
+static NSMutableDictionary *__customArgumentKeys;
+
 @implementation TMFArguments
 //............................................................................
 #pragma mark -
@@ -44,13 +47,17 @@
 #pragma mark Public
 //............................................................................
 - (NSArray *)argumentList {
+    TMFSerializationPlan *plan = [TMFSerializationPlan planForObject:self];
+    if(!plan.customSerialization) {
+        return [plan serializeValuesOfObject:self];
+    }
+
     NSDictionary *serialized = [self serializedObject];
-    NSMutableArray *sortedKeys = [[self sortedKeysForDictionary:serialized] mutableCopy];
-    [sortedKeys removeObjectAtIndex:0];
-    
-    NSMutableArray *result = [[NSMutableArray alloc] initWithCapacity:[sortedKeys count]];
-    for (NSString *key in sortedKeys) {
-        [result addObject:[serialized objectForKey:key]];
+    NSArray *keys = [self customArgumentKeys];
+    NSMutableArray *result = [[NSMutableArray alloc] initWithCapacity:[keys count]];
+    for (NSString *key in keys) {
+        id value = [serialized objectForKey:key];
+        [result addObject:(value ? value : [NSNull null])];
     }
     return result;
 }
@@ -60,23 +67,22 @@
     BOOL result = NO;
     
     if(list) {
-        NSMutableDictionary *serialized = [[self serializedObject] mutableCopy];
-        NSMutableArray *sortedKeys = [[self sortedKeysForDictionary:serialized] mutableCopy];
-        [sortedKeys removeObjectAtIndex:0];
-        
-        if([list count] == [sortedKeys count]) { // class key excluded
-            NSUInteger i = 0;
-            NSMutableDictionary *serializedObject = [[NSMutableDictionary alloc] initWithCapacity:[list count]];
-            for(NSString *key in sortedKeys) {
-                [serializedObject setObject:[list objectAtIndex:i] forKey:key];
-                i++;
-            }
+        TMFSerializationPlan *plan = [TMFSerializationPlan planForObject:self];
+        NSArray *keys = (plan.customSerialization ? [self customArgumentKeys] : plan.orderedKeys);
 
-            [serializedObject setObject:NSStringFromClass([self class]) forKey:TMFSerializableObjectClassKey];
-            [self updateFromSerializedObject:serializedObject];
+        if([list count] == [keys count]) {
+            if(!plan.customSerialization) {
+                [plan updateObject:self fromValues:list];
+            }
+            else {
+                NSMutableDictionary *serializedObject = [[NSMutableDictionary alloc] initWithObjects:list forKeys:keys];
+                [serializedObject setObject:plan.className forKey:TMFSerializableObjectClassKey];
+                [self updateFromSerializedObject:serializedObject];
+            }
+            result = YES;
         }
         else {
-            TMFLogError(@"ERROR: Arguments list contains wrong amount of arguments. Has %@ should be %@.", @([list count]), @([sortedKeys count]));
+            TMFLogError(@"ERROR: Arguments list contains wrong amount of arguments. Has %@ should be %@.", @([list count]), @([keys count]));
         }
     }
     else {
@@ -95,14 +101,28 @@
 #pragma mark -
 #pragma mark Private
 //............................................................................
-- (NSArray *)sortedKeysForDictionary:(NSDictionary *)dic {
-    NSMutableArray *keys = [[NSMutableArray alloc] initWithArray:[dic allKeys]];
-    [keys removeObject:TMFSerializableObjectClassKey]; // remove _class key to ensure it is always at index 0
-    NSArray *sortedKeys = [keys sortedArrayUsingSelector:@selector(caseInsensitiveCompare:)]; // sort keys alphabetical
-    
-    [keys removeAllObjects];
-    [keys insertObject:TMFSerializableObjectClassKey atIndex:0]; // ensure the _class key is at index 0
-    [keys addObjectsFromArray:sortedKeys]; // add all other keys behind the _class
+- (NSArray *)customArgumentKeys {
+    // classes with custom serialization may serialize more than their properties
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        __customArgumentKeys = [NSMutableDictionary new];
+    });
+
+    Class class = [self class];
+    NSArray *keys = nil;
+    @synchronized(__customArgumentKeys) {
+        keys = [__customArgumentKeys objectForKey:class];
+    }
+
+    if(!keys) {
+        NSMutableArray *sortedKeys = [[NSMutableArray alloc] initWithArray:[[self serializedObject] allKeys]];
+        [sortedKeys removeObject:TMFSerializableObjectClassKey];
+        [sortedKeys sortUsingSelector:@selector(caseInsensitiveCompare:)]; // sort keys alphabetical
+        keys = [sortedKeys copy];
+        @synchronized(__customArgumentKeys) {
+            [__customArgumentKeys setObject:keys forKey:(id<NSCopying>)class];
+        }
+    }
     return keys;
 }
 
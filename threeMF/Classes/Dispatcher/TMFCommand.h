@@ -49,6 +49,14 @@
  @param commandClass The command calling the method
  */
 - (TMFChannel *)channelForCommand:(Class)commandClass;
+
+@optional
+/**
+ The channel used for peers running on the same host.
+ @param commandClass The command calling the method
+ @return a running channel or nil if the command's default channel should be used
+ */
+- (TMFChannel *)localChannelForCommand:(Class)commandClass;
 @end
 
 /**
@@ -112,7 +120,8 @@
 
 /**
  The channel class used for the command.
- The default channel is a reliable TCP channel.
+ The default channel is a reliable TCP channel. TMFTcpChannel and TMFUdpChannel stand for the
+ channels of the configuration, the dispatcher uses the classes returned by TMFConfigurationDelegate for them.
  
  @see TMFChannel
  */
@@ -128,4 +137,22 @@
  */
 - (void)sendWithArguments:(TMFArguments *)arguments destination:(TMFPeer *)peer response:(responseBlock_t)responseBlock;
 
+/**
+ Sends the given arguments object to the destination peer and triggers the command.
+ The response block gets called with a TMFTimeoutErrorCode error if the response did not arrive within the timeout.
+ @param arguments The Arguments used to send with the command.
+ @param peer The destination peer.
+ @param timeout Time in seconds to wait for the response, 0 uses the channel's default timeout.
+ @param responseBlock The block executed on response.
+ */
+- (void)sendWithArguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(NSTimeInterval)timeout response:(responseBlock_t)responseBlock;
+
+/**
+ Sends the given arguments object to multiple destination peers without expecting responses.
+ The arguments get encoded once and the same message is sent to every peer.
+ @param arguments The Arguments used to send with the command.
+ @param peers Array of destination TMFPeer objects.
+ */
+- (void)sendWithArguments:(TMFArguments *)arguments destinations:(NSArray *)peers;
+
 @end
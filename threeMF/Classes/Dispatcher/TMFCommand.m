@@ -32,7 +32,12 @@
 #define PREFIX @"TMF"
 #define SUFFIX @"Command"
 
-@interface TMFCommand()
+@interface TMFCommand() {
+    // bound on first use, weak because commands may outlive their dispatcher and concurrent sends may bind them
+    __weak TMFChannel *_channel;
+    __weak TMFChannel *_localChannel; // for peers on the same host, nil if there is none
+    NSString *_name;
+}
 @property (nonatomic, strong, readonly) TMFChannel *channel;
 @end
 
@@ -47,9 +52,39 @@
 #pragma mark Public
 //............................................................................
 - (void)sendWithArguments:(TMFArguments *)arguments destination:(TMFPeer *)peer response:(responseBlock_t)responseBlock {
+    [self sendWithArguments:arguments destination:peer timeout:0 response:responseBlock];
+}
+
+- (void)sendWithArguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(NSTimeInterval)timeout response:(responseBlock_t)responseBlock {
     NSAssert(self.delegate != nil, @"Dispatcher needed");
     NSAssert(self.channel != nil, @"Channel needed");
-   [self.channel send:self arguments:arguments destination:peer responseBlock:responseBlock];
+    [[self channelForPeer:peer] send:self arguments:arguments destination:peer timeout:timeout responseBlock:responseBlock];
+}
+
+- (void)sendWithArguments:(TMFArguments *)arguments destinations:(NSArray *)peers {
+    NSAssert(self.delegate != nil, @"Dispatcher needed");
+    NSAssert(self.channel != nil, @"Channel needed");
+
+    // peers on the same host are sent to through the local channel
+    TMFChannel *channel = self.channel;
+    NSMutableArray *channelPeers = nil;
+    for(TMFPeer *peer in peers) {
+        TMFChannel *peerChannel = [self channelForPeer:peer];
+        if(peerChannel != channel) {
+            [peerChannel send:self arguments:arguments destinations:@[ peer ]];
+            if(!channelPeers) {
+                channelPeers = [peers mutableCopy];
+            }
+            [channelPeers removeObjectIdenticalTo:peer];
+        }
+    }
+
+    if(channelPeers) {
+        peers = channelPeers;
+    }
+    if([peers count] > 0) {
+        [channel send:self arguments:arguments destinations:peers];
+    }
 }
 
 + (NSString *)name {
@@ -80,11 +115,28 @@
 }
 
 - (TMFChannel *)channel {
-    return [self.delegate channelForCommand:[self class]];
+    // no locks on the send path, only ask the dispatcher again if the channel was stopped
+    TMFChannel *channel = _channel;
+    if(!channel || ![channel isRunning]) {
+        channel = [self.delegate channelForCommand:[self class]];
+        _channel = channel;
+    }
+    return channel;
+}
+
+- (void)setDelegate:(NSObject<TMFCommandDelegate> *)delegate {
+    _delegate = delegate;
+    _channel = nil; // channels belong to the dispatcher
+    _localChannel = nil;
 }
 
 - (NSString *)name {
-    return [[self class] name];
+    NSString *name = _name;
+    if(!name) {
+        name = [[self class] name];
+        _name = name;
+    }
+    return name;
 }
 
 - (BOOL)isEqual:(id)object {
@@ -108,5 +160,18 @@
 #pragma mark -
 #pragma mark Private
 //............................................................................
+- (TMFChannel *)channelForPeer:(TMFPeer *)peer {
+    if(peer.localSocketPath) {
+        TMFChannel *channel = _localChannel;
+        if(!channel || ![channel isRunning]) {
+            channel = [self.delegate respondsToSelector:@selector(localChannelForCommand:)] ? [self.delegate localChannelForCommand:[self class]] : nil;
+            _localChannel = channel;
+        }
+        if(channel) {
+            return channel;
+        }
+    }
+    return self.channel;
+}
 
 @end
@@ -39,6 +39,7 @@
  */
 @protocol TMFCommandDispatcherDelegate <NSObject>
 /**
+ May be called from any thread, channels look up senders from their socket queues.
  @param address The peers address.
  @return The peer for the given address or nil if the peer is not visible / known.
  */
@@ -147,6 +148,15 @@
  */
 - (void)subscribe:(Class)commandClass peer:(TMFPeer *)peer receive:(pubSubArgumentsReceivedBlock_t)receive;
 
+/**
+ Subscribes to a command at a given remote peer, which identifies the command's messages by an interned identifier.
+ @param commandClass The class of the TMFPublishSubscribeCommand to subscribe to.
+ @param peer The peer the command should get subscribed at.
+ @param commandIdentifier The [TMFPublishSubscribeCommand commandIdentifier] sent by the peer, 0 if the peer sends the command name.
+ @param receive The receive block being executed with pushed arguments for the subscribed command.
+ */
+- (void)subscribe:(Class)commandClass peer:(TMFPeer *)peer commandIdentifier:(NSUInteger)commandIdentifier receive:(pubSubArgumentsReceivedBlock_t)receive;
+
 /**
  Unsubscribes from a command at the given remote peer.
  Nothing will happen if no corresponding subscription exists.
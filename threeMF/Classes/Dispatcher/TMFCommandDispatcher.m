@@ -26,6 +26,7 @@
 #import "TMFCommandDispatcher.h"
 #import "TMFTcpChannel.h"
 #import "TMFUdpChannel.h"
+#import "TMFSharedMemoryChannel.h"
 #import "TMFPeer.h"
 
 #import "TMFProtocol.h"
@@ -38,19 +39,26 @@
 #import "TMFRequestResponseCommand.h"
 #import "TMFHeartBeatCommand.h"
 
+#define TMF_MAX_COMMAND_IDENTIFIER 65535 /* larger identifiers are neither assigned nor accepted, they would only waste memory */
+
 static dispatch_queue_t __bonjourQueue;
 
 @interface TMFCommandDispatcher() <TMFChannelDelegate> {
     dispatch_queue_t _callBackQueue;
     NSMutableDictionary *_publishedCommands;
+    NSMutableDictionary *_commandIdentifiers; // command name -> identifier, kept on unpublishing, subscribers may still know it
+    NSUInteger _lastCommandIdentifier;
 
     TMFChannel *_systemChannel;    // main TCP channel for system commands (also published via bonjour)
+    TMFChannel *_localChannel;     // shared memory channel for peers on the same host
     TMFProtocol *_protocol;
 
     NSMutableDictionary *_channels;
     NSLock *_channelLock;
 
     NSMutableArray *_subscriptions;
+    NSMutableDictionary *_subscriptionsByPeer; // peer UUID -> (command name -> TMFSubscription)
+    NSMutableDictionary *_subscriptionsByIdentifier; // peer UUID -> TMFSubscription at index of the command identifier, NSNull for gaps
 }
 @end
 
@@ -80,15 +88,20 @@ static dispatch_queue_t __bonjourQueue;
         _delegate = delegate; // weak ref!
 
         _publishedCommands = [NSMutableDictionary new];     
+        _commandIdentifiers = [NSMutableDictionary new];
 
         _channels = [NSMutableDictionary new];
         _channelLock = [NSLock new];
 
         _subscriptions = [NSMutableArray new];
+        _subscriptionsByPeer = [NSMutableDictionary new];
+        _subscriptionsByIdentifier = [NSMutableDictionary new];
         
         _protocol = [[[self.delegate protocolClass] alloc] initWithCoder:[[self.delegate coderClass] new]];
         _systemChannel = [[[self.delegate reliableChannelClass] alloc] initWithProtocol:_protocol delegate:self];
         [_channels setObject:_systemChannel forKey:NSStringFromClass([_systemChannel class])];
+        _localChannel = [[TMFSharedMemoryChannel alloc] initWithProtocol:_protocol delegate:self];
+        [_channels setObject:_localChannel forKey:NSStringFromClass([_localChannel class])];
     }
     return self;
 }
@@ -96,6 +109,9 @@ static dispatch_queue_t __bonjourQueue;
 - (void)dealloc {
     [self stopAllCommands];
     [self stopChannels];
+    for(TMFCommand *command in [_publishedCommands allValues]) {
+        command.delegate = nil; // releases the command's channel binding
+    }
 #if ARC_HANDLES_QUEUES
     dispatch_release(_callBackQueue);
 #endif
@@ -136,6 +152,9 @@ static dispatch_queue_t __bonjourQueue;
     NSString *name = command.name;
     if(![_publishedCommands objectForKey:name]) {
         [_publishedCommands setObject:command forKey:name];
+        if([command isKindOfClass:[TMFPublishSubscribeCommand class]] && ((TMFPublishSubscribeCommand *)command).commandIdentifier == 0) {
+            ((TMFPublishSubscribeCommand *)command).commandIdentifier = [self commandIdentifierForName:name];
+        }
     }
     else {
         TMFLogError(@"Command '%@' already published. Ignored!", name);
@@ -168,6 +187,10 @@ static dispatch_queue_t __bonjourQueue;
 }
 
 - (void)subscribe:(Class)commandClass peer:(TMFPeer *)peer receive:(pubSubArgumentsReceivedBlock_t)receive {
+    [self subscribe:commandClass peer:peer commandIdentifier:0 receive:receive];
+}
+
+- (void)subscribe:(Class)commandClass peer:(TMFPeer *)peer commandIdentifier:(NSUInteger)commandIdentifier receive:(pubSubArgumentsReceivedBlock_t)receive {
     NSParameterAssert(commandClass!=nil);
     NSParameterAssert([commandClass isSubclassOfClass:[TMFCommand class]]);
     NSParameterAssert(peer!=nil);
@@ -175,8 +198,10 @@ static dispatch_queue_t __bonjourQueue;
     TMFSubscription *subscription = [self findSubscriptionForCommand:[commandClass name] atPeer:peer];
     if(!subscription) {
         subscription = [[TMFSubscription alloc] initWithPeer:peer command:commandClass receive:receive];
+        subscription.commandIdentifier = commandIdentifier;
         [self willChangeValueForKey:@"subscriptions"];
         [_subscriptions addObject:subscription];
+        [self indexSubscription:subscription];
         [self didChangeValueForKey:@"subscriptions"];
     }
 }
@@ -208,9 +233,13 @@ static dispatch_queue_t __bonjourQueue;
     }
 
     NSArray *subscriptions = [self findSubscriptionsAtPeer:peer];
-    [self willChangeValueForKey:@"subscriptions"];
-    [_subscriptions removeObjectsInArray:subscriptions];
-    [self didChangeValueForKey:@"subscriptions"];
+    if([subscriptions count] > 0) {
+        [self willChangeValueForKey:@"subscriptions"];
+        [_subscriptions removeObjectsInArray:subscriptions];
+        [_subscriptionsByPeer removeObjectForKey:peer.UUID];
+        [_subscriptionsByIdentifier removeObjectForKey:peer.UUID];
+        [self didChangeValueForKey:@"subscriptions"];
+    }
 }
 
 - (void)checkSubscriptionsForPeer:(TMFPeer *)peer {
@@ -266,20 +295,21 @@ static dispatch_queue_t __bonjourQueue;
 
 - (TMFChannel *)channelForCommand:(Class)commandClass {
     NSParameterAssert([commandClass isSubclassOfClass:[TMFCommand class]]);
-    NSParameterAssert([commandClass channelClass] != Nil);
-    NSParameterAssert([[commandClass channelClass] isSubclassOfClass:[TMFChannel class]]);
+    Class channelClass = [self channelClassForCommand:commandClass];
+    NSParameterAssert(channelClass != Nil);
+    NSParameterAssert([channelClass isSubclassOfClass:[TMFChannel class]]);
 
     [_channelLock lock];    
-    TMFChannel *channel = [_channels objectForKey:NSStringFromClass([commandClass channelClass])];
+    TMFChannel *channel = [_channels objectForKey:NSStringFromClass(channelClass)];
     if(!channel) {
         if ([commandClass isSubclassOfClass:[TMFPublishSubscribeCommand class]] && [commandClass isMulticast]) {
-            channel = [[[commandClass channelClass] alloc] initWithPort:[self.delegate multicastPort] protocol:_protocol delegate:self multicastGroup:[self.delegate multicastGroup]];
+            channel = [[channelClass alloc] initWithPort:[self.delegate multicastPort] protocol:_protocol delegate:self multicastGroup:[self.delegate multicastGroup]];
         }
         else {
-            channel = [[[commandClass channelClass] alloc] initWithProtocol:_protocol delegate:self];
+            channel = [[channelClass alloc] initWithProtocol:_protocol delegate:self];
         }
         
-        [_channels setObject:channel forKey:NSStringFromClass([commandClass channelClass])];
+        [_channels setObject:channel forKey:NSStringFromClass(channelClass)];
     }
     [_channelLock unlock];
 
@@ -291,6 +321,17 @@ static dispatch_queue_t __bonjourQueue;
     return channel;
 }
 
+- (TMFChannel *)localChannelForCommand:(Class)commandClass {
+    // co-located peers get TCP and UDP unicast commands through shared memory,
+    // multicast reaches them anyway
+    Class channelClass = [self channelClassForCommand:commandClass];
+    BOOL multicast = [commandClass isSubclassOfClass:[TMFPublishSubscribeCommand class]] && [commandClass isMulticast];
+    if([_localChannel isRunning] && !multicast && (channelClass == [self.delegate reliableChannelClass] || channelClass == [self.delegate unreliableChannelClass])) {
+        return _localChannel;
+    }
+    return nil;
+}
+
 //............................................................................
 #pragma mark TMFChannelDelegate
 //............................................................................
@@ -326,6 +367,21 @@ static dispatch_queue_t __bonjourQueue;
     }
 }
 
+- (TMFPeer *)channel:(__unused TMFChannel *)channel peerByAddress:(NSData *)address {
+    return [self.delegate peerByAddress:address];
+}
+
+- (void)receiveOnChannel:(__unused TMFChannel *)channel commandIdentifier:(NSUInteger)commandIdentifier arguments:(NSArray *)arguments address:(NSData *)address {
+    TMFPeer *sourcePeer = [self.delegate peerByAddress:address];
+    TMFSubscription *subscription = [self findSubscriptionForCommandIdentifier:commandIdentifier atPeer:sourcePeer];
+    if(subscription) {
+        TMFArguments *argumentsObject = [[[subscription.commandClass argumentsClass] alloc] initWithArgumentList:arguments];
+        dispatch_async(self.callbackQueue, ^{
+            subscription.receiveBlock(argumentsObject, sourcePeer);
+        });
+    }
+}
+
 - (dispatch_queue_t)callbackQueue {
     return _callBackQueue;
 }
@@ -334,14 +390,79 @@ static dispatch_queue_t __bonjourQueue;
 #pragma mark -
 #pragma mark Private
 //............................................................................
+- (NSUInteger)commandIdentifierForName:(NSString *)name {
+    // republished commands get their old identifier, once all are used up subscribers get the name
+    NSNumber *identifier = [_commandIdentifiers objectForKey:name];
+    if(!identifier && _lastCommandIdentifier < TMF_MAX_COMMAND_IDENTIFIER) {
+        identifier = @(++_lastCommandIdentifier);
+        [_commandIdentifiers setObject:identifier forKey:name];
+    }
+    return [identifier unsignedIntegerValue];
+}
+
+- (Class)channelClassForCommand:(Class)commandClass {
+    // commands name the default channels, the configuration decides which implementation is used
+    Class channelClass = [commandClass channelClass];
+    if(channelClass == [TMFTcpChannel class]) {
+        return [self.delegate reliableChannelClass];
+    }
+    if(channelClass == [TMFUdpChannel class]) {
+        BOOL multicast = [commandClass isSubclassOfClass:[TMFPublishSubscribeCommand class]] && [commandClass isMulticast];
+        return multicast ? [self.delegate multicastChannelClass] : [self.delegate unreliableChannelClass];
+    }
+    return channelClass;
+}
+
 - (void)unsubscribe:(TMFSubscription *)subscription {
-    if([_subscriptions containsObject:subscription]) {
+    if(subscription && [self findSubscriptionForCommand:[subscription.commandClass name] atPeer:subscription.peer] == subscription) {
         [self willChangeValueForKey:@"subscriptions"];
-        [_subscriptions removeObject:subscription];
+        [_subscriptions removeObjectIdenticalTo:subscription];
+        [self unindexSubscription:subscription];
         [self didChangeValueForKey:@"subscriptions"];
     }
 }
 
+- (void)indexSubscription:(TMFSubscription *)subscription {
+    NSMutableDictionary *peerSubscriptions = [_subscriptionsByPeer objectForKey:subscription.peer.UUID];
+    if(!peerSubscriptions) {
+        peerSubscriptions = [NSMutableDictionary new];
+        [_subscriptionsByPeer setObject:peerSubscriptions forKey:subscription.peer.UUID];
+    }
+    [peerSubscriptions setObject:subscription forKey:[subscription.commandClass name]];
+
+    NSUInteger commandIdentifier = subscription.commandIdentifier;
+    if(commandIdentifier > TMF_MAX_COMMAND_IDENTIFIER) {
+        TMFLogError(@"Invalid identifier %@ for %@.", @(commandIdentifier), subscription);
+    }
+    else if(commandIdentifier > 0) {
+        NSMutableArray *identifiedSubscriptions = [_subscriptionsByIdentifier objectForKey:subscription.peer.UUID];
+        if(!identifiedSubscriptions) {
+            identifiedSubscriptions = [NSMutableArray new];
+            [_subscriptionsByIdentifier setObject:identifiedSubscriptions forKey:subscription.peer.UUID];
+        }
+        while([identifiedSubscriptions count] <= commandIdentifier) {
+            [identifiedSubscriptions addObject:[NSNull null]];
+        }
+        [identifiedSubscriptions replaceObjectAtIndex:commandIdentifier withObject:subscription];
+    }
+}
+
+- (void)unindexSubscription:(TMFSubscription *)subscription {
+    NSMutableDictionary *peerSubscriptions = [_subscriptionsByPeer objectForKey:subscription.peer.UUID];
+    [peerSubscriptions removeObjectForKey:[subscription.commandClass name]];
+    if([peerSubscriptions count] == 0) {
+        [_subscriptionsByPeer removeObjectForKey:subscription.peer.UUID];
+    }
+
+    NSMutableArray *identifiedSubscriptions = [_subscriptionsByIdentifier objectForKey:subscription.peer.UUID];
+    if(subscription.commandIdentifier > 0 && subscription.commandIdentifier < [identifiedSubscriptions count]) {
+        [identifiedSubscriptions replaceObjectAtIndex:subscription.commandIdentifier withObject:[NSNull null]];
+    }
+    if([peerSubscriptions count] == 0) {
+        [_subscriptionsByIdentifier removeObjectForKey:subscription.peer.UUID];
+    }
+}
+
 - (void)stopAllCommands {
     for(TMFPublishSubscribeCommand *command in [self publishedCommandsOfType:[TMFRequestResponseCommand class]]) {
         if([command isRunning]) {
@@ -357,17 +478,29 @@ static dispatch_queue_t __bonjourQueue;
 }
 
 - (NSArray *)findSubscriptionsAtPeer:(TMFPeer *)peer {
-    return [_subscriptions filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(TMFSubscription *subscription, __unused NSDictionary *bindings) {
-        return [subscription.peer isEqual:peer];
-    }]];
+    if(!peer.UUID) {
+        return @[];
+    }
+    NSArray *subscriptions = [[_subscriptionsByPeer objectForKey:peer.UUID] allValues];
+    return subscriptions ? subscriptions : @[];
 }
 
 - (TMFSubscription *)findSubscriptionForCommand:(NSString *)commandName atPeer:(TMFPeer *)peer {
-    NSArray *subscriptions = [_subscriptions filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(TMFSubscription *subscription, __unused NSDictionary *bindings) {
-        return [subscription.peer isEqual:peer] && [[subscription.commandClass name] isEqual:commandName];
-    }]];
-    
-    return [subscriptions lastObject];
+    // called for every received publish subscribe message, keep it a plain hash lookup
+    if(!peer.UUID || !commandName) {
+        return nil;
+    }
+    return [[_subscriptionsByPeer objectForKey:peer.UUID] objectForKey:commandName];
+}
+
+- (TMFSubscription *)findSubscriptionForCommandIdentifier:(NSUInteger)commandIdentifier atPeer:(TMFPeer *)peer {
+    // identifiers are small, the subscription is at their index
+    NSArray *identifiedSubscriptions = peer.UUID ? [_subscriptionsByIdentifier objectForKey:peer.UUID] : nil;
+    if(commandIdentifier == 0 || commandIdentifier >= [identifiedSubscriptions count]) {
+        return nil;
+    }
+    id subscription = [identifiedSubscriptions objectAtIndex:commandIdentifier];
+    return (subscription != [NSNull null]) ? subscription : nil;
 }
 
 - (void)startChannel:(TMFChannel *)channel completion:(dispatch_block_t)completion {
@@ -376,6 +509,10 @@ static dispatch_queue_t __bonjourQueue;
             if(!error) {
                 [self.delegate dispatcher:self startedChannel:channel];
             }
+            else if(channel == _localChannel) {
+                // peers on the same host fall back to TCP and UDP
+                TMFLogInfo(@"Local channel not available %@", error);
+            }
             else {
                 [self.delegate dispatcher:self failedStartingChannel:channel error:error];
                 TMFLogError(@"Could not start %@ %@", NSStringFromClass([channel class]), error);
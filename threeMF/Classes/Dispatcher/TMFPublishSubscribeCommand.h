@@ -34,6 +34,16 @@
  */
 typedef void (^pubSubArgumentsReceivedBlock_t)(id arguments, TMFPeer *peer);
 
+/**
+ Defines what happens to arguments sent to a subscriber which is not able to keep up with reading them.
+ */
+typedef enum {
+    TMFSendQueuePolicyReject,       /* queued arguments never get dropped, sending fails while the subscriber's send queue is full */
+    TMFSendQueuePolicyDropOldest,   /* drop the oldest queued arguments of droppable commands */
+    TMFSendQueuePolicyKeepLatest,   /* replace queued arguments of the same command, only the freshest sample is kept */
+    TMFSendQueuePolicyBlock __attribute__((deprecated("sending never blocks, use TMFSendQueuePolicyReject"))) = TMFSendQueuePolicyReject
+} TMFSendQueuePolicy;
+
 /**
  This abstract class describes a command following the publish subscribe pattern.
 
@@ -71,6 +81,7 @@ typedef void (^pubSubArgumentsReceivedBlock_t)(id arguments, TMFPeer *peer);
     - Override [TMFPublishSubscribeCommand isReliable] and return YES to use TCP instead of UDP
     - Override [TMFPublishSubscribeCommand isRealTime] and return YES to disable Nagle's algorithm for TCP
     - Override [TMFPublishSubscribeCommand isMulticast] and return YES if you want to use UDP multicast instead of UDP unicast.
+    - Override [TMFPublishSubscribeCommand sendQueuePolicy] to define how reliable commands handle slow subscribers.
     - Override [TMFPublishSubscribeCommand defaultConfiguration] if you want a default configuration.
  2. Command startup / shutdown
     - Override [TMFPublishSubscribeCommand start:] to setup the service (if needed, can also be triggered from "outside")
@@ -107,6 +118,13 @@ typedef void (^pubSubArgumentsReceivedBlock_t)(id arguments, TMFPeer *peer);
  */
 @property (nonatomic, readonly, copy) NSArray *subscribers;
 
+/**
+ Small number identifying the command in messages to subscribers, 0 if the command is not published
+ or the publisher ran out of identifiers. Subscribers then receive the command name.
+ Assigned by the TMFCommandDispatcher on publishing and sent to subscribers with the TMFSubscribeCommand response.
+ */
+@property (nonatomic) NSUInteger commandIdentifier;
+
 /**
  Defines if a command is using UDP multi-cast for data transmission.
  Default value is NO.
@@ -132,6 +150,15 @@ typedef void (^pubSubArgumentsReceivedBlock_t)(id arguments, TMFPeer *peer);
  */
 + (BOOL)isRealTime;
 
+/**
+ Defines how arguments get queued for reliable subscribers which read slower than the command sends.
+ The send queue of each subscriber is bounded, the policy decides what happens once it is full.
+ The default value is TMFSendQueuePolicyKeepLatest for real time commands and TMFSendQueuePolicyReject otherwise,
+ override this method in your command class if you want to change it.
+ Setting this value for unreliable commands will have no effect.
+ */
++ (TMFSendQueuePolicy)sendQueuePolicy;
+
 /**
  The standard configuration for the command which will be used if no configuration is transmitted on subscription.
  The default value is nil.
@@ -80,6 +80,10 @@
     return NO;
 }
 
++ (TMFSendQueuePolicy)sendQueuePolicy {
+    return [self isRealTime] ? TMFSendQueuePolicyKeepLatest : TMFSendQueuePolicyReject;
+}
+
 - (void)sendWithArguments:(TMFArguments *)arguments {
     NSParameterAssert([[self class] argumentsClass] != Nil); // needs to be overriden or exist according to the naming convetion.
     NSParameterAssert(arguments != nil);
@@ -87,9 +91,8 @@
         [super sendWithArguments:arguments destination:nil response:NULL];
     }
     else {
-        for(TMFPeer *subscriber in [_subscribers copy]) {
-            [super sendWithArguments:arguments destination:subscriber response:NULL];
-        }
+        // encode once for all subscribers
+        [super sendWithArguments:arguments destinations:[_subscribers copy]];
     }
 }
 
@@ -42,7 +42,7 @@
 /**
  This protocol defines defautl 3MF de- serialization.
  TMFSerializable has to be adapted by each object that should be able to transmittet to any TMFPeer.
- Each de-/serialization should be JSON compatible.
+ Each de-/serialization should be JSON compatible, binary data may be kept as NSData.
  */
 @protocol TMFSerializable <NSObject>
 @required
@@ -42,13 +42,13 @@ NSString * const TMFSerializableObjectClassKey;
 
  Properties can get excluded by providing their names in [TMFSerializableObject notSerializableKeys].
 
- The automatic serialization creates JSON compatible dictionaries.
+ The automatic serialization creates JSON compatible dictionaries, except for binary data.
  Allowed types are:
 
  - NSString
  - NSNumber objects and primitives like NSInteger, BOOL, CGFloat...
  - NSDate (gets encoded as string)
- - NSData (gets encoded as Base64 string)
+ - NSData (stays NSData, TMFProtocol transfers it as raw attachment of the message)
  - TMFSerializableObject
  - NSDictionary (can contain any other supported type)
  - NSArray (can contain any other supported type)
@@ -62,12 +62,14 @@ NSString * const TMFSerializableObjectClassKey;
 
 /**
  Extracts a classes (and it's super classes) property list excluding read only properties and properties contained in notSerializableKeys.
+ The list is extracted once per class, see TMFSerializationPlan.
  @return set of serializable class properties.
  */
 - (NSSet *)serializableKeys;
 
 /**
  Set of excluding property names used in serializableKeys. Nil by default.
+ The set is requested once per class and must not change.
  @return set of not serializable class properties.
  */
 - (NSSet *)notSerializableKeys;
@@ -87,12 +89,19 @@ NSString * const TMFSerializableObjectClassKey;
 + (id)decode:(id)value;
 
 /**
- Encodes binary data for JSON RPC.
+ Encodes binary data as string, e.g. for storing serialized objects as JSON.
  @param dataToEncode The data object to encode.
  @return The data encoded as NSString.
  */
 + (NSString *)encodeBinaryData:(NSData *)dataToEncode;
 
+/**
+ Checks if a value is binary data encoded by encodeBinaryData:.
+ @param value The value to check.
+ @return YES if the value is a string containing encoded binary data.
+ */
++ (BOOL)isEncodedBinaryData:(id)value;
+
 /**
  Decodes previously encoded binary data from strings to data.
  @param encodedData The data encoded as NSString.
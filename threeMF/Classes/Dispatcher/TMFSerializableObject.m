@@ -24,12 +24,10 @@
 //
 
 #import "TMFSerializableObject.h"
-#import <objc/runtime.h> 
+#import "TMFSerializationPlan.h"
 #import "TMFLog.h"
 #import "ybase64.h"
 
-static NSMutableDictionary *__serializableKeysByClass;
-static NSMutableDictionary *__propertyTypesByClass;
 static NSArray *__numberEncodings;
 
 NSString * const TMFSerializableObjectClassKey = @"_class";
@@ -77,59 +75,7 @@ NSString * const TMFSerializableObjectClassKey = @"_class";
 #pragma mark Public
 //............................................................................
 - (NSSet *)serializableKeys {
-    @synchronized([NSObject class]) {
-        static dispatch_once_t onceToken;
-        dispatch_once(&onceToken, ^{
-            __serializableKeysByClass = [NSMutableDictionary new];
-        });
-
-        Class class = [self class];
-        NSString *className = NSStringFromClass(class);
-        NSMutableSet *keys = [__serializableKeysByClass objectForKey:className];        
-        if (keys == nil) {
-            keys = [NSMutableSet set];
-            unsigned int propertyCount;
-
-            // walk class hierarchy 
-            while (class != [NSObject class]) {
-                objc_property_t *properties = class_copyPropertyList(class, &propertyCount);
-                // extract each property
-                for (int i = 0; i < propertyCount; i++) {
-                    objc_property_t property = properties[i];
-                    NSString *key = [NSString stringWithCString:property_getName(property) encoding:NSUTF8StringEncoding];
-
-                    BOOL isReadOnly = NO;
-                    const char *attributes = property_getAttributes(property);
-                    NSString *encoding = [NSString stringWithCString:attributes encoding:NSUTF8StringEncoding];
-                    if ([[encoding componentsSeparatedByString:@","] containsObject:@"R"]) {
-                        isReadOnly = YES;
-
-                        //see if there is a backing ivar with a KVC-compliant name
-                        NSRange iVarRange = [encoding rangeOfString:@",V"];
-                        if (iVarRange.location != NSNotFound) {
-                            NSString *iVarName = [encoding substringFromIndex:iVarRange.location + 2];
-                            if ([iVarName isEqualToString:key] || [iVarName isEqualToString:[@"_" stringByAppendingString:key]]) {
-                                isReadOnly = NO;
-                            }
-                        }
-                    }
-
-                    if (!isReadOnly) {
-                        [keys addObject:key];
-                    }
-                }
-                free(properties);
-                class = [class superclass];
-            }
-            // cache properties
-            [__serializableKeysByClass setObject:keys forKey:className];
-        }
-
-        if([self notSerializableKeys]) {
-            [keys minusSet:[self notSerializableKeys]];
-        }
-        return keys;
-    }
+    return [[TMFSerializationPlan planForObject:self] keys];
 }
 
 - (NSSet *)notSerializableKeys {
@@ -158,7 +104,7 @@ NSString * const TMFSerializableObjectClassKey = @"_class";
         return @([((NSDate *)value) timeIntervalSince1970]);
     }
     else if([value isKindOfClass:[NSData class]]) {
-        return [self encodeBinaryData:value];
+        return value; // the protocol transfers binary data as raw attachment
     }
     else if([value isKindOfClass:[NSNumber class]] || [value isKindOfClass:[NSString class]]) {
         return value;
@@ -189,9 +135,12 @@ NSString * const TMFSerializableObjectClassKey = @"_class";
         else if([value isKindOfClass:[NSArray class]]) {
             return [self traverseArray:value withSelector:_cmd];
         }
-        else if([value isKindOfClass:[NSString class]] && [value hasPrefix:kBinaryDataPrefix] && [value hasSuffix:kBinaryDataSuffix]) {
+        else if([self isEncodedBinaryData:value]) {
             return [self decodeBinaryData:value];
         }
+        else if([value isKindOfClass:[NSData class]]) { // binary coders deliver raw data
+            return value;
+        }
         else if([__numberEncodings containsObject:[NSString stringWithUTF8String:@encode(typeof(value))]]) {
             return [[NSNumber alloc] initWithBytes:&value objCType:@encode(typeof(value))];
         }
@@ -213,6 +162,10 @@ NSString * const TMFSerializableObjectClassKey = @"_class";
     return [NSString stringWithFormat:@"%@%@%@", kBinaryDataPrefix, enc, kBinaryDataSuffix];
 }
 
++ (BOOL)isEncodedBinaryData:(id)value {
+    return [value isKindOfClass:[NSString class]] && [value hasPrefix:kBinaryDataPrefix] && [value hasSuffix:kBinaryDataSuffix];
+}
+
 + (NSData *)decodeBinaryData:(NSString *)encodedData {  
     if([encodedData isKindOfClass:[NSString class]]) {
         NSMutableString *encData = [[NSMutableString alloc] initWithString:encodedData];
@@ -231,91 +184,13 @@ NSString * const TMFSerializableObjectClassKey = @"_class";
 #pragma mark -
 #pragma mark Override
 //............................................................................
-- (NSMutableDictionary *)serializedObject {    
-    NSMutableDictionary *serializedObject = [[NSMutableDictionary alloc] initWithObjectsAndKeys:NSStringFromClass([self class]),TMFSerializableObjectClassKey, nil];
-    for(NSString *key in [self serializableKeys]) {
-        id value = [self valueForKey:key];
-        [serializedObject setValue:[TMFSerializableObject encode:value] forKey:key];
-    }
-    
-    return serializedObject;
+- (NSMutableDictionary *)serializedObject {
+    return [[TMFSerializationPlan planForObject:self] serializeObject:self];
 }
 
 - (void)updateFromSerializedObject:(NSDictionary *)serializedObject {
     if(serializedObject) {
-        static dispatch_once_t onceToken;
-        dispatch_once(&onceToken, ^{
-            __propertyTypesByClass = [NSMutableDictionary new];
-        });
-
-        // cache types
-        Class class = [self class];
-        NSString *className = NSStringFromClass(class);
-        NSMutableDictionary *propertyTypes = [__propertyTypesByClass objectForKey:className];
-        if(!propertyTypes) {
-            propertyTypes = [NSMutableDictionary new];
-            for(NSString *key in [self serializableKeys]) {
-                objc_property_t theProperty = class_getProperty(class, [key UTF8String]);
-                const char * propertyAttrs = property_getAttributes(theProperty);
-                NSString *propertyAttrsS = [NSString stringWithUTF8String:propertyAttrs];
-                NSString *type = [[propertyAttrsS substringToIndex:[propertyAttrsS rangeOfString:@","].location] substringFromIndex:1];
-                [propertyTypes setObject:type forKey:key];
-            }
-
-            [__propertyTypesByClass setObject:propertyTypes forKey:className];
-        }
-
-        // decode
-        for(NSString *key in [self serializableKeys]) {
-            NSString *type = [propertyTypes objectForKey:key];
-            id value = NilIfNSNull([serializedObject objectForKey:key]);
-
-            if(value != nil) {
-                if([type hasPrefix:@"@"]) {
-                    if([type length]>1) {
-                        Class class = NSClassFromString([[type substringToIndex:[type length]-1] substringFromIndex:2]);
-
-                        if([class isSubclassOfClass:[NSDictionary class]] || [class isSubclassOfClass:[NSArray class]]) {
-                            value = [TMFSerializableObject decode:value];
-                        }
-                        else if([class isSubclassOfClass:[NSSet class]]) {
-                            value = [TMFSerializableObject decode:value];
-                            if(value !=  nil) {
-                                value = [NSSet setWithArray:value];
-                            }
-                        }
-                        else if([class isSubclassOfClass:[NSData class]]) {
-                            value = NilIfNSNull([TMFSerializableObject decode:value]);
-                        }
-                        else if ([class isSubclassOfClass:[NSDate class]]) {
-                            if(value != nil) {
-                                value = [NSDate dateWithTimeIntervalSince1970:[value doubleValue]];
-                            }
-                        }
-                        else if ([class conformsToProtocol:@protocol(TMFSerializable)]) {
-                            Class valueClass = NSClassFromString([value objectForKey:TMFSerializableObjectClassKey]);
-                            if(valueClass) {
-                                value = [[valueClass alloc] initWithSerializedObject:value];
-                            }
-                        }
-                        else if([class isSubclassOfClass:[NSString class]] || [class isSubclassOfClass:[NSNumber class]]) {
-                            value = NilIfNSNull(value);
-                        }
-                        else {
-                            TMFLogError(@"Not supported type %@ property in %@.", NSStringFromClass(class), NSStringFromClass([self class]));
-                        }
-                    }
-                }
-                else if([__numberEncodings containsObject:[NSString stringWithUTF8String:@encode(typeof(value))]]) {
-                    value = [[NSNumber alloc] initWithBytes:&value objCType:@encode(typeof(value))];
-                }
-
-                value = NilIfNSNull(value);
-                if(value != nil) {
-                    [self setValue:value forKey:key];
-                }
-            }
-        }
+        [[TMFSerializationPlan planForObject:self] updateObject:self fromSerializedObject:serializedObject];
     }
 }
 
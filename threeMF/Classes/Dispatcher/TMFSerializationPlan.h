@@ -0,0 +1,99 @@
+//
+//  TMFSerializationPlan.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+
+@class TMFSerializableObject;
+
+/**
+ Precompiled serialization plan of a TMFSerializableObject subclass.
+
+ A plan gets created once per class. It holds the serializable properties together with their resolved
+ types and accessor implementations, so serializing an object is a loop over the fields without any
+ property attribute parsing, class name lookups or key value coding.
+ Plans are immutable and can be used from any thread.
+ */
+@interface TMFSerializationPlan : NSObject
+
+/**
+ Name of the planned class, used as TMFSerializableObjectClassKey value.
+ */
+@property (nonatomic, readonly, copy) NSString *className;
+
+/**
+ Serializable property names of the planned class.
+ */
+@property (nonatomic, readonly) NSSet *keys;
+
+/**
+ Serializable property names of the planned class in **alphabetical order**.
+ */
+@property (nonatomic, readonly) NSArray *orderedKeys;
+
+/**
+ YES if the planned class overrides [TMFSerializable serializedObject] or [TMFSerializable updateFromSerializedObject:].
+ Values of such classes must not be accessed by the plan directly.
+ */
+@property (nonatomic, readonly) BOOL customSerialization;
+
+/**
+ Gets the plan for an object's class, the plan is created on first use.
+ [TMFSerializableObject notSerializableKeys] of the given object is evaluated once for the class.
+ @param object An instance of the class to get the plan for. Must not be nil.
+ @return The serialization plan of the object's class.
+ */
++ (TMFSerializationPlan *)planForObject:(TMFSerializableObject *)object;
+
+/**
+ Serializes all planned properties of an object.
+ @param object An instance of the planned class.
+ @return dictionary representation including TMFSerializableObjectClassKey.
+ */
+- (NSMutableDictionary *)serializeObject:(TMFSerializableObject *)object;
+
+/**
+ Updates all planned properties of an object contained in a dictionary representation.
+ @param object An instance of the planned class.
+ @param serializedObject dictionary representation.
+ */
+- (void)updateObject:(TMFSerializableObject *)object fromSerializedObject:(NSDictionary *)serializedObject;
+
+/**
+ Serializes all planned properties of an object in the order of orderedKeys.
+ @param object An instance of the planned class.
+ @return list of serialized property values.
+ */
+- (NSMutableArray *)serializeValuesOfObject:(TMFSerializableObject *)object;
+
+/**
+ Updates all planned properties of an object from a list of serialized values.
+ @param object An instance of the planned class.
+ @param values list of serialized property values in the order of orderedKeys, must contain a value for each key.
+ */
+- (void)updateObject:(TMFSerializableObject *)object fromValues:(NSArray *)values;
+
+@end
@@ -0,0 +1,411 @@
+//
+//  TMFSerializationPlan.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFSerializationPlan.h"
+#import "TMFSerializableObject.h"
+#import "TMFLog.h"
+
+#import <objc/runtime.h>
+#include <stdatomic.h>
+
+typedef NS_ENUM(NSUInteger, TMFSerializationFieldKind) {
+    TMFSerializationFieldPrimitive,     /* number types, boxed as NSNumber */
+    TMFSerializationFieldValue,         /* id, NSString and NSNumber, taken as they are */
+    TMFSerializationFieldCollection,    /* NSArray and NSDictionary */
+    TMFSerializationFieldSet,           /* NSSet, serialized as array */
+    TMFSerializationFieldData,          /* NSData */
+    TMFSerializationFieldDate,          /* NSDate, serialized as time interval */
+    TMFSerializationFieldSerializable,  /* objects conforming to TMFSerializable */
+    TMFSerializationFieldUnsupported,   /* objects of unsupported classes */
+    TMFSerializationFieldOther          /* structs and other C types, accessed by key value coding */
+};
+
+typedef struct {
+    __unsafe_unretained NSString *key;
+    __unsafe_unretained NSString *valueClassName;
+    __unsafe_unretained Class valueClass;
+    TMFSerializationFieldKind kind;
+    char type;                          /* objective-c type encoding of primitives */
+    SEL getter;
+    SEL setter;                         /* NULL for read only properties backed by an ivar */
+    IMP getterIMP;
+    IMP setterIMP;
+} TMFSerializationField;
+
+// class -> plan, replaced as a whole when a plan is added so readers never lock
+static _Atomic(CFDictionaryRef) __plans;
+// replaced tables may still be read concurrently, there is one per serializable class
+static NSMutableArray *__replacedPlans;
+
+@interface TMFSerializationPlan() {
+    Class _class;
+    TMFSerializationField *_fields;
+    NSUInteger _count;
+    NSMutableArray *_strings; // retains the strings referenced by _fields
+}
+@end
+
+@implementation TMFSerializationPlan
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithObject:(TMFSerializableObject *)object {
+    self = [super init];
+    if(self) {
+        _class = [object class];
+        _className = NSStringFromClass(_class);
+        _strings = [NSMutableArray new];
+
+        // walk class hierarchy, properties of sub classes win
+        NSMutableDictionary *properties = [NSMutableDictionary new];
+        Class class = _class;
+        while (class != [NSObject class]) {
+            unsigned int propertyCount;
+            objc_property_t *classProperties = class_copyPropertyList(class, &propertyCount);
+            for (unsigned int i = 0; i < propertyCount; i++) {
+                NSString *key = [NSString stringWithCString:property_getName(classProperties[i]) encoding:NSUTF8StringEncoding];
+                if(![properties objectForKey:key] && [self isSerializableProperty:classProperties[i] key:key]) {
+                    [properties setObject:[NSValue valueWithPointer:classProperties[i]] forKey:key];
+                }
+            }
+            free(classProperties);
+            class = [class superclass];
+        }
+
+        NSSet *notSerializableKeys = [object notSerializableKeys];
+        if(notSerializableKeys) {
+            [properties removeObjectsForKeys:[notSerializableKeys allObjects]];
+        }
+
+        _keys = [NSSet setWithArray:[properties allKeys]];
+        _orderedKeys = [[properties allKeys] sortedArrayUsingSelector:@selector(caseInsensitiveCompare:)];
+        _customSerialization = ([self overridesSelector:@selector(serializedObject)] || [self overridesSelector:@selector(updateFromSerializedObject:)]);
+
+        _count = [_orderedKeys count];
+        _fields = calloc(MAX(_count, 1), sizeof(TMFSerializationField));
+        NSUInteger i = 0;
+        for(NSString *key in _orderedKeys) {
+            [self planField:&_fields[i] key:key property:[[properties objectForKey:key] pointerValue]];
+            i++;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_fields);
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
++ (TMFSerializationPlan *)planForObject:(TMFSerializableObject *)object {
+    NSParameterAssert(object!=nil);
+    Class class = [object class];
+    CFDictionaryRef plans = atomic_load_explicit(&__plans, memory_order_acquire);
+    TMFSerializationPlan *plan = (plans ? (__bridge TMFSerializationPlan *)CFDictionaryGetValue(plans, (__bridge const void *)class) : nil);
+    if(!plan) {
+        plan = [self addPlanForObject:object];
+    }
+    return plan;
+}
+
+#define TMF_GET_NUMBER(T) @(((T (*)(id, SEL))imp)(object, field->getter))
+#define TMF_SET_NUMBER(T, accessor) ((void (*)(id, SEL, T))imp)(object, field->setter, [number accessor])
+
+static inline NSNumber *TMFSerializationGetNumber(id object, const TMFSerializationField *field, IMP imp) {
+    switch (field->type) {
+        case 'c': return TMF_GET_NUMBER(char);
+        case 'i': return TMF_GET_NUMBER(int);
+        case 's': return TMF_GET_NUMBER(short);
+        case 'l': return TMF_GET_NUMBER(long);
+        case 'q': return TMF_GET_NUMBER(long long);
+        case 'C': return TMF_GET_NUMBER(unsigned char);
+        case 'I': return TMF_GET_NUMBER(unsigned int);
+        case 'S': return TMF_GET_NUMBER(unsigned short);
+        case 'L': return TMF_GET_NUMBER(unsigned long);
+        case 'Q': return TMF_GET_NUMBER(unsigned long long);
+        case 'f': return TMF_GET_NUMBER(float);
+        case 'd': return TMF_GET_NUMBER(double);
+        case 'B': return TMF_GET_NUMBER(bool);
+    }
+    return nil;
+}
+
+static inline void TMFSerializationSetNumber(id object, const TMFSerializationField *field, IMP imp, NSNumber *number) {
+    switch (field->type) {
+        case 'c': TMF_SET_NUMBER(char, charValue); break;
+        case 'i': TMF_SET_NUMBER(int, intValue); break;
+        case 's': TMF_SET_NUMBER(short, shortValue); break;
+        case 'l': TMF_SET_NUMBER(long, longValue); break;
+        case 'q': TMF_SET_NUMBER(long long, longLongValue); break;
+        case 'C': TMF_SET_NUMBER(unsigned char, unsignedCharValue); break;
+        case 'I': TMF_SET_NUMBER(unsigned int, unsignedIntValue); break;
+        case 'S': TMF_SET_NUMBER(unsigned short, unsignedShortValue); break;
+        case 'L': TMF_SET_NUMBER(unsigned long, unsignedLongValue); break;
+        case 'Q': TMF_SET_NUMBER(unsigned long long, unsignedLongLongValue); break;
+        case 'f': TMF_SET_NUMBER(float, floatValue); break;
+        case 'd': TMF_SET_NUMBER(double, doubleValue); break;
+        case 'B': TMF_SET_NUMBER(bool, boolValue); break;
+    }
+}
+
+static id TMFSerializationGetValue(TMFSerializableObject *object, const TMFSerializationField *field, Class class, BOOL planned) {
+    if(field->kind == TMFSerializationFieldOther) {
+        return [TMFSerializableObject encode:[object valueForKey:field->key]];
+    }
+
+    IMP imp = (planned ? field->getterIMP : class_getMethodImplementation(class, field->getter));
+    if(field->kind == TMFSerializationFieldPrimitive) {
+        return TMFSerializationGetNumber(object, field, imp);
+    }
+    return [TMFSerializableObject encode:((id (*)(id, SEL))imp)(object, field->getter)];
+}
+
+static void TMFSerializationSetValue(TMFSerializableObject *object, const TMFSerializationField *field, Class class, BOOL planned, id value, NSString *className) {
+    value = NilIfNSNull(value);
+    if(value == nil) {
+        return;
+    }
+
+    switch (field->kind) {
+        case TMFSerializationFieldCollection:
+        case TMFSerializationFieldData:
+            value = [TMFSerializableObject decode:value];
+            break;
+        case TMFSerializationFieldSet:
+            value = [TMFSerializableObject decode:value];
+            value = ([value isKindOfClass:[NSArray class]] ? [NSSet setWithArray:value] : nil);
+            break;
+        case TMFSerializationFieldDate:
+            value = ([value respondsToSelector:@selector(doubleValue)] ? [NSDate dateWithTimeIntervalSince1970:[value doubleValue]] : nil);
+            break;
+        case TMFSerializationFieldSerializable:
+            if([value isKindOfClass:[NSDictionary class]]) {
+                NSString *valueClassName = [value objectForKey:TMFSerializableObjectClassKey];
+                Class valueClass = ([valueClassName isEqualToString:field->valueClassName] ? field->valueClass : NSClassFromString(valueClassName));
+                if(valueClass) {
+                    value = [[valueClass alloc] initWithSerializedObject:value];
+                }
+            }
+            break;
+        case TMFSerializationFieldUnsupported:
+            TMFLogError(@"Not supported type %@ property in %@.", field->valueClassName, className);
+            break;
+        default:
+            break;
+    }
+
+    value = NilIfNSNull(value);
+    if(value == nil) {
+        return;
+    }
+
+    if(field->setter == NULL || field->kind == TMFSerializationFieldOther ||
+       (field->kind == TMFSerializationFieldPrimitive && ![value isKindOfClass:[NSNumber class]])) {
+        [object setValue:value forKey:field->key];
+    }
+    else {
+        IMP imp = (planned ? field->setterIMP : class_getMethodImplementation(class, field->setter));
+        if(field->kind == TMFSerializationFieldPrimitive) {
+            TMFSerializationSetNumber(object, field, imp, value);
+        }
+        else {
+            ((void (*)(id, SEL, id))imp)(object, field->setter, value);
+        }
+    }
+}
+
+- (NSMutableDictionary *)serializeObject:(TMFSerializableObject *)object {
+    NSMutableDictionary *serializedObject = [[NSMutableDictionary alloc] initWithCapacity:_count + 1];
+    [serializedObject setObject:_className forKey:TMFSerializableObjectClassKey];
+
+    Class class = object_getClass(object);
+    BOOL planned = (class == _class); // observed objects have a different runtime class
+    for(NSUInteger i = 0; i < _count; i++) {
+        [serializedObject setObject:TMFSerializationGetValue(object, &_fields[i], class, planned) forKey:_fields[i].key];
+    }
+    return serializedObject;
+}
+
+- (void)updateObject:(TMFSerializableObject *)object fromSerializedObject:(NSDictionary *)serializedObject {
+    Class class = object_getClass(object);
+    BOOL planned = (class == _class);
+    for(NSUInteger i = 0; i < _count; i++) {
+        TMFSerializationSetValue(object, &_fields[i], class, planned, [serializedObject objectForKey:_fields[i].key], _className);
+    }
+}
+
+- (NSMutableArray *)serializeValuesOfObject:(TMFSerializableObject *)object {
+    NSMutableArray *values = [[NSMutableArray alloc] initWithCapacity:_count];
+    Class class = object_getClass(object);
+    BOOL planned = (class == _class);
+    for(NSUInteger i = 0; i < _count; i++) {
+        [values addObject:TMFSerializationGetValue(object, &_fields[i], class, planned)];
+    }
+    return values;
+}
+
+- (void)updateObject:(TMFSerializableObject *)object fromValues:(NSArray *)values {
+    NSParameterAssert([values count] == _count);
+    Class class = object_getClass(object);
+    BOOL planned = (class == _class);
+    NSUInteger i = 0;
+    for(id value in values) {
+        TMFSerializationSetValue(object, &_fields[i], class, planned, value, _className);
+        i++;
+    }
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
++ (TMFSerializationPlan *)addPlanForObject:(TMFSerializableObject *)object {
+    @synchronized(self) {
+        Class class = [object class];
+        CFDictionaryRef previousPlans = atomic_load_explicit(&__plans, memory_order_relaxed); // only replaced while synchronized
+        TMFSerializationPlan *plan = (previousPlans ? (__bridge TMFSerializationPlan *)CFDictionaryGetValue(previousPlans, (__bridge const void *)class) : nil);
+        if(!plan) {
+            plan = [[TMFSerializationPlan alloc] initWithObject:object];
+
+            CFMutableDictionaryRef plans = (previousPlans ? CFDictionaryCreateMutableCopy(NULL, 0, previousPlans) : CFDictionaryCreateMutable(NULL, 0, NULL, &kCFTypeDictionaryValueCallBacks));
+            CFDictionarySetValue(plans, (__bridge const void *)class, (__bridge const void *)plan);
+
+            if(previousPlans) {
+                if(!__replacedPlans) {
+                    __replacedPlans = [NSMutableArray new];
+                }
+                [__replacedPlans addObject:CFBridgingRelease(previousPlans)];
+            }
+
+            // publish the complete table
+            atomic_store_explicit(&__plans, plans, memory_order_release);
+        }
+        return plan;
+    }
+}
+
+- (BOOL)overridesSelector:(SEL)selector {
+    return class_getMethodImplementation(_class, selector) != class_getMethodImplementation([TMFSerializableObject class], selector);
+}
+
+- (BOOL)isSerializableProperty:(objc_property_t)property key:(NSString *)key {
+    char *readOnly = property_copyAttributeValue(property, "R");
+    if(!readOnly) {
+        return YES;
+    }
+    free(readOnly);
+
+    // see if there is a backing ivar with a KVC-compliant name
+    BOOL serializable = NO;
+    char *ivar = property_copyAttributeValue(property, "V");
+    if(ivar) {
+        NSString *ivarName = [NSString stringWithCString:ivar encoding:NSUTF8StringEncoding];
+        serializable = ([ivarName isEqualToString:key] || [ivarName isEqualToString:[@"_" stringByAppendingString:key]]);
+        free(ivar);
+    }
+    return serializable;
+}
+
+- (void)planField:(TMFSerializationField *)field key:(NSString *)key property:(objc_property_t)property {
+    [_strings addObject:key];
+    field->key = key;
+
+    char *type = property_copyAttributeValue(property, "T");
+    if(type[0] == '@') {
+        field->kind = TMFSerializationFieldValue;
+        if(type[1] == '"') {
+            // @"ClassName" or @"ClassName<Protocol>"
+            NSString *name = [[NSString alloc] initWithCString:type + 2 encoding:NSUTF8StringEncoding];
+            NSUInteger end = [name rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"\"<"]].location;
+            name = (end != NSNotFound ? [name substringToIndex:end] : name);
+            if([name length] > 0) {
+                [_strings addObject:name];
+                field->valueClassName = name;
+                field->valueClass = NSClassFromString(name);
+                field->kind = [self kindForClass:field->valueClass];
+            }
+        }
+    }
+    else if(type[0] != '\0' && type[1] == '\0' && strchr("cislqCISLQfdB", type[0]) != NULL) {
+        field->kind = TMFSerializationFieldPrimitive;
+        field->type = type[0];
+    }
+    else {
+        field->kind = TMFSerializationFieldOther;
+    }
+    free(type);
+
+    char *getter = property_copyAttributeValue(property, "G");
+    field->getter = (getter ? sel_registerName(getter) : NSSelectorFromString(key));
+    field->getterIMP = class_getMethodImplementation(_class, field->getter);
+    free(getter);
+
+    char *readOnly = property_copyAttributeValue(property, "R");
+    if(readOnly) {
+        free(readOnly);
+    }
+    else {
+        char *setter = property_copyAttributeValue(property, "S");
+        if(setter) {
+            field->setter = sel_registerName(setter);
+            free(setter);
+        }
+        else {
+            field->setter = NSSelectorFromString([NSString stringWithFormat:@"set%@%@:", [[key substringToIndex:1] uppercaseString], [key substringFromIndex:1]]);
+        }
+        field->setterIMP = class_getMethodImplementation(_class, field->setter);
+    }
+}
+
+- (TMFSerializationFieldKind)kindForClass:(Class)class {
+    if(class == Nil) {
+        return TMFSerializationFieldUnsupported;
+    }
+    else if([class isSubclassOfClass:[NSDictionary class]] || [class isSubclassOfClass:[NSArray class]]) {
+        return TMFSerializationFieldCollection;
+    }
+    else if([class isSubclassOfClass:[NSSet class]]) {
+        return TMFSerializationFieldSet;
+    }
+    else if([class isSubclassOfClass:[NSData class]]) {
+        return TMFSerializationFieldData;
+    }
+    else if([class isSubclassOfClass:[NSDate class]]) {
+        return TMFSerializationFieldDate;
+    }
+    else if([class conformsToProtocol:@protocol(TMFSerializable)]) {
+        return TMFSerializationFieldSerializable;
+    }
+    else if([class isSubclassOfClass:[NSString class]] || [class isSubclassOfClass:[NSNumber class]]) {
+        return TMFSerializationFieldValue;
+    }
+    return TMFSerializationFieldUnsupported;
+}
+
+@end
@@ -33,6 +33,8 @@
 /**
  System command used to subscribe to a TMFPublishSubscribeCommand at a peer.
  The corresponding arguments class is TMFSubscribeCommandArguments.
+ Publishers of version 2.x respond with the command's [TMFPublishSubscribeCommand commandIdentifier],
+ their messages to 2.x subscribers carry this identifier instead of the command name.
 
  - unique name: _unsub
  - system command
@@ -0,0 +1,57 @@
+//
+//  TMFAttachmentReference.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Reference to a binary attachment of a message body.
+
+ TMFProtocol replaces binary data within request arguments and response results with references before
+ a message gets encoded and the references with the received attachments after it got decoded.
+ Coders have to encode references distinguishable from any other value.
+ */
+@interface TMFAttachmentReference : NSObject
+
+/**
+ Index of the attachment within the message body.
+ */
+@property (nonatomic, readonly) NSUInteger index;
+
+/**
+ Initializes a new reference.
+ @param index Index of the attachment within the message body.
+ */
+- (id)initWithIndex:(NSUInteger)index;
+
+/**
+ Creates a new reference.
+ @param index Index of the attachment within the message body.
+ @return A new reference to the attachment at index.
+ */
++ (TMFAttachmentReference *)referenceWithIndex:(NSUInteger)index;
+
+@end
@@ -0,0 +1,65 @@
+//
+//  TMFAttachmentReference.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFAttachmentReference.h"
+
+@implementation TMFAttachmentReference
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithIndex:(NSUInteger)index {
+    self = [super init];
+    if(self) {
+        _index = index;
+    }
+    return self;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
++ (TMFAttachmentReference *)referenceWithIndex:(NSUInteger)index {
+    return [[self alloc] initWithIndex:index];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Override
+//............................................................................
+- (BOOL)isEqual:(id)object {
+    return [object isKindOfClass:[TMFAttachmentReference class]] && ((TMFAttachmentReference *)object)->_index == _index;
+}
+
+- (NSUInteger)hash {
+    return _index;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %@>", NSStringFromClass([self class]), @(_index)];
+}
+
+@end
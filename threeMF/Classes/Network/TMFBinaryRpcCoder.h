@@ -0,0 +1,51 @@
+//
+//  TMFBinaryRpcCoder.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "TMFProtocolCoder.h"
+
+/**
+ Compact binary TMFProtocol coder.
+
+ Requests and responses are encoded positionally without any key names. Every value starts
+ with a one byte type tag followed by its payload:
+
+ - integers as zig-zag varints
+ - floating point numbers as raw little endian float64
+ - strings and binary data as varint length followed by the raw bytes
+ - arrays and dictionaries as varint element count followed by the elements
+ - attachment references as varint index
+
+ Binary data is transferred as raw bytes instead of Base64 strings.
+
+ Overwrite the TMFConnector's coderClass method to return [TMFBinaryRpcCoder class]
+ in order to use binary encoding. All peers have to use the same coder, the coder's name
+ gets published as part of the protocol identifier.
+ */
+@interface TMFBinaryRpcCoder : NSObject <TMFProtocolCoder>
+
+@end
@@ -0,0 +1,421 @@
+//
+//  TMFBinaryRpcCoder.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFBinaryRpcCoder.h"
+#import "TMFSerializableObject.h"
+#import "TMFAttachmentReference.h"
+#import "TMFLog.h"
+
+#import <libkern/OSByteOrder.h>
+
+#define kMessageTypeRequest     0x51 /* 'Q' */
+#define kMessageTypeResponse    0x52 /* 'R' */
+
+#define kMaximumNestingDepth    64
+
+typedef NS_ENUM(uint8_t, TMFBinaryTag) {
+    TMFBinaryTagNull = 0x00,
+    TMFBinaryTagFalse = 0x01,
+    TMFBinaryTagTrue = 0x02,
+    TMFBinaryTagInteger = 0x03,   /* zig-zag varint */
+    TMFBinaryTagUnsigned = 0x04,  /* varint, values above INT64_MAX */
+    TMFBinaryTagDouble = 0x05,    /* little endian float64 */
+    TMFBinaryTagString = 0x06,    /* varint length, UTF-8 bytes */
+    TMFBinaryTagData = 0x07,      /* varint length, raw bytes */
+    TMFBinaryTagArray = 0x08,     /* varint count, values */
+    TMFBinaryTagDictionary = 0x09, /* varint count, key value pairs */
+    TMFBinaryTagAttachment = 0x0A  /* varint index of a TMFAttachmentReference */
+};
+
+typedef struct {
+    const uint8_t *position;
+    const uint8_t *end;
+} TMFBinaryReader;
+
+static BOOL TMFBinaryWriteValue(NSMutableData *data, id value, NSUInteger depth);
+static id TMFBinaryReadValue(TMFBinaryReader *reader, NSUInteger depth, BOOL *valid);
+
+@implementation TMFBinaryRpcCoder
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
+
+//............................................................................
+#pragma mark -
+#pragma TMFProtocol
+//............................................................................
+- (NSString *)name {
+    return @"Binary";
+}
+
+- (NSString *)version {
+    return @"1.0";
+}
+
+- (NSData *)encodeRequest:(TMFRequest *)request {
+    NSAssert(request.commandName!=nil || request.commandIdentifier!=0, @"Command name may not be nil!");
+    NSMutableData *data = [[NSMutableData alloc] initWithCapacity:64];
+    uint8_t type = kMessageTypeRequest;
+    [data appendBytes:&type length:1];
+
+    // interned commands take a tagged varint of one or two bytes instead of the name
+    id command = request.commandName ? request.commandName : @(request.commandIdentifier);
+    BOOL valid = TMFBinaryWriteValue(data, command, 0);
+    valid = valid && TMFBinaryWriteValue(data, request.identifier, 0);
+    valid = valid && TMFBinaryWriteValue(data, (request.arguments ? request.arguments : @[ ]), 0);
+    if(!valid) {
+        TMFLogError(@"Binary coder error. Could not encode %@", request);
+        return nil;
+    }
+    return data;
+}
+
+- (NSData *)encodeResponse:(TMFResponse *)response {
+    NSMutableData *data = [[NSMutableData alloc] initWithCapacity:32];
+    uint8_t type = kMessageTypeResponse;
+    [data appendBytes:&type length:1];
+
+    BOOL valid = TMFBinaryWriteValue(data, response.identifier, 0);
+    valid = valid && TMFBinaryWriteValue(data, response.result, 0);
+    valid = valid && TMFBinaryWriteValue(data, response.error, 0);
+    if(!valid) {
+        TMFLogError(@"Binary coder error. Could not encode %@", response);
+        return nil;
+    }
+    return data;
+}
+
+- (TMFRequest *)decodeRequest:(NSData *)data {
+    TMFBinaryReader reader = { [data bytes], (const uint8_t *)[data bytes] + [data length] };
+    if(reader.position == reader.end || *reader.position != kMessageTypeRequest) {
+        TMFLogError(@"Binary coder error. Data is not a request.");
+        return nil;
+    }
+    reader.position++;
+
+    BOOL valid = YES;
+    id command = TMFBinaryReadValue(&reader, 0, &valid);
+    id identifier = valid ? TMFBinaryReadValue(&reader, 0, &valid) : nil;
+    id arguments = valid ? TMFBinaryReadValue(&reader, 0, &valid) : nil;
+    BOOL interned = [command isKindOfClass:[NSNumber class]];
+    if(!valid || reader.position != reader.end || !(interned || [command isKindOfClass:[NSString class]]) || ![arguments isKindOfClass:[NSArray class]]) {
+        TMFLogError(@"Binary coder error. Invalid request data.");
+        return nil;
+    }
+
+    TMFRequest *request = [TMFRequest new];
+    if(interned) {
+        request.commandIdentifier = [command unsignedIntegerValue];
+    }
+    else {
+        request.commandName = command;
+    }
+    request.identifier = identifier;
+    request.arguments = arguments;
+    return request;
+}
+
+- (TMFResponse *)decodeResponse:(NSData *)data {
+    TMFBinaryReader reader = { [data bytes], (const uint8_t *)[data bytes] + [data length] };
+    if(reader.position == reader.end || *reader.position != kMessageTypeResponse) {
+        TMFLogError(@"Binary coder error. Data is not a response.");
+        return nil;
+    }
+    reader.position++;
+
+    BOOL valid = YES;
+    id identifier = TMFBinaryReadValue(&reader, 0, &valid);
+    id result = valid ? TMFBinaryReadValue(&reader, 0, &valid) : nil;
+    id error = valid ? TMFBinaryReadValue(&reader, 0, &valid) : nil;
+    if(!valid || reader.position != reader.end) {
+        TMFLogError(@"Binary coder error. Invalid response data.");
+        return nil;
+    }
+
+    TMFResponse *response = [TMFResponse new];
+    response.identifier = identifier;
+    response.result = result;
+    response.error = error;
+    return response;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+
+#pragma mark writing
+static inline void TMFBinaryWriteVarint(NSMutableData *data, uint64_t value) {
+    uint8_t buffer[10];
+    NSUInteger length = 0;
+    while(value >= 0x80) {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+    [data appendBytes:buffer length:length];
+}
+
+static inline void TMFBinaryWriteTag(NSMutableData *data, TMFBinaryTag tag) {
+    [data appendBytes:&tag length:1];
+}
+
+static inline void TMFBinaryWriteBytes(NSMutableData *data, TMFBinaryTag tag, const void *bytes, NSUInteger length) {
+    TMFBinaryWriteTag(data, tag);
+    TMFBinaryWriteVarint(data, length);
+    [data appendBytes:bytes length:length];
+}
+
+static void TMFBinaryWriteNumber(NSMutableData *data, NSNumber *number) {
+    if(CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+        TMFBinaryWriteTag(data, [number boolValue] ? TMFBinaryTagTrue : TMFBinaryTagFalse);
+        return;
+    }
+
+    switch (*[number objCType]) {
+        case 'f':
+        case 'd': {
+            double value = [number doubleValue];
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            bits = OSSwapHostToLittleInt64(bits);
+            TMFBinaryWriteTag(data, TMFBinaryTagDouble);
+            [data appendBytes:&bits length:sizeof(bits)];
+            break;
+        }
+        case 'Q': {
+            unsigned long long value = [number unsignedLongLongValue];
+            if(value > INT64_MAX) {
+                TMFBinaryWriteTag(data, TMFBinaryTagUnsigned);
+                TMFBinaryWriteVarint(data, value);
+                break;
+            }
+        } // fall through for values fitting into int64
+        default: {
+            int64_t value = [number longLongValue];
+            TMFBinaryWriteTag(data, TMFBinaryTagInteger);
+            TMFBinaryWriteVarint(data, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+            break;
+        }
+    }
+}
+
+static BOOL TMFBinaryWriteValue(NSMutableData *data, id value, NSUInteger depth) {
+    if(depth > kMaximumNestingDepth) {
+        return NO;
+    }
+
+    if(value == nil || value == [NSNull null]) {
+        TMFBinaryWriteTag(data, TMFBinaryTagNull);
+    }
+    else if([value isKindOfClass:[NSString class]]) {
+        if([TMFSerializableObject isEncodedBinaryData:value]) {
+            // serialized binary data gets transferred raw
+            NSData *binary = [TMFSerializableObject decodeBinaryData:value];
+            TMFBinaryWriteBytes(data, TMFBinaryTagData, [binary bytes], [binary length]);
+        }
+        else {
+            NSUInteger length = [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+            TMFBinaryWriteTag(data, TMFBinaryTagString);
+            TMFBinaryWriteVarint(data, length);
+            NSUInteger offset = [data length];
+            [data increaseLengthBy:length];
+            [value getBytes:(uint8_t *)[data mutableBytes] + offset maxLength:length usedLength:NULL encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [value length]) remainingRange:NULL];
+        }
+    }
+    else if([value isKindOfClass:[NSNumber class]]) {
+        TMFBinaryWriteNumber(data, value);
+    }
+    else if([value isKindOfClass:[NSData class]]) {
+        TMFBinaryWriteBytes(data, TMFBinaryTagData, [value bytes], [value length]);
+    }
+    else if([value isKindOfClass:[TMFAttachmentReference class]]) {
+        TMFBinaryWriteTag(data, TMFBinaryTagAttachment);
+        TMFBinaryWriteVarint(data, [value index]);
+    }
+    else if([value isKindOfClass:[NSArray class]]) {
+        TMFBinaryWriteTag(data, TMFBinaryTagArray);
+        TMFBinaryWriteVarint(data, [value count]);
+        for(id element in value) {
+            if(!TMFBinaryWriteValue(data, element, depth + 1)) {
+                return NO;
+            }
+        }
+    }
+    else if([value isKindOfClass:[NSDictionary class]]) {
+        TMFBinaryWriteTag(data, TMFBinaryTagDictionary);
+        TMFBinaryWriteVarint(data, [value count]);
+        __block BOOL valid = YES;
+        [value enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+            if(![key isKindOfClass:[NSString class]] || !TMFBinaryWriteValue(data, key, depth + 1) || !TMFBinaryWriteValue(data, obj, depth + 1)) {
+                valid = NO;
+                *stop = YES;
+            }
+        }];
+        return valid;
+    }
+    else {
+        TMFLogInfo(@"Encoded NSNull for %@", value);
+        TMFBinaryWriteTag(data, TMFBinaryTagNull);
+    }
+    return YES;
+}
+
+#pragma mark reading
+static inline BOOL TMFBinaryReadVarint(TMFBinaryReader *reader, uint64_t *value) {
+    uint64_t result = 0;
+    for(NSUInteger shift = 0; shift < 64 && reader->position < reader->end; shift += 7) {
+        uint8_t byte = *reader->position++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            *value = result;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static inline BOOL TMFBinaryReadLength(TMFBinaryReader *reader, NSUInteger *length) {
+    uint64_t value = 0;
+    if(!TMFBinaryReadVarint(reader, &value) || value > (uint64_t)(reader->end - reader->position)) {
+        return NO;
+    }
+    *length = (NSUInteger)value;
+    return YES;
+}
+
+static id TMFBinaryReadValue(TMFBinaryReader *reader, NSUInteger depth, BOOL *valid) {
+    if(depth > kMaximumNestingDepth || reader->position >= reader->end) {
+        *valid = NO;
+        return nil;
+    }
+
+    TMFBinaryTag tag = *reader->position++;
+    switch (tag) {
+        case TMFBinaryTagNull:
+            return nil;
+        case TMFBinaryTagFalse:
+            return @NO;
+        case TMFBinaryTagTrue:
+            return @YES;
+        case TMFBinaryTagInteger: {
+            uint64_t value = 0;
+            if(TMFBinaryReadVarint(reader, &value)) {
+                return @((long long)((value >> 1) ^ (~(value & 1) + 1)));
+            }
+            break;
+        }
+        case TMFBinaryTagUnsigned: {
+            uint64_t value = 0;
+            if(TMFBinaryReadVarint(reader, &value)) {
+                return @((unsigned long long)value);
+            }
+            break;
+        }
+        case TMFBinaryTagDouble: {
+            if(reader->end - reader->position >= (ptrdiff_t)sizeof(uint64_t)) {
+                uint64_t bits = OSReadLittleInt64(reader->position, 0);
+                double value;
+                memcpy(&value, &bits, sizeof(value));
+                reader->position += sizeof(uint64_t);
+                return @(value);
+            }
+            break;
+        }
+        case TMFBinaryTagString: {
+            NSUInteger length = 0;
+            if(TMFBinaryReadLength(reader, &length)) {
+                NSString *string = [[NSString alloc] initWithBytes:reader->position length:length encoding:NSUTF8StringEncoding];
+                reader->position += length;
+                if(string) {
+                    return string;
+                }
+            }
+            break;
+        }
+        case TMFBinaryTagData: {
+            NSUInteger length = 0;
+            if(TMFBinaryReadLength(reader, &length)) {
+                // the message body may reference a reusable receive buffer, copy
+                NSData *data = [[NSData alloc] initWithBytes:reader->position length:length];
+                reader->position += length;
+                return data;
+            }
+            break;
+        }
+        case TMFBinaryTagAttachment: {
+            uint64_t index = 0;
+            if(TMFBinaryReadVarint(reader, &index)) {
+                return [TMFAttachmentReference referenceWithIndex:(NSUInteger)index];
+            }
+            break;
+        }
+        case TMFBinaryTagArray: {
+            NSUInteger count = 0;
+            if(TMFBinaryReadLength(reader, &count)) { // each element takes at least one byte
+                NSMutableArray *array = [[NSMutableArray alloc] initWithCapacity:count];
+                for(NSUInteger i = 0; i < count && *valid; i++) {
+                    id element = TMFBinaryReadValue(reader, depth + 1, valid);
+                    [array addObject:(element ? element : [NSNull null])];
+                }
+                if(*valid) {
+                    return array;
+                }
+            }
+            break;
+        }
+        case TMFBinaryTagDictionary: {
+            NSUInteger count = 0;
+            if(TMFBinaryReadLength(reader, &count)) {
+                NSMutableDictionary *dictionary = [[NSMutableDictionary alloc] initWithCapacity:count];
+                for(NSUInteger i = 0; i < count && *valid; i++) {
+                    id key = TMFBinaryReadValue(reader, depth + 1, valid);
+                    id obj = *valid ? TMFBinaryReadValue(reader, depth + 1, valid) : nil;
+                    if(![key isKindOfClass:[NSString class]]) {
+                        *valid = NO;
+                    }
+                    else if(*valid) {
+                        [dictionary setObject:(obj ? obj : [NSNull null]) forKey:key];
+                    }
+                }
+                if(*valid) {
+                    return dictionary;
+                }
+            }
+            break;
+        }
+    }
+
+    *valid = NO;
+    return nil;
+}
+
+@end
@@ -28,6 +28,7 @@
 #import <Foundation/Foundation.h>
 #import "TMFChannelDelegate.h"
 #import "TMFProtocol.h"
+#import "TMFSendQueue.h"
 
 /**
  Abstract class representing a network channel.
@@ -100,9 +101,117 @@
  */
 - (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer responseBlock:(responseBlock_t)responseBlock;
 
+/**
+ Sends a command with arguments via the channel and limits the time to wait for the response.
+ If no response arrived in time the response block gets called with a TMFTimeoutErrorCode error.
+ The default implementation ignores the timeout and calls send:arguments:destination:responseBlock:
+ @param command command to send
+ @param arguments arguments to send
+ @param peer destination peer
+ @param timeout time in seconds to wait for the response, 0 uses the channel's default timeout
+ @param responseBlock response callback block to call for responses. This parameter gets ignored for TMFPublishSubscribeCommand
+ */
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(NSTimeInterval)timeout responseBlock:(responseBlock_t)responseBlock;
+
+/**
+ Sends a command with arguments to multiple peers without expecting responses.
+ The default implementation calls send:arguments:destination:responseBlock: for each peer, subclasses should encode the message only once.
+ @param command command to send
+ @param arguments arguments to send
+ @param peers destination peers
+ */
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destinations:(NSArray *)peers;
+
 /**
  Removes all connections and sockets for a given peer.
  @param peer Peer which should get removed.
  */
 - (void)removePeer:(TMFPeer *)peer;
+
+/** @name Subclassing */
+
+/**
+ Options for messages sent to a peer with this channel.
+ The default implementation returns [TMFProtocol frameOptionsForPeer:].
+ @param peer destination peer
+ @return TMFFrameOption bits for the peer
+ */
+- (TMFFrameOption)frameOptionsForPeer:(TMFPeer *)peer;
+
+/**
+ Message framing of incoming data, looked up by [TMFChannelDelegate channel:peerByAddress:].
+ Data of unknown senders is expected with compact headers.
+ @param address the senders address
+ @return YES if the sender is a 1.0 peer using legacy headers
+ */
+- (BOOL)legacyFramingForAddress:(NSData *)address;
+
+/**
+ Defines what happens to messages of a command if the send queue of the connection is full.
+ The default implementation returns [TMFPublishSubscribeCommand sendQueuePolicy] for publish subscribe commands and TMFSendQueuePolicyReject for requests expecting a response.
+ @param command the command sent
+ @return the policy for the command's messages
+ */
+- (TMFSendQueuePolicy)sendQueuePolicyForCommand:(TMFCommand *)command;
+
+/**
+ Encodes a request once per set of frame options of the destinations.
+ All messages carry the identifier the arguments already have.
+ @param command command to send
+ @param arguments arguments to send
+ @param peers destination peers
+ @return encoded data for each peer, in the order of peers
+ */
+- (NSArray *)requestDataForCommand:(TMFCommand *)command arguments:(TMFArguments *)arguments destinations:(NSArray *)peers;
+
+/**
+ Hands received requests to the delegate on its callback queue.
+ @param requests received TMFRequest objects
+ @param address source address of the requests
+ @param responseBlock called with the request and the delegate's result for requests expecting a response
+ */
+- (void)receiveRequests:(NSArray *)requests address:(NSData *)address response:(void (^)(TMFRequest *request, id result, NSError *error))responseBlock;
+
+/**
+ Registers the response block of a request.
+ The block gets called with a TMFTimeoutErrorCode error if no response arrives in time.
+ @param block response block, nothing is registered for NULL
+ @param identifier identifier of the request
+ @param peer destination peer
+ @param connection the connection the request is sent with
+ @param timeout time in seconds to wait for the response, 0 uses the channel's default timeout
+ */
+- (void)addResponseBlock:(responseBlock_t)block identifier:(NSUInteger)identifier peer:(TMFPeer *)peer connection:(id)connection timeout:(NSTimeInterval)timeout;
+
+/**
+ Calls the response blocks of received responses on the delegate's callback queue.
+ @param responses received TMFResponse objects
+ */
+- (void)executeResponseBlocksForResponses:(NSArray *)responses;
+
+/**
+ Checks if requests sent with a connection wait for their responses.
+ @param connection the connection the requests were sent with
+ @return YES if at least one response is outstanding
+ */
+- (BOOL)hasResponseBlocksForConnection:(id)connection;
+
+/**
+ Calls the response blocks of all requests sent with a connection with an error.
+ @param connection the closed connection
+ @param error the error to pass, nil for a TMFChannelErrorCode error
+ */
+- (void)failResponseBlocksForConnection:(id)connection error:(NSError *)error;
+
+/**
+ Calls the response block of a request which could not be sent.
+ @param identifier identifier of the request
+ @param error the reason
+ */
+- (void)failResponseBlockForIdentifier:(NSUInteger)identifier error:(NSError *)error;
+
+/**
+ Calls all outstanding response blocks with a TMFChannelErrorCode error.
+ */
+- (void)failAllResponseBlocks;
 @end
\ No newline at end of file
@@ -24,11 +24,20 @@
 //
 
 #import "TMFChannel.h"
-#import "TMFCommand.h"
+#import "TMFPublishSubscribeCommand.h"
 #import "TMFPeer.h"
+#import "TMFResponseCallback.h"
+#import "TMFResponseCallbackTable.h"
+#import "TMFError.h"
+#import "TMFLog.h"
+#import "TMFDefine.h"
+
+#define TMF_RESPONSE_TIMEOUT 60.0 /* default time to wait for a response */
 
 @interface TMFChannel() {
     NSUInteger _port;
+    TMFResponseCallbackTable *_responseCallbacks;
+    dispatch_queue_t _timeoutQueue;
 }
 @end
 
@@ -46,6 +55,13 @@
         _port = (port > 65535) ? 0 : port;
         _protocol = protocol;
         _delegate = delegate;
+
+        // requests without response in time get their callback executed with an error
+        _timeoutQueue = dispatch_queue_create("tmf.channel.timeout", DISPATCH_QUEUE_SERIAL);
+        __weak TMFChannel *weakSelf = self;
+        _responseCallbacks = [[TMFResponseCallbackTable alloc] initWithTimeout:TMF_RESPONSE_TIMEOUT queue:_timeoutQueue expiration:^(NSArray *callbacks) {
+            [weakSelf executeResponseCallbacks:callbacks result:nil error:[TMFError errorForCode:TMFTimeoutErrorCode message:@"Request timed out."]];
+        }];
     }
     return self;
 }
@@ -56,6 +72,10 @@
 
 - (void)dealloc {
     [self stop:nil];
+    [_responseCallbacks removeAllCallbacks];
+#if ARC_HANDLES_QUEUES
+    dispatch_release(_timeoutQueue);
+#endif
 }
 
 //............................................................................
@@ -74,10 +94,142 @@
     [super doesNotRecognizeSelector:_cmd];
 }
 
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(__unused NSTimeInterval)timeout responseBlock:(responseBlock_t)responseBlock {
+    [self send:command arguments:arguments destination:peer responseBlock:responseBlock];
+}
+
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destinations:(NSArray *)peers {
+    for(TMFPeer *peer in peers) {
+        [self send:command arguments:arguments destination:peer responseBlock:NULL];
+    }
+}
+
 - (void)removePeer:(__unused TMFPeer *)peer {
     // doing nothing per default
 }
 
+- (TMFFrameOption)frameOptionsForPeer:(TMFPeer *)peer {
+    return [self.protocol frameOptionsForPeer:peer];
+}
+
+- (BOOL)legacyFramingForAddress:(NSData *)address {
+    TMFPeer *peer = address ? [self.delegate channel:self peerByAddress:address] : nil;
+    return peer && ([self.protocol frameOptionsForPeer:peer] & TMFFrameOptionLegacyHeader);
+}
+
+- (TMFSendQueuePolicy)sendQueuePolicyForCommand:(TMFCommand *)command {
+    if([command isKindOfClass:[TMFPublishSubscribeCommand class]]) {
+        return [[command class] sendQueuePolicy];
+    }
+    return TMFSendQueuePolicyReject; // requests expect a response
+}
+
+- (NSArray *)requestDataForCommand:(TMFCommand *)command arguments:(TMFArguments *)arguments destinations:(NSArray *)peers {
+    NSMutableArray *messages = [NSMutableArray arrayWithCapacity:[peers count]];
+    NSMutableDictionary *variants = [NSMutableDictionary dictionaryWithCapacity:1]; // encoded data by frame options
+    for(TMFPeer *peer in peers) {
+        NSNumber *options = @([self frameOptionsForPeer:peer]);
+        NSData *variant = [variants objectForKey:options];
+        if(!variant) {
+            variant = [self.protocol requestDataForCommand:command arguments:arguments options:[options unsignedIntegerValue]];
+            [variants setObject:variant forKey:options];
+        }
+        [messages addObject:variant];
+    }
+    return messages;
+}
+
+- (void)receiveRequests:(NSArray *)requests address:(NSData *)address response:(void (^)(TMFRequest *request, id result, NSError *error))responseBlock {
+    // one hop to the callback queue for all requests of a read
+    dispatch_async(self.delegate.callbackQueue, ^{
+        for(TMFRequest *request in requests) {
+            if(!request.commandName && request.commandIdentifier != 0) {
+                [self.delegate receiveOnChannel:self commandIdentifier:request.commandIdentifier arguments:request.arguments address:address];
+                continue;
+            }
+            if(!request.commandName) {
+                responseBlock(request, nil, [TMFError errorForCode:TMFMessageParsingErrorCode message:@"Request without command."]);
+                continue;
+            }
+            [self.delegate receiveOnChannel:self
+                                commandName:request.commandName
+                                  arguments:request.arguments
+                                    address:address
+                                   response:^(id result, NSError *error) {
+                                       responseBlock(request, result, error);
+                                   }];
+        }
+    });
+}
+
+- (void)addResponseBlock:(responseBlock_t)block identifier:(NSUInteger)identifier peer:(TMFPeer *)peer connection:(id)connection timeout:(NSTimeInterval)timeout {
+    if(block) {
+        TMFResponseCallback *callback = [[TMFResponseCallback alloc] initWithIdentifier:identifier peer:peer connection:connection block:block];
+        callback.timeout = timeout;
+        [_responseCallbacks addCallback:callback];
+    }
+}
+
+- (void)executeResponseBlocksForResponses:(NSArray *)responses {
+    NSMutableArray *callbacks = [NSMutableArray arrayWithCapacity:[responses count]];
+    NSMutableArray *matched = [NSMutableArray arrayWithCapacity:[responses count]];
+    for(TMFResponse *response in responses) {
+        TMFResponseCallback *callback = nil;
+        if([response.identifier isKindOfClass:[NSNumber class]]) {
+            callback = [_responseCallbacks removeCallbackForIdentifier:[response.identifier unsignedIntegerValue]];
+        }
+        if(callback) {
+            [callbacks addObject:callback];
+            [matched addObject:response];
+        }
+        else {
+            // published commands share connections with requests and never register a callback,
+            // answers to them and late answers to timed out requests are expected
+            TMFLogVerbose(@"Ignoring response %@ without callback.", response.identifier);
+        }
+    }
+
+    if([callbacks count] > 0) {
+        // one hop to the callback queue for all responses of a read
+        dispatch_async(self.delegate.callbackQueue, ^{
+            [callbacks enumerateObjectsUsingBlock:^(TMFResponseCallback *callback, NSUInteger idx, __unused BOOL *stop) {
+                TMFResponse *response = [matched objectAtIndex:idx];
+                NSError *error = nil;
+                if(response.error != nil) {
+                    error = [TMFError errorForCode:TMFResponseErrorCode message:response.error];
+                }
+                callback.responseBlock(response.result, error);
+            }];
+        });
+    }
+}
+
+- (BOOL)hasResponseBlocksForConnection:(id)connection {
+    return [_responseCallbacks hasCallbacksForConnection:connection];
+}
+
+- (void)failResponseBlocksForConnection:(id)connection error:(NSError *)error {
+    // lets make sure response callbacks get called even if the peer closed the connection
+    NSArray *callbacks = [_responseCallbacks removeCallbacksForConnection:connection];
+    if([callbacks count] > 0) {
+        [self executeResponseCallbacks:callbacks result:nil error:(error ? error : [TMFError errorForCode:TMFChannelErrorCode message:@"Connection closed before receiving a response."])];
+    }
+}
+
+- (void)failResponseBlockForIdentifier:(NSUInteger)identifier error:(NSError *)error {
+    TMFResponseCallback *callback = [_responseCallbacks removeCallbackForIdentifier:identifier];
+    if(callback) {
+        [self executeResponseCallbacks:@[ callback ] result:nil error:error];
+    }
+}
+
+- (void)failAllResponseBlocks {
+    NSArray *callbacks = [_responseCallbacks removeAllCallbacks];
+    if([callbacks count] > 0) {
+        [self executeResponseCallbacks:callbacks result:nil error:[TMFError errorForCode:TMFChannelErrorCode message:@"Channel stopped before receiving a response."]];
+    }
+}
+
 //............................................................................
 #pragma mark -
 #pragma mark Override
@@ -92,5 +244,16 @@
 #pragma mark -
 #pragma mark Private
 //............................................................................
+- (void)executeResponseCallbacks:(NSArray *)callbacks result:(id)result error:(NSError *)error {
+    dispatch_queue_t queue = self.delegate.callbackQueue;
+    if(!queue) {
+        return;
+    }
+    dispatch_async(queue, ^{
+        for(TMFResponseCallback *callback in callbacks) {
+            callback.responseBlock(result, error);
+        }
+    });
+}
 
 @end
@@ -66,6 +66,25 @@ typedef void (^stopCompletionBlock_t)();
  */
 - (void)receiveOnChannel:(TMFChannel *)channel commandName:(NSString *)commandName arguments:(NSArray *)arguments address:(NSData *)address response:(responseBlock_t)responseBlock;
 
+/**
+ This method is called whenever a publish subscribe command identified by its interned identifier got sent to this peer.
+ Those messages are never answered.
+ @param channel The channel that sends the message
+ @param commandIdentifier The [TMFPublishSubscribeCommand commandIdentifier] the sender assigned on subscription
+ @param arguments The alphabetical ordered list of arguments for the command execution.
+ @param address The senders address.
+ */
+- (void)receiveOnChannel:(TMFChannel *)channel commandIdentifier:(NSUInteger)commandIdentifier arguments:(NSArray *)arguments address:(NSData *)address;
+
+/**
+ Finds the sender of incoming data, its protocol version decides on the message framing.
+ This method is called from the channel's socket queues.
+ @param channel The channel receiving data
+ @param address The senders address.
+ @return The known peer for the address or nil.
+ */
+- (TMFPeer *)channel:(TMFChannel *)channel peerByAddress:(NSData *)address;
+
 /**
  Defines the callback queue used for all delegate callbacks.
  Ignored if NULL.
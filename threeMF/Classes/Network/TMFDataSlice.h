@@ -0,0 +1,57 @@
+//
+//  TMFDataSlice.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Immutable data object referencing a range of another data object without copying it.
+ The referenced data is retained and must not be mutated as long as slices of it exist.
+ */
+@interface TMFDataSlice : NSData
+
+/**
+ YES if slices of this slice got created.
+ Receivers reusing a buffer must not touch the buffer of a referenced slice anymore.
+ */
+@property (nonatomic, readonly, getter = isReferenced) BOOL referenced;
+
+/**
+ Initializes a new slice.
+ @param data The referenced data, must not be nil. If data is a slice, the new slice references its underlying data and data is marked as referenced.
+ @param range The range of the slice within data, must be within the bounds of data.
+ */
+- (id)initWithData:(NSData *)data range:(NSRange)range;
+
+/**
+ Creates a new slice.
+ @param data The referenced data, must not be nil.
+ @param range The range of the slice within data, must be within the bounds of data.
+ @return A new data object referencing the given range of data.
+ */
++ (TMFDataSlice *)sliceOfData:(NSData *)data range:(NSRange)range;
+
+@end
@@ -0,0 +1,84 @@
+//
+//  TMFDataSlice.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFDataSlice.h"
+
+@interface TMFDataSlice() {
+    NSData *_data;
+    const void *_bytes;
+    NSUInteger _length;
+}
+@end
+
+@implementation TMFDataSlice
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithData:(NSData *)data range:(NSRange)range {
+    NSParameterAssert(data!=nil);
+    NSParameterAssert(NSMaxRange(range) <= [data length]);
+
+    self = [super init];
+    if(self) {
+        if([data isKindOfClass:[TMFDataSlice class]]) {
+            TMFDataSlice *slice = (TMFDataSlice *)data;
+            slice->_referenced = YES;
+            _data = slice->_data; // avoid chains of slices
+        }
+        else {
+            _data = data;
+        }
+        _bytes = (const uint8_t *)[data bytes] + range.location;
+        _length = range.length;
+    }
+    return self;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
++ (TMFDataSlice *)sliceOfData:(NSData *)data range:(NSRange)range {
+    return [[self alloc] initWithData:data range:range];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Override
+//............................................................................
+- (NSUInteger)length {
+    return _length;
+}
+
+- (const void *)bytes {
+    return _bytes;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self; // immutable
+}
+
+@end
@@ -62,6 +62,12 @@
  */
 @property (nonatomic, readonly) NSArray *peers;
 
+/**
+ Path of the local TMFUnixChannel socket file.
+ Gets published with the TXT record, so peers on the same host can bypass the TCP stack. Nil if there is none.
+ */
+@property (nonatomic, copy) NSString *localSocketPath;
+
 /**
  This property states if all discovery components are running.
  */
@@ -94,8 +100,8 @@
 
 /**
  Finds a peer by its address.
- The port will be ignored.
- @param address The sockaddr_in or sockaddr_in6 of the peer to find.
+ The port will be ignored. May be called from any thread.
+ @param address The sockaddr_in, sockaddr_in6 or sockaddr_un of the peer to find.
  */
 - (TMFPeer *)peerByAddress:(NSData *)address;
 
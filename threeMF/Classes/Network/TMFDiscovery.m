@@ -25,20 +25,64 @@
 
 #import "TMFDiscovery.h"
 #import "TMFPeer.h"
+#import "TMFProtocol.h"
+#import "TMFUnixChannel.h"
 
 #import "TMFError.h"
 #import "TMFLog.h"
 #import "TMFDefine.h"
 
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+
 static dispatch_queue_t __bonjourQueue;
 static NSString *__uuid;
 static TMFPeer *__localPeer;
 
+#define TMF_HOST_KEY_MAX_LENGTH (1 + sizeof(((struct sockaddr_un *)0)->sun_path))
+
+/**
+ Writes the host key of a sockaddr_in, sockaddr_in6 or sockaddr_un address into a buffer of TMF_HOST_KEY_MAX_LENGTH bytes.
+ The key consists of the address family followed by the raw IP, ports are ignored and IPv4 mapped IPv6 addresses are keyed as IPv4.
+ Unix domain socket addresses are keyed by their path.
+ @return length of the key, 0 if the address is not supported
+ */
+static NSUInteger TMFHostKeyForAddress(NSData *address, uint8_t *key) {
+    const struct sockaddr *socketAddress = (const struct sockaddr *)[address bytes];
+    NSUInteger length = [address length];
+    if(length >= sizeof(struct sockaddr_in) && socketAddress->sa_family == AF_INET) {
+        key[0] = AF_INET;
+        memcpy(key + 1, &((const struct sockaddr_in *)socketAddress)->sin_addr, sizeof(struct in_addr));
+        return 1 + sizeof(struct in_addr);
+    }
+    else if(length >= sizeof(struct sockaddr_in6) && socketAddress->sa_family == AF_INET6) {
+        const struct in6_addr *ip = &((const struct sockaddr_in6 *)socketAddress)->sin6_addr;
+        if(IN6_IS_ADDR_V4MAPPED(ip)) {
+            key[0] = AF_INET;
+            memcpy(key + 1, ip->s6_addr + 12, sizeof(struct in_addr));
+            return 1 + sizeof(struct in_addr);
+        }
+        key[0] = AF_INET6;
+        memcpy(key + 1, ip, sizeof(struct in6_addr));
+        return 1 + sizeof(struct in6_addr);
+    }
+    else if(length >= sizeof(struct sockaddr_un) && socketAddress->sa_family == AF_UNIX) {
+        const char *path = ((const struct sockaddr_un *)socketAddress)->sun_path;
+        size_t pathLength = strnlen(path, sizeof(((struct sockaddr_un *)0)->sun_path));
+        key[0] = AF_UNIX;
+        memcpy(key + 1, path, pathLength);
+        return 1 + pathLength;
+    }
+    return 0;
+}
+
 @interface TMFDiscovery() <NSNetServiceDelegate, NSNetServiceBrowserDelegate> {
     dispatch_queue_t _resolve_queue;    
 
     NSMutableArray *_discoveredServices;
-    NSMutableDictionary *_peersByAddress;
+    NSMutableDictionary *_peersByAddress; // normalized (family, IP) host key -> living peer
+    NSLock *_peersByAddressLock;          // channels look up senders from their socket queues
     NSMutableArray *_livingPeers;
 
     NSMutableDictionary *_deadPeers;
@@ -79,6 +123,7 @@ static TMFPeer *__localPeer;
         _capabilities = [NSMutableArray new];
         _resolve_queue = dispatch_queue_create("com.threemf.resolve_serivce_queue", DISPATCH_QUEUE_SERIAL);
         _peersByAddress = [NSMutableDictionary new];
+        _peersByAddressLock = [NSLock new];
 
         _heartBeatCommand = [[TMFHeartBeatCommand alloc] initWithRequestReceivedBlock:^(TMFHeartBeatCommandArguments *arguments, __unused TMFPeer *peer, responseBlock_t responseBlock) {
             NSError *error;
@@ -152,6 +197,16 @@ static TMFPeer *__localPeer;
     }
 }
 
+- (void)setLocalSocketPath:(NSString *)localSocketPath {
+    if(localSocketPath != _localSocketPath && ![localSocketPath isEqualToString:_localSocketPath]) {
+        _localSocketPath = [localSocketPath copy];
+        [[self class] performBonjourBlock:^{
+            [_netService setTXTRecordData:[self txtRecordData]];
+        }];
+        TMFLogInfo(@"Publishing local socket %@", localSocketPath);
+    }
+}
+
 - (TMFPeer *)localPeer {
     return __localPeer;
 }
@@ -159,17 +214,17 @@ static TMFPeer *__localPeer;
 - (TMFPeer *)peerByAddress:(NSData *)address {
     NSParameterAssert(address != nil);
 
-    TMFPeer *peer = [_peersByAddress objectForKey:address];
-    if(!peer) {
-        NSPredicate *predicate = [NSPredicate predicateWithBlock:^BOOL(TMFPeer *peer, __unused NSDictionary *bindings){
-            return [peer hasAddress:address];
-        }];
-        peer = [[_livingPeers filteredArrayUsingPredicate:predicate] lastObject];
-        if(peer) {
-            [_peersByAddress setObject:peer forKey:address];
-        }
+    // the source port changes with every connection, look up the host only
+    uint8_t key[TMF_HOST_KEY_MAX_LENGTH];
+    NSUInteger length = TMFHostKeyForAddress(address, key);
+    if(length == 0) {
+        return nil;
     }
 
+    NSData *hostKey = [[NSData alloc] initWithBytesNoCopy:key length:length freeWhenDone:NO];
+    [_peersByAddressLock lock];
+    TMFPeer *peer = [_peersByAddress objectForKey:hostKey];
+    [_peersByAddressLock unlock];
     return peer;
 }
 
@@ -202,7 +257,7 @@ static TMFPeer *__localPeer;
                 }
             }
             else {
-                if([peer.protocolIdentifier isEqualToString:self.delegate.protocolIdentifier]) {
+                if([TMFProtocol isIdentifier:peer.protocolIdentifier compatibleWithIdentifier:self.delegate.protocolIdentifier]) {
                     // we did already get a heartbeat from this peer
                     if([_heartBeats containsObject:peer.UUID]) {
                         [self awakePeer:peer];
@@ -219,6 +274,10 @@ static TMFPeer *__localPeer;
                             TMFLogError(@"Ignoring %@, could not send heart beat (%@).", peer, [error localizedDescription]);
                             [_deadPeers removeObjectForKey:peer.UUID];
                         }
+                        else if(peer.protocolMajorVersion < 2) {
+                            // 1.x peers ignore us and never send a heart beat, the response proves they are alive
+                            [self pulse:peer.UUID];
+                        }
                     }];
                 }
                 else {
@@ -238,6 +297,9 @@ static TMFPeer *__localPeer;
         TMFPeer *peer = [self peerForService:sender];
         if(peer) {
             [peer updateWithTXTRecordData:data];        
+            if([_livingPeers containsObject:peer]) {
+                [self indexAddressesOfPeer:peer]; // the local socket may have been published late
+            }
             if(peer != __localPeer) {
                 if([self.delegate respondsToSelector:@selector(discovery:didUpdatePeer:)]) {
                     [self.delegate discovery:self didUpdatePeer:peer];
@@ -377,6 +439,7 @@ static TMFPeer *__localPeer;
 - (void)awakePeer:(TMFPeer *)peer {
     TMFLogInfo(@"%@ discovered (%@).", peer, [peer.capabilities componentsJoinedByString:@","]);
     [_livingPeers addObject:peer];
+    [self indexAddressesOfPeer:peer];
     [_deadPeers removeObjectForKey:peer.UUID];
     [_heartBeats removeObject:peer.UUID];
     
@@ -386,8 +449,10 @@ static TMFPeer *__localPeer;
 }
 
 - (void)removePeer:(TMFPeer *)peer {
+    [_peersByAddressLock lock];
     NSArray *keys = [_peersByAddress allKeysForObject:peer];
     [_peersByAddress removeObjectsForKeys:keys];
+    [_peersByAddressLock unlock];
 
     if(peer.UUID) {
         [_deadPeers removeObjectForKey:peer.UUID];
@@ -398,6 +463,33 @@ static TMFPeer *__localPeer;
         [_livingPeers removeObject:peer];
         TMFLogInfo(@"Did remove %@", peer);
     }
+
+    // other peers may run on the same host
+    if([keys count] > 0) {
+        for(TMFPeer *livingPeer in _livingPeers) {
+            [self indexAddressesOfPeer:livingPeer];
+        }
+    }
+}
+
+- (void)indexAddressesOfPeer:(TMFPeer *)peer {
+    // the latest living peer of a host wins
+    uint8_t key[TMF_HOST_KEY_MAX_LENGTH];
+    [_peersByAddressLock lock];
+    for(NSData *address in peer.addresses) {
+        NSUInteger length = TMFHostKeyForAddress(address, key);
+        if(length > 0) {
+            [_peersByAddress setObject:peer forKey:[NSData dataWithBytes:key length:length]];
+        }
+    }
+
+    // requests of co-located peers arrive from their unix domain socket
+    NSData *localAddress = peer.localSocketPath ? [TMFUnixChannel addressForSocketPath:peer.localSocketPath] : nil;
+    NSUInteger length = localAddress ? TMFHostKeyForAddress(localAddress, key) : 0;
+    if(length > 0) {
+        [_peersByAddress setObject:peer forKey:[NSData dataWithBytes:key length:length]];
+    }
+    [_peersByAddressLock unlock];
 }
 
 - (void)clenupService:(NSNetService *)service {
@@ -438,14 +530,19 @@ static TMFPeer *__localPeer;
 }
 
 - (NSData *)txtRecordData {
-    return [NSNetService dataFromTXTRecordDictionary:@{
+    NSMutableDictionary *TXTRecord = [NSMutableDictionary dictionaryWithDictionary:@{
                 @"id" : __uuid,
                 // FIXME: what if _capabilities get too big for txtRecordData?
                 // A placeholder should be added which indicates too much infomration for the txtRecord
                 // Discovery should call the capability command to read a peer's capabilities in this case.
                 @"cap" : [_capabilities componentsJoinedByString:@","],
                 @"pro" : [self.delegate protocolIdentifier],
+                @"cmp" : @"deflate", // accepted message compression, see [TMFProtocol compressedData:]
             }];
+    if(_localSocketPath) {
+        [TXTRecord setObject:_localSocketPath forKey:@"uds"];
+    }
+    return [NSNetService dataFromTXTRecordDictionary:TXTRecord];
 }
 
 + (void)performBonjourBlock:(void(^)(void))block {
@@ -0,0 +1,91 @@
+//
+//  TMFEventLoop.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+
+@class TMFEventLoop;
+
+/**
+ Objects registered with a TMFEventLoop get notified about events of their descriptor on the loop's thread.
+ */
+@protocol TMFEventLoopHandler <NSObject>
+@required
+/**
+ Called when the descriptor became readable or writable.
+ Descriptors are registered edge-triggered, the handler has to read or write until EAGAIN before it gets notified again.
+ A closed or failed descriptor is reported as readable, so the following read returns 0 or an error.
+ @param loop The loop the descriptor is registered with.
+ @param readable YES if the descriptor became readable
+ @param writable YES if the descriptor became writable
+ */
+- (void)eventLoop:(TMFEventLoop *)loop handleEventsReadable:(BOOL)readable writable:(BOOL)writable;
+@end
+
+/**
+ Thread waiting for descriptor events using epoll on Linux and kqueue on BSD based systems (iOS, OS X).
+
+ Besides descriptor events the loop runs blocks queued from any thread, they run on the loop's thread after
+ the events of the current iteration got handled. Owners of handlers use this to defer the reuse of objects
+ which may still have events pending in the current iteration.
+ */
+@interface TMFEventLoop : NSObject
+
+/**
+ Initializes a new instance.
+ @param name Name of the loop's thread.
+ */
+- (id)initWithName:(NSString *)name;
+
+/**
+ Creates the event queue and starts the loop's thread.
+ @param error set if the event queue could not be created
+ @return YES if the loop is running
+ */
+- (BOOL)start:(NSError **)error;
+
+/**
+ Stops the loop's thread after the current iteration and the queued blocks.
+ Registered descriptors are not closed.
+ */
+- (void)stop;
+
+/**
+ Registers a descriptor for read and write events. Closing the descriptor removes it.
+ @param fd Non-blocking descriptor.
+ @param handler Object getting notified about events, it is not retained and must stay alive until the descriptor got closed.
+ @param error set if the descriptor could not be registered
+ @return YES if the descriptor got registered
+ */
+- (BOOL)addDescriptor:(int)fd handler:(id<TMFEventLoopHandler>)handler error:(NSError **)error;
+
+/**
+ Queues a block to run on the loop's thread.
+ @param block The block to run.
+ */
+- (void)performBlock:(dispatch_block_t)block;
+
+@end
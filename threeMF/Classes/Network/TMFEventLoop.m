@@ -0,0 +1,236 @@
+//
+//  TMFEventLoop.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFEventLoop.h"
+#import "TMFError.h"
+#import "TMFLog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#define TMF_EVENT_LOOP_BATCH 64 /* events handled per iteration */
+
+@interface TMFEventLoop() {
+    NSString *_name;
+    int _queue;        // epoll or kqueue descriptor
+    int _wakeUp[2];    // pipe waking up the loop for queued blocks
+
+    NSLock *_blocksLock;
+    NSMutableArray *_blocks;
+    BOOL _wakeUpPending;
+    volatile BOOL _stopped;
+}
+@end
+
+@implementation TMFEventLoop
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithName:(NSString *)name {
+    self = [super init];
+    if(self) {
+        _name = [name copy];
+        _queue = -1;
+        _wakeUp[0] = -1;
+        _wakeUp[1] = -1;
+        _blocksLock = [NSLock new];
+        _blocks = [NSMutableArray new];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    // not closed by the thread, blocks may get queued until the last reference is gone
+    [self closeDescriptors];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
+- (BOOL)start:(NSError **)error {
+#if defined(__linux__)
+    _queue = epoll_create1(EPOLL_CLOEXEC);
+#else
+    _queue = kqueue();
+#endif
+    if(_queue < 0 || pipe(_wakeUp) != 0) {
+        if(error) {
+            *error = [TMFError errorForCode:TMFChannelErrorCode message:[NSString stringWithFormat:@"Could not create event loop (%s).", strerror(errno)]];
+        }
+        [self closeDescriptors];
+        return NO;
+    }
+
+    fcntl(_wakeUp[0], F_SETFL, fcntl(_wakeUp[0], F_GETFL) | O_NONBLOCK);
+    fcntl(_wakeUp[1], F_SETFL, fcntl(_wakeUp[1], F_GETFL) | O_NONBLOCK);
+    if(![self addDescriptor:_wakeUp[0] handler:nil error:error]) {
+        [self closeDescriptors];
+        return NO;
+    }
+
+    // the thread retains the loop until it finished
+    NSThread *thread = [[NSThread alloc] initWithTarget:self selector:@selector(run) object:nil];
+    [thread setName:_name];
+    [thread start];
+    return YES;
+}
+
+- (void)stop {
+    // blocks queued after the loop stopped never run
+    _stopped = YES;
+    [self performBlock:^{}];
+}
+
+- (BOOL)addDescriptor:(int)fd handler:(id<TMFEventLoopHandler>)handler error:(NSError **)error {
+    void *context = (__bridge void *)handler;
+#if defined(__linux__)
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = context;
+    BOOL added = epoll_ctl(_queue, EPOLL_CTL_ADD, fd, &event) == 0;
+#else
+    struct kevent events[2];
+    EV_SET(&events[0], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, context);
+    EV_SET(&events[1], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, context);
+    BOOL added = kevent(_queue, events, handler ? 2 : 1, NULL, 0, NULL) == 0;
+#endif
+    if(!added && error) {
+        *error = [TMFError errorForCode:TMFChannelErrorCode message:[NSString stringWithFormat:@"Could not register descriptor (%s).", strerror(errno)]];
+    }
+    return added;
+}
+
+- (void)performBlock:(dispatch_block_t)block {
+    NSParameterAssert(block!=nil);
+
+    [_blocksLock lock];
+    [_blocks addObject:[block copy]];
+    BOOL wakeUp = !_wakeUpPending;
+    _wakeUpPending = YES;
+    [_blocksLock unlock];
+
+    // one byte is enough until the loop picked up the blocks
+    if(wakeUp) {
+        uint8_t byte = 1;
+        while(write(_wakeUp[1], &byte, 1) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (void)run {
+#if defined(__linux__)
+    struct epoll_event events[TMF_EVENT_LOOP_BATCH];
+#else
+    struct kevent events[TMF_EVENT_LOOP_BATCH];
+#endif
+
+    while(!_stopped) {
+        @autoreleasepool {
+#if defined(__linux__)
+            int count = epoll_wait(_queue, events, TMF_EVENT_LOOP_BATCH, -1);
+#else
+            int count = kevent(_queue, NULL, 0, events, TMF_EVENT_LOOP_BATCH, NULL);
+#endif
+            if(count < 0 && errno != EINTR) {
+                TMFLogError(@"Event loop %@ failed (%s).", _name, strerror(errno));
+                break;
+            }
+
+            for(int i = 0; i < count; i++) {
+#if defined(__linux__)
+                id<TMFEventLoopHandler> handler = (__bridge id<TMFEventLoopHandler>)events[i].data.ptr;
+                uint32_t flags = events[i].events;
+                BOOL readable = (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+                BOOL writable = (flags & EPOLLOUT) != 0;
+#else
+                id<TMFEventLoopHandler> handler = (__bridge id<TMFEventLoopHandler>)events[i].udata;
+                BOOL readable = events[i].filter == EVFILT_READ || (events[i].flags & (EV_EOF | EV_ERROR)) != 0;
+                BOOL writable = events[i].filter == EVFILT_WRITE;
+#endif
+                if(handler) {
+                    [handler eventLoop:self handleEventsReadable:readable writable:writable];
+                }
+                else {
+                    [self drainWakeUps];
+                }
+            }
+
+            [self runBlocks];
+        }
+    }
+
+    [self runBlocks];
+}
+
+- (void)drainWakeUps {
+    uint8_t bytes[64];
+    while(read(_wakeUp[0], bytes, sizeof(bytes)) > 0) {
+    }
+}
+
+- (void)runBlocks {
+    [_blocksLock lock];
+    NSArray *blocks = nil;
+    if([_blocks count] > 0) {
+        blocks = _blocks;
+        _blocks = [NSMutableArray new];
+    }
+    _wakeUpPending = NO;
+    [_blocksLock unlock];
+
+    for(dispatch_block_t block in blocks) {
+        block();
+    }
+}
+
+- (void)closeDescriptors {
+    if(_queue >= 0) {
+        close(_queue);
+        _queue = -1;
+    }
+    for(int i = 0; i < 2; i++) {
+        if(_wakeUp[i] >= 0) {
+            close(_wakeUp[i]);
+            _wakeUp[i] = -1;
+        }
+    }
+}
+
+@end
@@ -0,0 +1,56 @@
+//
+//  TMFEventLoopChannel.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "TMFChannel.h"
+
+/**
+ TMFChannel implementation communicating via TCP sockets driven by native event loops.
+
+ It speaks the same wire protocol as TMFTcpChannel but does not use GCDAsyncSocket. Each loop is a thread waiting
+ on an edge-triggered epoll (Linux) or kqueue (iOS, OS X) descriptor, connections of one host are bound to one loop.
+ Connection state including the receive buffer is preallocated and reused, queued writes are flushed with a
+ single gathering write per loop iteration. This makes the channel a good fit for servers talking to thousands
+ of peers, return it from [TMFConfigurationDelegate reliableChannelClass] to use it.
+ */
+@interface TMFEventLoopChannel : TMFChannel
+
+/**
+ Number of event loop threads.
+ By default one loop per active processor is used, override this method in a sub-class to change it.
+ @return the number of loops, clamped to 1...16
+ */
++ (NSUInteger)eventLoopCount;
+
+/**
+ Number of connections each loop preallocates on start. More connections get allocated on demand and are reused as well.
+ The default is 16, override this method in a sub-class to change it.
+ @return the number of preallocated connections per loop
+ */
++ (NSUInteger)preallocatedConnections;
+
+@end
@@ -0,0 +1,757 @@
+//
+//  TMFEventLoopChannel.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFEventLoopChannel.h"
+#import "TMFEventLoop.h"
+#import "TMFTcpChannel.h"
+#import "TMFTcpChannelSession.h"
+#import "TMFFrameDecoder.h"
+#import "TMFPublishSubscribeCommand.h"
+#import "TMFRequest.h"
+#import "TMFResponse.h"
+#import "TMFPeer.h"
+
+#import "TMFError.h"
+#import "TMFLog.h"
+#import "TMFDefine.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* SO_NOSIGPIPE is set on the socket instead */
+#endif
+
+#define TMF_LOOP_MAX_COUNT       16
+#define TMF_LOOP_READS_PER_EVENT 16       /* reads before other connections of the loop get a turn */
+#define TMF_LOOP_IOVECS          64       /* buffers per gathering write */
+
+@class TMFEventLoopChannel;
+
+/**
+ State of one TCP connection. Objects are reused for later connections of the same loop,
+ the generation tells apart which connection a queued write belongs to.
+ Except for open, all methods must be called on the loop's thread.
+ */
+@interface TMFLoopConnection : NSObject <TMFEventLoopHandler> {
+    int _fd;
+    TMFFrameDecoder *_decoder;
+    TMFProtocol *_protocol;
+    TMFSendQueue *_sendQueue;
+    BOOL _flushScheduled;
+    BOOL _connected; // outgoing connect() completed
+}
+@property (nonatomic, unsafe_unretained) TMFEventLoopChannel *channel;
+@property (nonatomic, readonly) TMFEventLoop *loop;
+@property (nonatomic, readonly) NSUInteger generation;
+@property (nonatomic, readonly) BOOL outgoing;
+@property (nonatomic, readonly) BOOL closed;
+@property (nonatomic, readonly) BOOL legacyFraming;
+@property (nonatomic, strong) TMFPeer *peer;
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, strong) NSData *address;
+- (id)initWithLoop:(TMFEventLoop *)loop protocol:(TMFProtocol *)protocol;
+- (void)openWithDescriptor:(int)fd outgoing:(BOOL)outgoing legacyFraming:(BOOL)legacyFraming;
+- (void)registerWithGeneration:(NSUInteger)generation;
+- (BOOL)writeData:(NSData *)data generation:(NSUInteger)generation policy:(TMFSendQueuePolicy)policy key:(NSString *)key;
+- (void)closeWithGeneration:(NSUInteger)generation;
+- (void)closeWithError:(NSError *)error;
+- (void)reset;
+@end
+
+@interface TMFEventLoopChannel() <TMFEventLoopHandler> {
+    NSLock *_startupLock;
+
+    NSArray *_loops;
+    NSArray *_pools;               // free connections per loop
+    NSMutableArray *_connections;  // every connection object of the run, loops do not retain their handlers
+    NSLock *_poolLock;
+
+    NSMutableDictionary *_sessions;
+    NSLock *_sessionsLock;
+
+    int _listenSocket;
+    NSUInteger _listenPort;
+}
+- (void)connection:(TMFLoopConnection *)connection didReadMessages:(NSArray *)messages;
+- (void)connectionDidClose:(TMFLoopConnection *)connection error:(NSError *)error;
+@end
+
+static void TMFConfigureSocket(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int on = 1;
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    // writes are already coalesced per loop iteration
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+@implementation TMFLoopConnection
+- (id)initWithLoop:(TMFEventLoop *)loop protocol:(TMFProtocol *)protocol {
+    self = [super init];
+    if(self) {
+        _fd = -1;
+        _loop = loop;
+        _protocol = protocol;
+        _decoder = [[TMFFrameDecoder alloc] initWithProtocol:protocol];
+        _sendQueue = [TMFSendQueue new];
+        _closed = YES;
+    }
+    return self;
+}
+
+- (void)openWithDescriptor:(int)fd outgoing:(BOOL)outgoing legacyFraming:(BOOL)legacyFraming {
+    _fd = fd;
+    _outgoing = outgoing;
+    _decoder.legacyFraming = legacyFraming;
+    _connected = NO;
+    _closed = NO;
+    _generation++;
+}
+
+- (void)registerWithGeneration:(NSUInteger)generation {
+    if(_closed || generation != _generation) {
+        return;
+    }
+
+    NSError *error = nil;
+    if(![_loop addDescriptor:_fd handler:self error:&error]) {
+        [self closeWithError:error];
+    }
+}
+
+- (BOOL)writeData:(NSData *)data generation:(NSUInteger)generation policy:(TMFSendQueuePolicy)policy key:(NSString *)key {
+    if(_closed || generation != _generation) {
+        return YES; // callbacks of the connection already failed
+    }
+
+    if(![_sendQueue enqueueData:data policy:policy key:key]) {
+        if(policy == TMFSendQueuePolicyReject) {
+            TMFLogError(@"Send queue of %@ is full, rejecting %@.", _peer, key);
+        }
+        else {
+            TMFLogVerbose(@"Send queue of %@ is full, dropping %@.", _peer, key);
+        }
+        return NO;
+    }
+
+    // all writes queued within one loop iteration go out with one system call
+    if(!_flushScheduled) {
+        _flushScheduled = YES;
+        __unsafe_unretained TMFLoopConnection *connection = self; // connections live as long as their loop runs
+        [_loop performBlock:^{
+            if(generation == connection.generation) {
+                [connection flush];
+            }
+        }];
+    }
+    return YES;
+}
+
+- (void)closeWithGeneration:(NSUInteger)generation {
+    if(generation == _generation) {
+        [self closeWithError:nil];
+    }
+}
+
+- (void)closeWithError:(NSError *)error {
+    if(_closed) {
+        return;
+    }
+    _closed = YES;
+
+    close(_fd);
+    _fd = -1;
+    [_sendQueue removeAllData];
+
+    [_channel connectionDidClose:self error:error];
+}
+
+- (BOOL)legacyFraming {
+    return _decoder.legacyFraming;
+}
+
+- (void)reset {
+    _peer = nil;
+    _key = nil;
+    _address = nil;
+    _flushScheduled = NO;
+    [_decoder reset];
+}
+
+- (void)eventLoop:(TMFEventLoop *)loop handleEventsReadable:(BOOL)readable writable:(BOOL)writable {
+    if(_closed) {
+        return; // reported before the connection got closed in the same iteration
+    }
+
+    if(writable) {
+        if(_outgoing && !_connected) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if(getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+                [self closeWithError:[TMFError errorForCode:TMFChannelErrorCode message:[NSString stringWithFormat:@"Could not connect (%s).", strerror(error ? error : errno)]]];
+                return;
+            }
+            _connected = YES;
+        }
+        [self writePendingData];
+    }
+
+    if(readable && !_closed) {
+        [self readAvailableData];
+    }
+}
+
+- (void)flush {
+    _flushScheduled = NO;
+    if(!_closed && (_connected || !_outgoing)) {
+        [self writePendingData];
+    }
+}
+
+- (void)readAvailableData {
+    __block NSMutableArray *messages = nil;
+    BOOL outgoing = _outgoing;
+    TMFProtocol *protocol = _protocol;
+    frameDecoderBlock_t frames = ^(NSData *body, uint8_t flags) {
+        id message = outgoing ? (id)[protocol responseFromData:body flags:flags] : (id)[protocol requestFromData:body flags:flags];
+        if(message) {
+            if(!messages) {
+                messages = [NSMutableArray new];
+            }
+            [messages addObject:message];
+        }
+    };
+
+    // edge-triggered, read until the socket is empty or the loop has to serve others
+    NSError *error = nil;
+    BOOL failed = NO;
+    NSUInteger reads = 0;
+    for(; reads < TMF_LOOP_READS_PER_EVENT; reads++) {
+        NSData *data = [_decoder readFromFileDescriptor:_fd error:&error];
+        if(!data) {
+            failed = YES;
+            break;
+        }
+        if([data length] == 0) {
+            break;
+        }
+        if(![_decoder decodeReadData:data frames:frames error:&error]) {
+            TMFLogError(@"Invalid message from %@: %@", _peer ? (id)_peer : (id)[TMFPeer stringFromAddressData:_address], error);
+            failed = YES;
+            break;
+        }
+    }
+
+    if([messages count] > 0) {
+        [_channel connection:self didReadMessages:messages];
+    }
+
+    if(failed) {
+        [self closeWithError:error];
+    }
+    else if(reads == TMF_LOOP_READS_PER_EVENT) {
+        NSUInteger generation = _generation;
+        __unsafe_unretained TMFLoopConnection *connection = self;
+        [_loop performBlock:^{
+            if(generation == connection.generation && !connection.closed) {
+                [connection readAvailableData];
+            }
+        }];
+    }
+}
+
+- (void)writePendingData {
+    while([_sendQueue count] > 0) {
+        struct iovec vectors[TMF_LOOP_IOVECS];
+        int count = (int)MIN([_sendQueue count], (NSUInteger)TMF_LOOP_IOVECS);
+        for(int index = 0; index < count; index++) {
+            NSData *data = [_sendQueue dataAtIndex:(NSUInteger)index];
+            NSUInteger offset = (index == 0) ? [_sendQueue offset] : 0;
+            vectors[index].iov_base = (void *)((const uint8_t *)[data bytes] + offset);
+            vectors[index].iov_len = [data length] - offset;
+        }
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = vectors;
+        message.msg_iovlen = count;
+
+        ssize_t written;
+        do {
+            written = sendmsg(_fd, &message, MSG_NOSIGNAL);
+        } while(written < 0 && errno == EINTR);
+
+        if(written < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                [self closeWithError:[TMFError errorForCode:TMFChannelErrorCode message:[NSString stringWithFormat:@"Writing failed (%s).", strerror(errno)]]];
+            }
+            return; // the loop reports when the socket is writable again
+        }
+
+        [_sendQueue consumeLength:(NSUInteger)written];
+    }
+}
+@end
+
+@implementation TMFEventLoopChannel
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithPort:(NSUInteger)port protocol:(TMFProtocol *)protocol delegate:(NSObject<TMFChannelDelegate> *)delegate {
+    self = [super initWithPort:port protocol:protocol delegate:delegate];
+    if(self) {
+        _startupLock = [NSLock new];
+        _poolLock = [NSLock new];
+        _sessionsLock = [NSLock new];
+        _sessions = [NSMutableDictionary new];
+        _listenSocket = -1;
+    }
+    return self;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
++ (NSUInteger)eventLoopCount {
+    return [[NSProcessInfo processInfo] activeProcessorCount];
+}
+
++ (NSUInteger)preallocatedConnections {
+    return 16;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Override
+//............................................................................
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer responseBlock:(responseBlock_t)responseBlock {
+    [self send:command arguments:arguments destination:peer timeout:0 responseBlock:responseBlock];
+}
+
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(NSTimeInterval)timeout responseBlock:(responseBlock_t)responseBlock {
+    NSParameterAssert(peer!=nil);
+    NSParameterAssert(command!=nil);
+    BOOL publishSubscribe = [command isKindOfClass:[TMFPublishSubscribeCommand class]];
+    if (!publishSubscribe) {
+        NSParameterAssert(responseBlock!=nil);
+    }
+
+    arguments.identifier = [TMFTcpChannel nextIdentifier];
+    NSData *data = [self.protocol requestDataForCommand:command arguments:arguments options:[self frameOptionsForPeer:peer]];
+
+    NSUInteger generation = 0;
+    TMFLoopConnection *connection = [self sessionForCommand:command peer:peer generation:&generation];
+    if(connection) {
+        [self addResponseBlock:responseBlock identifier:arguments.identifier peer:peer connection:connection timeout:timeout];
+        [self writeData:data connection:connection generation:generation policy:[self sendQueuePolicyForCommand:command] key:command.name identifier:arguments.identifier];
+    }
+    else {
+        dispatch_async(self.delegate.callbackQueue, ^{
+            if(responseBlock) {
+                responseBlock(nil, [TMFError errorForCode:TMFChannelErrorCode message:@"Could not create socket."]);
+            }
+        });
+    }
+}
+
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destinations:(NSArray *)peers {
+    NSParameterAssert(command!=nil);
+
+    arguments.identifier = [TMFTcpChannel nextIdentifier];
+    NSArray *messages = [self requestDataForCommand:command arguments:arguments destinations:peers];
+    TMFSendQueuePolicy policy = [self sendQueuePolicyForCommand:command];
+
+    [peers enumerateObjectsUsingBlock:^(TMFPeer *peer, NSUInteger idx, __unused BOOL *stop) {
+        NSUInteger generation = 0;
+        TMFLoopConnection *connection = [self sessionForCommand:command peer:peer generation:&generation];
+        if(connection) {
+            [self writeData:[messages objectAtIndex:idx] connection:connection generation:generation policy:policy key:command.name identifier:arguments.identifier];
+        }
+    }];
+}
+
+- (void)removePeer:(TMFPeer *)peer {
+    // getting rid of all sessions to the peer
+    [_sessionsLock lock];
+    NSSet *keys = [_sessions keysOfEntriesPassingTest:^BOOL(__unused id key, TMFLoopConnection *connection, __unused BOOL *stop) {
+        return [connection.peer isEqual:peer];
+    }];
+    NSArray *connections = [_sessions objectsForKeys:[keys allObjects] notFoundMarker:[NSNull null]];
+    NSMutableArray *generations = [NSMutableArray arrayWithCapacity:[connections count]];
+    for(TMFLoopConnection *connection in connections) {
+        [generations addObject:@(connection.generation)];
+    }
+    [_sessions removeObjectsForKeys:[keys allObjects]];
+    [_sessionsLock unlock];
+
+    [connections enumerateObjectsUsingBlock:^(TMFLoopConnection *connection, NSUInteger idx, __unused BOOL *stop) {
+        NSUInteger generation = [[generations objectAtIndex:idx] unsignedIntegerValue];
+        [connection.loop performBlock:^{
+            [connection closeWithGeneration:generation];
+        }];
+    }];
+}
+
+- (NSUInteger)port {
+    return [self isRunning] ? _listenPort : 0;
+}
+
+- (void)start:(startCompletionBlock_t)completion {
+    [_startupLock lock];
+    @autoreleasepool {
+        if(![self isRunning]) {
+            NSError *error = nil;
+            _running = [self startLoops:&error] && [self startListening:&error];
+            if(!_running) {
+                [self stopLoops];
+                TMFLogError(@"Error starting %@ %@", NSStringFromClass([self class]), error);
+            }
+            else {
+                TMFLogInfo(@"Started %@ on port %@ with %@ loops.", NSStringFromClass([self class]), @(_listenPort), @([_loops count]));
+            }
+
+            if(completion) {
+                dispatch_async(self.delegate.callbackQueue, ^{ completion(error); });
+            }
+        }
+    }
+    [_startupLock unlock];
+}
+
+- (void)stop:(stopCompletionBlock_t)completion {
+    [_startupLock lock];
+    _running = NO;
+    [self stopLoops];
+    [_startupLock unlock];
+
+    [self failAllResponseBlocks];
+
+    if(completion) {
+        dispatch_async(self.delegate.callbackQueue, ^{
+            completion();
+        });
+    }
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Delegates
+//............................................................................
+#pragma mark TMFEventLoopHandler
+- (void)eventLoop:(TMFEventLoop *)loop handleEventsReadable:(BOOL)readable writable:(__unused BOOL)writable {
+    // the listening socket lives on the first loop, accepted connections move to the loop of their host
+    while(readable) {
+        struct sockaddr_storage address;
+        socklen_t length = sizeof(address);
+        int fd = accept(_listenSocket, (struct sockaddr *)&address, &length);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                TMFLogError(@"Could not accept connection (%s).", strerror(errno));
+            }
+            break;
+        }
+
+        TMFConfigureSocket(fd);
+        NSData *addressData = [NSData dataWithBytes:&address length:length];
+        TMFLoopConnection *connection = [self dequeueConnectionForLoop:[TMFPeer hostHashFromAddressData:addressData] % [_loops count]];
+        [connection openWithDescriptor:fd outgoing:NO legacyFraming:[self legacyFramingForAddress:addressData]];
+        connection.address = addressData;
+
+        NSUInteger generation = connection.generation;
+        [connection.loop performBlock:^{
+            [connection registerWithGeneration:generation];
+        }];
+    }
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (BOOL)startLoops:(NSError **)error {
+    if(!self.protocol) {
+        TMFLogError(@"No protocol provided.");
+        return NO;
+    }
+
+    NSUInteger count = MAX(1, MIN([[self class] eventLoopCount], TMF_LOOP_MAX_COUNT));
+    NSUInteger preallocated = [[self class] preallocatedConnections];
+    NSMutableArray *loops = [NSMutableArray arrayWithCapacity:count];
+    NSMutableArray *pools = [NSMutableArray arrayWithCapacity:count];
+    _connections = [NSMutableArray arrayWithCapacity:count * preallocated];
+    _loops = loops;
+    _pools = pools;
+
+    for(NSUInteger i = 0; i < count; i++) {
+        TMFEventLoop *loop = [[TMFEventLoop alloc] initWithName:[NSString stringWithFormat:@"tmf.channel.loop.%lu", (unsigned long)i]];
+        if(![loop start:error]) {
+            return NO;
+        }
+        [loops addObject:loop];
+
+        NSMutableArray *pool = [NSMutableArray arrayWithCapacity:preallocated];
+        for(NSUInteger j = 0; j < preallocated; j++) {
+            TMFLoopConnection *connection = [[TMFLoopConnection alloc] initWithLoop:loop protocol:self.protocol];
+            connection.channel = self;
+            [pool addObject:connection];
+            [_connections addObject:connection];
+        }
+        [pools addObject:pool];
+    }
+    return YES;
+}
+
+- (BOOL)startListening:(NSError **)error {
+    // dual stack, IPv4 clients show up with mapped addresses
+    int fd = socket(AF_INET6, SOCK_STREAM, 0);
+    BOOL ipv6 = (fd >= 0);
+    if(!ipv6) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if(fd < 0) {
+        [self setError:error systemCall:@"socket"];
+        return NO;
+    }
+
+    int on = 1;
+    int off = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_storage address;
+    memset(&address, 0, sizeof(address));
+    socklen_t length;
+    if(ipv6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        struct sockaddr_in6 *address6 = (struct sockaddr_in6 *)&address;
+        address6->sin6_family = AF_INET6;
+        address6->sin6_addr = in6addr_any;
+        address6->sin6_port = htons((uint16_t)super.port);
+        length = sizeof(struct sockaddr_in6);
+    }
+    else {
+        struct sockaddr_in *address4 = (struct sockaddr_in *)&address;
+        address4->sin_family = AF_INET;
+        address4->sin_addr.s_addr = htonl(INADDR_ANY);
+        address4->sin_port = htons((uint16_t)super.port);
+        length = sizeof(struct sockaddr_in);
+    }
+
+    if(bind(fd, (struct sockaddr *)&address, length) != 0 || listen(fd, SOMAXCONN) != 0 || getsockname(fd, (struct sockaddr *)&address, &length) != 0) {
+        [self setError:error systemCall:@"bind"];
+        close(fd);
+        return NO;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    _listenPort = ntohs(ipv6 ? ((struct sockaddr_in6 *)&address)->sin6_port : ((struct sockaddr_in *)&address)->sin_port);
+    _listenSocket = fd;
+    if(![[_loops objectAtIndex:0] addDescriptor:fd handler:self error:error]) {
+        close(fd);
+        _listenSocket = -1;
+        return NO;
+    }
+    return YES;
+}
+
+- (void)stopLoops {
+    NSArray *loops = _loops;
+    NSArray *connections = _connections;
+    int listenSocket = _listenSocket;
+    _loops = nil;
+    _pools = nil;
+    _connections = nil;
+    _listenSocket = -1;
+
+    [_sessionsLock lock];
+    [_sessions removeAllObjects];
+    [_sessionsLock unlock];
+
+    // close everything on the loop threads and wait, handlers must not outlive the channel
+    dispatch_group_t group = dispatch_group_create();
+    [loops enumerateObjectsUsingBlock:^(TMFEventLoop *loop, NSUInteger idx, __unused BOOL *stop) {
+        dispatch_group_enter(group);
+        [loop performBlock:^{
+            if(idx == 0 && listenSocket >= 0) {
+                close(listenSocket);
+            }
+            for(TMFLoopConnection *connection in connections) {
+                if(connection.loop == loop) {
+                    connection.channel = nil;
+                    [connection closeWithError:nil];
+                }
+            }
+            dispatch_group_leave(group);
+        }];
+        [loop stop];
+    }];
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+#if ARC_HANDLES_QUEUES
+    dispatch_release(group);
+#endif
+}
+
+- (TMFLoopConnection *)sessionForCommand:(TMFCommand *)command peer:(TMFPeer *)peer generation:(NSUInteger *)generation {
+    // all commands sent to the same peer endpoint share one connection
+    NSUInteger port = [peer portForCommandName:command.name];
+    NSString *key = [TMFTcpChannelSession keyForPeer:peer port:port];
+
+    [_sessionsLock lock];
+    TMFLoopConnection *connection = [_sessions objectForKey:key];
+    if(!connection && [self isRunning]) {
+        connection = [self connectToPeer:peer port:port];
+        if(connection) {
+            connection.key = key;
+            [_sessions setObject:connection forKey:key];
+        }
+    }
+    *generation = connection.generation;
+    [_sessionsLock unlock];
+
+    return connection;
+}
+
+- (TMFLoopConnection *)connectToPeer:(TMFPeer *)peer port:(NSUInteger)port {
+    NSData *address = [peer addressForPort:port];
+    const struct sockaddr *socketAddress = (const struct sockaddr *)[address bytes];
+    int fd = socketAddress ? socket(socketAddress->sa_family, SOCK_STREAM, 0) : -1;
+    if(fd < 0) {
+        TMFLogError(@"Could not create socket for %@ (%s).", peer, strerror(errno));
+        return nil;
+    }
+
+    TMFConfigureSocket(fd);
+    if(connect(fd, socketAddress, (socklen_t)[address length]) != 0 && errno != EINPROGRESS && errno != EINTR) {
+        TMFLogError(@"Could not connect to %@ (%s).", peer, strerror(errno));
+        close(fd);
+        return nil;
+    }
+
+    TMFLoopConnection *connection = [self dequeueConnectionForLoop:[TMFPeer hostHashFromAddressData:address] % [_loops count]];
+    // responses come in the format of our requests
+    [connection openWithDescriptor:fd outgoing:YES legacyFraming:([self frameOptionsForPeer:peer] & TMFFrameOptionLegacyHeader) != 0];
+    connection.peer = peer;
+    connection.address = address;
+
+    NSUInteger generation = connection.generation;
+    [connection.loop performBlock:^{
+        [connection registerWithGeneration:generation];
+    }];
+    return connection;
+}
+
+- (TMFLoopConnection *)dequeueConnectionForLoop:(NSUInteger)index {
+    [_poolLock lock];
+    NSMutableArray *pool = [_pools objectAtIndex:index];
+    TMFLoopConnection *connection = [pool lastObject];
+    if(connection) {
+        [pool removeLastObject];
+    }
+    else {
+        connection = [[TMFLoopConnection alloc] initWithLoop:[_loops objectAtIndex:index] protocol:self.protocol];
+        connection.channel = self;
+        [_connections addObject:connection];
+    }
+    [_poolLock unlock];
+    return connection;
+}
+
+- (void)writeData:(NSData *)data connection:(TMFLoopConnection *)connection generation:(NSUInteger)generation policy:(TMFSendQueuePolicy)policy key:(NSString *)key identifier:(NSUInteger)identifier {
+    [connection.loop performBlock:^{
+        if(![connection writeData:data generation:generation policy:policy key:key]) {
+            [self failResponseBlockForIdentifier:identifier error:[TMFError errorForCode:TMFChannelErrorCode message:@"Send queue is full."]];
+        }
+    }];
+}
+
+- (void)connection:(TMFLoopConnection *)connection didReadMessages:(NSArray *)messages {
+    if(connection.outgoing) {
+        [self executeResponseBlocksForResponses:messages];
+    }
+    else {
+        NSData *address = connection.address;
+        NSUInteger generation = connection.generation;
+        TMFEventLoop *loop = connection.loop;
+        BOOL legacyFraming = connection.legacyFraming;
+
+        [self receiveRequests:messages address:address response:^(TMFRequest *request, id result, NSError *error) {
+            TMFResponse *response = [TMFResponse responseWithidentifier:request.identifier result:result error:[error description]];
+            // answers in the format of the request
+            TMFFrameOption options = (request.compressed ? TMFFrameOptionCompress : 0) | (legacyFraming ? TMFFrameOptionLegacyHeader : 0);
+            NSData *data = [self.protocol data:[self.protocol responseDataForResponse:response] withOptions:options];
+            [loop performBlock:^{
+                if(![connection writeData:data generation:generation policy:TMFSendQueuePolicyReject key:nil]) {
+                    [connection closeWithError:[TMFError errorForCode:TMFChannelErrorCode message:@"The peer does not read its responses."]];
+                }
+            }];
+        }];
+    }
+}
+
+- (void)connectionDidClose:(TMFLoopConnection *)connection error:(NSError *)error {
+    if(connection.outgoing) {
+        [_sessionsLock lock];
+        if(connection.key && [_sessions objectForKey:connection.key] == connection) {
+            [_sessions removeObjectForKey:connection.key];
+        }
+        [_sessionsLock unlock];
+
+        [self failResponseBlocksForConnection:connection error:error];
+    }
+    TMFLogVerbose(@"Connection to %@ closed with error %@.", connection.peer ? (id)connection.peer : (id)[TMFPeer stringFromAddressData:connection.address], error);
+
+    // events of this loop iteration may still be reported, reuse the object afterwards
+    NSUInteger index = [_loops indexOfObjectIdenticalTo:connection.loop];
+    if(index == NSNotFound) {
+        return;
+    }
+    NSMutableArray *pool = [_pools objectAtIndex:index];
+    NSLock *poolLock = _poolLock;
+    [connection.loop performBlock:^{
+        [connection reset];
+        [poolLock lock];
+        [pool addObject:connection];
+        [poolLock unlock];
+    }];
+}
+
+- (void)setError:(NSError **)error systemCall:(NSString *)call {
+    if(error) {
+        *error = [TMFError errorForCode:TMFChannelErrorCode message:[NSString stringWithFormat:@"%@ failed (%s).", call, strerror(errno)]];
+    }
+}
+
+@end
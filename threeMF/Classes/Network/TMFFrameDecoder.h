@@ -0,0 +1,111 @@
+//
+//  TMFFrameDecoder.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "GCDAsyncSocket.h"
+#import "TMFProtocol.h"
+
+/**
+ Callback block for a decoded message body.
+ The body references the decoders receive buffer and is only valid during the call.
+ Slices of the body created with TMFDataSlice stay valid, the decoder hands off its buffer in this case.
+ @param body the message body without header
+ @param flags TMFFrameFlag bits of the message header, 0 for legacy headers
+ */
+typedef void(^frameDecoderBlock_t)(NSData *body, uint8_t flags);
+
+/**
+ Streaming decoder for framed messages read from a stream socket.
+
+ The decoder owns a reusable receive buffer socket reads append to. Each read takes whatever
+ the socket has available and every complete message in the buffer gets decoded at once,
+ incomplete messages stay in the buffer until the next read.
+ A decoder is not thread safe and is meant to be used from a socket's delegate queue.
+ */
+@interface TMFFrameDecoder : NSObject
+
+/**
+ The protocol used to parse message headers
+ */
+@property (nonatomic, strong) TMFProtocol *protocol;
+
+/**
+ Maximum accepted body length of a single message. Larger messages are treated as invalid.
+ */
+@property (nonatomic) uint64_t maximumBodyLength;
+
+/**
+ YES if the stream uses the legacy header of 1.0 peers, default NO.
+ The owner sets the format from the protocol version of the other side, see [TMFProtocol frameOptionsForPeer:].
+ */
+@property (nonatomic) BOOL legacyFraming;
+
+/**
+ Initializes a new instance.
+ @param protocol The protocol used to parse message headers. Must not be nil.
+ */
+- (id)initWithProtocol:(TMFProtocol *)protocol;
+
+/**
+ Queues a read into the receive buffer.
+ @param socket The socket to read from.
+ @param timeout The read timeout, negative values disable the timeout.
+ @param tag The tag passed to the socket's delegate.
+ */
+- (void)readFromSocket:(GCDAsyncSocket *)socket timeout:(NSTimeInterval)timeout tag:(long)tag;
+
+/**
+ Reads whatever a non-blocking file descriptor has available into the receive buffer.
+ @param fd The file descriptor to read from.
+ @param error set if reading failed
+ @return the read data to pass to decodeReadData:frames:error:, empty if nothing is available, nil if the descriptor got closed or reading failed
+ */
+- (NSData *)readFromFileDescriptor:(int)fd error:(NSError **)error;
+
+/**
+ Discards buffered bytes of an incomplete message and resets legacyFraming, so the decoder can be reused for another connection.
+ */
+- (void)reset;
+
+/**
+ Copies bytes received without a socket, e.g. from a TMFSharedRing, into the receive buffer.
+ @param bytes The received bytes.
+ @param length Number of received bytes.
+ @return the copied data to pass to decodeReadData:frames:error:, may be shorter than length if the buffer is full
+ */
+- (NSData *)readBytes:(const void *)bytes length:(NSUInteger)length;
+
+/**
+ Decodes all complete messages after a read finished.
+ @param data The data passed to socket:didReadData:withTag: for a read queued with readFromSocket:timeout:tag:
+ @param block Block called once for each complete message in order. Must not be nil.
+ @param error set if the stream contains an invalid header
+ @return NO if the stream is invalid and the connection should be closed
+ */
+- (BOOL)decodeReadData:(NSData *)data frames:(frameDecoderBlock_t)block error:(NSError **)error;
+
+@end
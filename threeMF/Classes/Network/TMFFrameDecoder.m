@@ -0,0 +1,182 @@
+//
+//  TMFFrameDecoder.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFFrameDecoder.h"
+#import "TMFDataSlice.h"
+#import "TMFError.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#define TMF_DECODER_BUFFER_SIZE 16384      /* default receive buffer size */
+#define TMF_DECODER_MAX_BODY    134217728  /* 128MB */
+
+@interface TMFFrameDecoder() {
+    NSMutableData *_buffer;
+    NSUInteger _used;
+}
+@end
+
+@implementation TMFFrameDecoder
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithProtocol:(TMFProtocol *)protocol {
+    NSParameterAssert(protocol!=nil);
+
+    self = [super init];
+    if(self) {
+        _protocol = protocol;
+        _maximumBodyLength = TMF_DECODER_MAX_BODY;
+        _buffer = [[NSMutableData alloc] initWithLength:TMF_DECODER_BUFFER_SIZE];
+    }
+    return self;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
+- (void)readFromSocket:(GCDAsyncSocket *)socket timeout:(NSTimeInterval)timeout tag:(long)tag {
+    // the buffer length is the capacity, only _used bytes contain data
+    [socket readDataWithTimeout:timeout buffer:_buffer bufferOffset:_used maxLength:[_buffer length] - _used tag:tag];
+}
+
+- (NSData *)readFromFileDescriptor:(int)fd error:(NSError **)error {
+    uint8_t *bytes = (uint8_t *)[_buffer mutableBytes] + _used;
+    ssize_t length;
+    do {
+        length = read(fd, bytes, [_buffer length] - _used);
+    } while(length < 0 && errno == EINTR);
+    if(length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        length = 0;
+    }
+    else if(length <= 0) {
+        if(length < 0 && error) {
+            *error = [TMFError errorForCode:TMFChannelErrorCode message:[NSString stringWithFormat:@"Reading failed (%s).", strerror(errno)]];
+        }
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:bytes length:(NSUInteger)length freeWhenDone:NO];
+}
+
+- (void)reset {
+    _used = 0;
+    _legacyFraming = NO;
+    [self ensureCapacity:0];
+}
+
+- (NSData *)readBytes:(const void *)bytes length:(NSUInteger)length {
+    uint8_t *destination = (uint8_t *)[_buffer mutableBytes] + _used;
+    NSUInteger count = MIN(length, [_buffer length] - _used);
+    memcpy(destination, bytes, count);
+    return [NSData dataWithBytesNoCopy:destination length:count freeWhenDone:NO];
+}
+
+- (BOOL)decodeReadData:(NSData *)data frames:(frameDecoderBlock_t)block error:(NSError **)error {
+    NSParameterAssert(block!=nil);
+    NSAssert([data bytes] == (uint8_t *)[_buffer bytes] + _used, @"Data was not read into the decoder's buffer.");
+
+    _used += [data length];
+
+    const uint8_t *bytes = [_buffer bytes];
+    NSUInteger offset = 0;
+    uint64_t pending = 0;
+    BOOL referenced = NO;
+
+    while(offset < _used) {
+        TMFFrameHeader header;
+        NSError *parseError = nil;
+        if(![self.protocol parseFrameHeader:&header bytes:bytes + offset length:_used - offset legacy:_legacyFraming error:&parseError]) {
+            if(parseError) {
+                if(error) {
+                    *error = parseError;
+                }
+                return NO;
+            }
+            break; // header incomplete
+        }
+
+        if(header.bodyLength > self.maximumBodyLength) {
+            if(error) {
+                *error = [TMFError errorForCode:TMFMessageParsingErrorCode message:[NSString stringWithFormat:@"Message of %llu bytes exceeds the maximum length.", header.bodyLength]];
+            }
+            return NO;
+        }
+
+        uint64_t frameLength = header.headerLength + header.bodyLength;
+        if(frameLength > _used - offset) {
+            pending = frameLength;
+            break; // body incomplete
+        }
+
+        TMFDataSlice *body = [[TMFDataSlice alloc] initWithData:_buffer range:NSMakeRange(offset + header.headerLength, (NSUInteger)header.bodyLength)];
+        @autoreleasepool {
+            block(body, header.flags);
+        }
+        referenced = referenced || [body isReferenced];
+        offset += (NSUInteger)frameLength;
+    }
+
+    if(referenced) {
+        // decoded messages keep slices of the buffer, hand it off and continue with a new one
+        _used -= offset;
+        NSMutableData *buffer = [[NSMutableData alloc] initWithLength:MAX(_used, TMF_DECODER_BUFFER_SIZE)];
+        if(_used > 0) {
+            memcpy([buffer mutableBytes], bytes + offset, _used);
+        }
+        _buffer = buffer;
+    }
+    else if(offset > 0) {
+        // move the incomplete rest to the front
+        _used -= offset;
+        if(_used > 0) {
+            memmove([_buffer mutableBytes], (uint8_t *)[_buffer mutableBytes] + offset, _used);
+        }
+    }
+
+    [self ensureCapacity:(NSUInteger)pending];
+
+    return YES;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (void)ensureCapacity:(NSUInteger)frameLength {
+    NSUInteger capacity = MAX(frameLength, TMF_DECODER_BUFFER_SIZE);
+    if(_used == [_buffer length] || capacity > [_buffer length]) {
+        // grow for a large message, the next read must never be empty
+        [_buffer setLength:MAX(capacity, _used + TMF_DECODER_BUFFER_SIZE)];
+    }
+    else if(_used == 0 && [_buffer length] > TMF_DECODER_BUFFER_SIZE) {
+        // release memory after a large message
+        [_buffer setLength:TMF_DECODER_BUFFER_SIZE];
+    }
+}
+
+@end
@@ -43,6 +43,11 @@
  */
 @property (nonatomic, readonly, copy) NSString *protocolIdentifier;
 
+/**
+ Major version of the peer's protocol, taken from protocolIdentifier. 0 if unknown.
+ */
+@property (nonatomic, readonly) NSUInteger protocolMajorVersion;
+
 /**
  The name of the peer.
  */
@@ -64,6 +69,18 @@
  */
 @property (nonatomic, readonly, copy) NSArray *addresses;
 
+/**
+ Path of the peer's TMFUnixChannel socket file.
+ Only set if one of the peer's addresses belongs to this host and the socket is accessible, nil otherwise.
+ */
+@property (nonatomic, readonly, copy) NSString *localSocketPath;
+
+/**
+ YES if the peer accepts messages compressed by [TMFProtocol compressedData:].
+ Advertised with the "cmp" entry of the peer's txtRecord.
+ */
+@property (nonatomic, readonly) BOOL supportsCompression;
+
 /**
  A list of command names the peer has published.
  */
@@ -104,6 +121,21 @@
  */
 - (NSUInteger)portForCommandName:(NSString *)commandName;
 
+/**
+ Gets the socket address used for a specific command.
+ @param commandName The unique command name provided by [TMFCommand name].
+ @return struct sockaddr data of the peer's first address with the command's port, nil if the peer has no address
+ */
+- (NSData *)addressForCommandName:(NSString *)commandName;
+
+/**
+ Gets the socket address of a port.
+ Endpoints of known command ports are precomputed, so this does not copy addresses or resolve the host name.
+ @param port The destination port.
+ @return struct sockaddr data of the peer's first address with the given port, nil if the peer has no address
+ */
+- (NSData *)addressForPort:(NSUInteger)port;
+
 /**
  Updates the peers meta information based on [NSNetService TXTRecordData]
  @param data The new data provided by the NSNetService [NSNetService TXTRecordData]
@@ -136,4 +168,12 @@
  */
 + (NSString *)stringFromAddressData:(NSData *)data;
 
+/**
+ Hash of the host part of sockaddr_in or sockaddr_in6 addresses.
+ Ports are ignored, all connections of one host get the same hash. IPv4 mapped IPv6 addresses hash like their IPv4 address.
+ @param data The sockaddr_in or sockaddr_in6 data
+ @return The hash of the host, the same value for all data without a host part.
+ */
++ (NSUInteger)hostHashFromAddressData:(NSData *)data;
+
 @end
@@ -31,6 +31,35 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <ifaddrs.h>
+#include <unistd.h>
+
+/**
+ Immutable endpoint tables of a peer, replaced as a whole whenever addresses or ports change
+ */
+@interface TMFPeerEndpoints : NSObject
+@property (nonatomic, readonly) NSData *firstAddress;
+@property (nonatomic, readonly, copy) NSString *firstHost;
+@property (nonatomic, readonly, copy) NSDictionary *endpointsByPort;    // NSNumber port -> sockaddr data
+@property (nonatomic, readonly, copy) NSDictionary *endpointsByCommand; // command name -> sockaddr data
+@property (nonatomic, readonly, copy) NSDictionary *portsByCommand;     // command name -> NSNumber port, also without addresses
+@property (nonatomic, readonly, copy) NSString *localSocketPath;        // advertised socket path if the host is this host
+- (id)initWithFirstAddress:(NSData *)firstAddress endpointsByPort:(NSDictionary *)endpointsByPort endpointsByCommand:(NSDictionary *)endpointsByCommand portsByCommand:(NSDictionary *)portsByCommand localSocketPath:(NSString *)localSocketPath;
+@end
+
+@implementation TMFPeerEndpoints
+- (id)initWithFirstAddress:(NSData *)firstAddress endpointsByPort:(NSDictionary *)endpointsByPort endpointsByCommand:(NSDictionary *)endpointsByCommand portsByCommand:(NSDictionary *)portsByCommand localSocketPath:(NSString *)localSocketPath {
+    self = [super init];
+    if(self) {
+        _firstAddress = firstAddress;
+        _firstHost = firstAddress ? [GCDAsyncSocket hostFromAddress:firstAddress] : nil;
+        _endpointsByPort = [endpointsByPort copy];
+        _endpointsByCommand = [endpointsByCommand copy];
+        _portsByCommand = [portsByCommand copy];
+        _localSocketPath = [localSocketPath copy];
+    }
+    return self;
+}
+@end
 
 @interface TMFPeer () {
     NSNetService *_service;
@@ -38,7 +67,10 @@
     NSMutableArray *_addresses;
     NSArray *_previousCapabilities;
     NSMutableDictionary *_portsByCommand;
+    NSString *_advertisedSocketPath;
 }
+// read on the send path without locking, a reader always gets one complete snapshot
+@property (atomic, strong) TMFPeerEndpoints *endpoints;
 @end
 
 @implementation TMFPeer
@@ -58,6 +90,7 @@
         _capabilities = [NSArray new];
 
         _portsByCommand = [NSMutableDictionary new];
+        _endpoints = [[TMFPeerEndpoints alloc] initWithFirstAddress:nil endpointsByPort:nil endpointsByCommand:nil portsByCommand:nil localSocketPath:nil];
     }
     return self;
 }
@@ -71,6 +104,7 @@
         _name = [[netService name] copy];
         _hostName = [[netService hostName] copy];
         _addresses = [[NSMutableArray alloc] initWithArray:[netService addresses] copyItems:YES];
+        [self rebuildEndpoints];
         [self updateWithTXTRecordData:netService.TXTRecordData];
     }
     return self;
@@ -80,11 +114,15 @@
     TMFPeer *copy = [TMFPeer new]; // also tired: [[TMFPeer allocWithZone:zone] init];
     copy->_UUID = self.UUID; // copy property
     copy->_protocolIdentifier = self.protocolIdentifier;
+    copy->_protocolMajorVersion = self.protocolMajorVersion;
     copy->_domain = self.domain; // copy property
     copy->_name = self.name; // copy property
     copy->_addresses = [[NSMutableArray alloc] initWithArray:_addresses copyItems:YES];
     copy->_hostName = self.hostName; // copy property
     copy->_capabilities = [[NSArray alloc] initWithArray:self.capabilities copyItems:YES];
+    copy->_advertisedSocketPath = _advertisedSocketPath;
+    copy->_supportsCompression = self.supportsCompression;
+    [copy rebuildEndpoints];
     return copy;
 }
 
@@ -98,19 +136,42 @@
         [newAddresses addObject:[TMFPeer addressWithAddress:address port:port]];
     }
     _addresses = newAddresses;
+    [self rebuildEndpoints];
 }
 
 - (void)setPort:(NSUInteger)port commandName:(NSString *)commandName {
-    if(commandName) {
+    if(commandName && ![[_portsByCommand objectForKey:commandName] isEqual:@(port)]) {
         [_portsByCommand setObject:@(port) forKey:commandName];
+        [self rebuildEndpoints];
     }
 }
 
 - (NSUInteger)portForCommandName:(NSString *)commandName {
-    if(commandName && [_portsByCommand objectForKey:commandName]) {
-        return [[_portsByCommand objectForKey:commandName] unsignedIntegerValue];
+    TMFPeerEndpoints *endpoints = self.endpoints;
+    NSData *address = commandName ? [endpoints.endpointsByCommand objectForKey:commandName] : nil;
+    if(address) {
+        return [TMFPeer portOfAddress:address];
+    }
+    NSNumber *port = commandName ? [endpoints.portsByCommand objectForKey:commandName] : nil;
+    if(port) {
+        return [port unsignedIntegerValue]; // peers without resolved addresses are reached by host name
     }
-    return [GCDAsyncSocket portFromAddress:[self firstAddress]]; // system channel port
+    return endpoints.firstAddress ? [TMFPeer portOfAddress:endpoints.firstAddress] : 0; // system channel port
+}
+
+- (NSData *)addressForCommandName:(NSString *)commandName {
+    TMFPeerEndpoints *endpoints = self.endpoints;
+    NSData *address = commandName ? [endpoints.endpointsByCommand objectForKey:commandName] : nil;
+    return address ? address : endpoints.firstAddress; // system channel port
+}
+
+- (NSData *)addressForPort:(NSUInteger)port {
+    TMFPeerEndpoints *endpoints = self.endpoints;
+    NSData *address = [endpoints.endpointsByPort objectForKey:@(port)];
+    if(!address && endpoints.firstAddress) {
+        address = [TMFPeer addressWithAddress:endpoints.firstAddress port:port];
+    }
+    return address;
 }
 
 - (void)updateWithTXTRecordData:(NSData *)data {
@@ -121,6 +182,14 @@
         NSDictionary *TXTRecord = [NSNetService dictionaryFromTXTRecordData:data];        
         _UUID = [uuid copy];
         _protocolIdentifier = [TMFPeer protocolIdentifierFromTXTRecord:TXTRecord];
+        _protocolMajorVersion = (NSUInteger)MAX(0, [[[_protocolIdentifier componentsSeparatedByString:@","] lastObject] integerValue]);
+        _supportsCompression = [TMFPeer supportsCompressionFromTXTRecord:TXTRecord];
+
+        NSString *socketPath = [TMFPeer localSocketPathFromTXTRecord:TXTRecord];
+        if(socketPath != _advertisedSocketPath && ![socketPath isEqualToString:_advertisedSocketPath]) {
+            _advertisedSocketPath = socketPath;
+            [self rebuildEndpoints];
+        }
 
         NSArray *previousCapabilities = [NSArray arrayWithArray:_capabilities];
         NSArray *newCapabilities = [TMFPeer capabilitiesFromTXTRecord:TXTRecord];
@@ -166,8 +235,34 @@
     return [NSString stringWithFormat:@"%@:%d", [GCDAsyncSocket hostFromAddress:data], [GCDAsyncSocket portFromAddress:data]];
 }
 
++ (NSUInteger)hostHashFromAddressData:(NSData *)data {
+    const struct sockaddr *socketAddress = (const struct sockaddr *)[data bytes];
+    const uint8_t *host = NULL;
+    size_t length = 0;
+    if(socketAddress && [data length] >= sizeof(struct sockaddr_in) && socketAddress->sa_family == AF_INET) {
+        host = (const uint8_t *)&((const struct sockaddr_in *)socketAddress)->sin_addr;
+        length = sizeof(struct in_addr);
+    }
+    else if(socketAddress && [data length] >= sizeof(struct sockaddr_in6) && socketAddress->sa_family == AF_INET6) {
+        host = (const uint8_t *)&((const struct sockaddr_in6 *)socketAddress)->sin6_addr;
+        length = sizeof(struct in6_addr);
+        if(IN6_IS_ADDR_V4MAPPED(&((const struct sockaddr_in6 *)socketAddress)->sin6_addr)) {
+            host += 12;
+            length = sizeof(struct in_addr);
+        }
+    }
+
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; i++) {
+        hash = (hash ^ host[i]) * 16777619u;
+    }
+    return hash;
+}
+
 - (void)addAddressesFromNetService:(NSNetService *)netService {
     [_addresses addObjectsFromArray:netService.addresses];
+    [self rebuildEndpoints];
 }
 
 - (BOOL)isEqualHost:(TMFPeer *)peer {
@@ -195,7 +290,7 @@
 #pragma mark Override
 //............................................................................
 - (NSString *)hostName {
-    return (_hostName != nil && [_hostName length] > 0 ? _hostName : [GCDAsyncSocket hostFromAddress:[self firstAddress]]);
+    return (_hostName != nil && [_hostName length] > 0 ? _hostName : self.endpoints.firstHost);
 }
 
 - (NSArray *)addresses {
@@ -210,6 +305,10 @@
     return [NSArray arrayWithArray:addresses];
 }
 
+- (NSString *)localSocketPath {
+    return self.endpoints.localSocketPath;
+}
+
 - (NSArray *)previousCapabilities {
     return _previousCapabilities;
 }
@@ -242,13 +341,75 @@
 #pragma mark Private
 //............................................................................
 - (NSData *)firstAddress {
-    for(NSData *a in self.addresses) {
-        if(((struct sockaddr *)[a bytes])->sa_family == AF_INET || ((struct sockaddr *)[a bytes])->sa_family == AF_INET6
-           ) {
-            return a;
+    return self.endpoints.firstAddress;
+}
+
+- (void)rebuildEndpoints {
+    NSArray *addresses = [self addresses];
+    NSData *firstAddress = [addresses count] > 0 ? [addresses objectAtIndex:0] : nil;
+
+    NSMutableDictionary *endpointsByPort = [NSMutableDictionary new];
+    NSMutableDictionary *endpointsByCommand = [NSMutableDictionary new];
+    if(firstAddress) {
+        [endpointsByPort setObject:firstAddress forKey:@([TMFPeer portOfAddress:firstAddress])];
+        [_portsByCommand enumerateKeysAndObjectsUsingBlock:^(NSString *commandName, NSNumber *port, __unused BOOL *stop) {
+            NSData *endpoint = [endpointsByPort objectForKey:port];
+            if(!endpoint) {
+                endpoint = [TMFPeer addressWithAddress:firstAddress port:[port unsignedIntegerValue]];
+                [endpointsByPort setObject:endpoint forKey:port];
+            }
+            [endpointsByCommand setObject:endpoint forKey:commandName];
+        }];
+    }
+
+    // any peer may advertise a socket path, only one of this host may own it
+    NSString *localSocketPath = (_advertisedSocketPath && [TMFPeer containsLocalAddress:addresses]) ? _advertisedSocketPath : nil;
+
+    self.endpoints = [[TMFPeerEndpoints alloc] initWithFirstAddress:firstAddress endpointsByPort:endpointsByPort endpointsByCommand:endpointsByCommand portsByCommand:_portsByCommand localSocketPath:localSocketPath];
+}
+
++ (BOOL)containsLocalAddress:(NSArray *)addresses {
+    if([addresses count] == 0) {
+        return NO;
+    }
+
+    struct ifaddrs *interfaces = NULL;
+    if(getifaddrs(&interfaces) != 0) {
+        return NO;
+    }
+
+    BOOL local = NO;
+    for(NSData *address in addresses) {
+        const struct sockaddr *socketAddress = (const struct sockaddr *)[address bytes];
+        for(struct ifaddrs *interface = interfaces; interface && !local; interface = interface->ifa_next) {
+            const struct sockaddr *interfaceAddress = interface->ifa_addr;
+            if(!interfaceAddress || interfaceAddress->sa_family != socketAddress->sa_family) {
+                continue;
+            }
+            if(socketAddress->sa_family == AF_INET && [address length] >= sizeof(struct sockaddr_in)) {
+                local = memcmp(&((const struct sockaddr_in *)socketAddress)->sin_addr, &((const struct sockaddr_in *)interfaceAddress)->sin_addr, sizeof(struct in_addr)) == 0;
+            }
+            else if(socketAddress->sa_family == AF_INET6 && [address length] >= sizeof(struct sockaddr_in6)) {
+                local = memcmp(&((const struct sockaddr_in6 *)socketAddress)->sin6_addr, &((const struct sockaddr_in6 *)interfaceAddress)->sin6_addr, sizeof(struct in6_addr)) == 0;
+            }
+        }
+        if(local) {
+            break;
         }
     }
-    return nil;
+    freeifaddrs(interfaces);
+    return local;
+}
+
++ (NSUInteger)portOfAddress:(NSData *)address {
+    const struct sockaddr *socketAddress = (const struct sockaddr *)[address bytes];
+    if(socketAddress->sa_family == AF_INET6 && [address length] >= sizeof(struct sockaddr_in6)) {
+        return ntohs(((const struct sockaddr_in6 *)socketAddress)->sin6_port);
+    }
+    else if(socketAddress->sa_family == AF_INET && [address length] >= sizeof(struct sockaddr_in)) {
+        return ntohs(((const struct sockaddr_in *)socketAddress)->sin_port);
+    }
+    return 0;
 }
 
 + (NSData *)addressWithAddress:(NSData *)addr port:(NSUInteger)port {
@@ -263,6 +424,20 @@
     return [capabilities componentsSeparatedByString:@","];
 }
 
++ (NSString *)localSocketPathFromTXTRecord:(NSDictionary *)TXTRecord {
+    // the socket file only exists if the peer runs on this host
+    NSString *path = [[NSString alloc] initWithData:[TXTRecord objectForKey:@"uds"] encoding:NSUTF8StringEncoding];
+    if([path length] > 0 && access([path fileSystemRepresentation], R_OK | W_OK) == 0) {
+        return path;
+    }
+    return nil;
+}
+
++ (BOOL)supportsCompressionFromTXTRecord:(NSDictionary *)TXTRecord {
+    NSString *compression = [[NSString alloc] initWithData:[TXTRecord objectForKey:@"cmp"] encoding:NSUTF8StringEncoding];
+    return [[compression componentsSeparatedByString:@","] containsObject:@"deflate"];
+}
+
 + (NSString *)protocolIdentifierFromTXTRecord:(NSDictionary *)TXTRecord {
     return [[NSString alloc] initWithData:[TXTRecord objectForKey:@"pro"] encoding:NSUTF8StringEncoding];
 }
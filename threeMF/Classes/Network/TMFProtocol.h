@@ -28,7 +28,19 @@
 #import <Foundation/Foundation.h>
 #import "TMFProtocolCoder.h"
 
-@class TMFCommand, TMFArguments, TMFResponse;
+@class TMFCommand, TMFArguments, TMFResponse, TMFPeer;
+
+/*
+ Message compression, see [TMFProtocol compressedData:].
+ zlib runs at Z_BEST_SPEED because every send of a message deflates it again. Below the threshold the few
+ bytes saved are not worth a deflate call. Bodies of at least 4 probes are first deflated with a probe sized
+ sample from their middle, so already compressed payloads like images skip the full deflate. A body or probe
+ goes out raw unless compression saves at least 1/TMF_COMPRESSION_MIN_SAVING of it.
+ Benchmarks/compression_bench.c measures these values on sample payloads.
+ */
+#define TMF_COMPRESSION_THRESHOLD  1024 /* default compressionThreshold in bytes */
+#define TMF_COMPRESSION_PROBE      4096 /* sample size for probing large bodies */
+#define TMF_COMPRESSION_MIN_SAVING 8    /* required saving as fraction 1/n */
 
 /**
  Callback block for the header parser
@@ -37,9 +49,67 @@
  */
 typedef void(^headerParserCompletion_t)(uint64_t length, NSError *error);
 
+/**
+ Kind of message announced by the frame header
+ */
+typedef enum {
+    TMFMessageTypeUnknown = 0,  /* legacy headers do not carry a type */
+    TMFMessageTypeRequest = 1,  /* request of a TMFRequestResponseCommand */
+    TMFMessageTypeResponse = 2, /* response to a request */
+    TMFMessageTypePublish = 3   /* request of a TMFPublishSubscribeCommand */
+} TMFMessageType;
+
+/**
+ Flag bits of the frame header
+ */
+typedef enum {
+    TMFFrameFlagCompressed = 1 << 2,  /* the body is deflated and followed by its inflated length */
+    TMFFrameFlagAttachments = 1 << 3, /* the body carries binary attachments */
+    TMFFrameFlagFragment = 1 << 4     /* a fragment header follows, the body is one part of a message */
+} TMFFrameFlag;
+
+/**
+ Options for sending framed data to a peer
+ */
+typedef enum {
+    TMFFrameOptionCompress = 1 << 0,          /* compress large bodies, see [TMFProtocol compressedData:] */
+    TMFFrameOptionLegacyHeader = 1 << 1,      /* write the 64 bit length header and plain message body understood by 1.0 peers */
+    TMFFrameOptionCommandIdentifier = 1 << 2  /* identify publish subscribe commands by their commandIdentifier instead of the name */
+} TMFFrameOption;
+
+/**
+ Parsed message header
+ */
+typedef struct {
+    NSUInteger headerLength; /* length of the header in bytes */
+    uint64_t bodyLength;     /* length of the message body following the header */
+    TMFMessageType type;     /* kind of message */
+    uint8_t flags;           /* TMFFrameFlag bits */
+    BOOL legacy;             /* 64 bit length header written by a 1.0 peer */
+} TMFFrameHeader;
+
+/**
+ Header of a broadcast package carrying one fragment of a request
+ */
+typedef struct {
+    uint16_t identifier; /* identifier shared by all fragments of a request */
+    uint16_t index;      /* index of the fragment */
+    uint16_t count;      /* number of fragments, 0 if the package is not a fragment */
+    uint8_t flags;       /* TMFFrameFlag bits of the message, without TMFFrameFlagFragment */
+} TMFFragmentHeader;
+
 /**
  Protocol responsible for parsing TCP / UDP data to TMFRequest and TMFResponse objects.
  Each peer talking has to use the same protocol and coder in order to talk to each other.
+
+ Messages start with a compact header: a magic/version byte, a byte carrying the TMFMessageType and TMFFrameFlag bits
+ and the body length as varint. Peers of version 1.0 prefix the plain coder message with a host-endian 64 bit length
+ instead. The bytes do not tell both formats apart, channels pick the format of a stream or datagram from the
+ protocol version of the other side, see frameOptionsForPeer:. Data for 1.0 peers gets converted with data:withOptions:.
+
+ Binary data within request arguments or response results is not encoded by the coder. It gets appended
+ to the message body as raw attachment and is referenced by a TMFAttachmentReference from the encoded message.
+ Only bodies flagged with TMFFrameFlagAttachments carry attachments and end with their lengths and count.
  Provide your own protocol by sub-classing and overwriting each public method.
  */
 @interface TMFProtocol : NSObject
@@ -66,15 +136,20 @@ typedef void(^headerParserCompletion_t)(uint64_t length, NSError *error);
 @property (nonatomic, readonly, copy) NSString *identifier;
 
 /**
- Size of a TMFRequestResponseCommand message header
+ Maximum size of a TMFRequestResponseCommand message header
  */
 @property (nonatomic, readonly) NSUInteger requestResponseHeaderLength;
 
 /**
- Size of a TMFPublishSubscribeCommand message header
+ Maximum size of a TMFPublishSubscribeCommand message header
  */
 @property (nonatomic, readonly) NSUInteger publishSubscribeHeaderLength;
 
+/**
+ Minimum message body size in bytes for compressedData: to compress a message. Default TMF_COMPRESSION_THRESHOLD.
+ */
+@property (nonatomic) NSUInteger compressionThreshold;
+
 /**
  Initializes a new protocol instance with a given coder.
  @param coder Data coder conforming to TMFProtocolCoder
@@ -83,11 +158,33 @@ typedef void(^headerParserCompletion_t)(uint64_t length, NSError *error);
 
 /**
  Parses the header out of a given data package
- @param data the data containing the encoded header, must be of requestResponseHeaderLength or publishSubscribeHeaderLength length
+ @param data the data containing the encoded header, must not be longer than requestResponseHeaderLength or publishSubscribeHeaderLength
  @param completion callback block containing the parsing result, may not be nil
  */
 - (void)parseHeader:(NSData *)data completion:(headerParserCompletion_t)completion;
 
+/**
+ Parses a compact message header at the beginning of a byte buffer.
+ Use parseFrameHeader:bytes:length:legacy:error: for streams of 1.0 peers.
+ @param header the parsed header, must not be NULL
+ @param bytes buffer starting with the header
+ @param length number of available bytes in the buffer
+ @param error set if the bytes do not start with a valid header
+ @return YES if a complete header got parsed, NO if more bytes are needed or the header is invalid (error is set)
+ */
+- (BOOL)parseFrameHeader:(TMFFrameHeader *)header bytes:(const void *)bytes length:(NSUInteger)length error:(NSError **)error;
+
+/**
+ Parses a message header of a known format at the beginning of a byte buffer.
+ @param header the parsed header, must not be NULL
+ @param bytes buffer starting with the header
+ @param length number of available bytes in the buffer
+ @param legacy YES to parse a 64 bit length header of a 1.0 peer
+ @param error set if the bytes do not start with a valid header
+ @return YES if a complete header got parsed, NO if more bytes are needed or the header is invalid (error is set)
+ */
+- (BOOL)parseFrameHeader:(TMFFrameHeader *)header bytes:(const void *)bytes length:(NSUInteger)length legacy:(BOOL)legacy error:(NSError **)error;
+
 /**
  Creates a data package out of a command and corresponding arguments. The data package will get encoded using the protocol's coder.
  @param command the requests command to encode, must not be nil
@@ -96,6 +193,16 @@ typedef void(^headerParserCompletion_t)(uint64_t length, NSError *error);
  */
 - (NSData *)requestDataForCommand:(TMFCommand *)command arguments:(TMFArguments *)arguments;
 
+/**
+ Creates a data package for sending a command to peers with the given options.
+ With TMFFrameOptionCommandIdentifier published commands are encoded with their [TMFPublishSubscribeCommand commandIdentifier], if they have one.
+ @param command the requests command to encode, must not be nil
+ @param arguments corresponding arguments for the command, must not be nil
+ @param options TMFFrameOption bits, usually provided by frameOptionsForPeer:
+ @return an encoded TMFRequest as data object, converted by data:withOptions:
+ */
+- (NSData *)requestDataForCommand:(TMFCommand *)command arguments:(TMFArguments *)arguments options:(TMFFrameOption)options;
+
 /**
  Creates a data package out of a request object. The data package will get encoded using the protocol's coder.
  @param request the request object to encode, must not be nil
@@ -111,25 +218,109 @@ typedef void(^headerParserCompletion_t)(uint64_t length, NSError *error);
 - (NSData *)responseDataForResponse:(TMFResponse *)response;
 
 /**
- Decodes a data package into a TMFRequest object. The data package must not contain any headers and must not be nil.
+ Compresses request or response data created by this protocol.
+ Message bodies of at least compressionThreshold bytes get deflated and flagged, decoding inflates them transparently.
+ Only send compressed data to peers with [TMFPeer supportsCompression].
+ @param data framed request or response data, must not be nil
+ @return the compressed data, data itself if the body is too small or does not compress well
+ */
+- (NSData *)compressedData:(NSData *)data;
+
+/**
+ Options for data sent to a peer, depending on its protocol version and features.
+ @param peer the destination peer, must not be nil
+ @return TMFFrameOption bits to pass to data:withOptions:
+ */
+- (TMFFrameOption)frameOptionsForPeer:(TMFPeer *)peer;
+
+/**
+ Prepares request or response data created by this protocol for sending.
+ With TMFFrameOptionLegacyHeader the message is converted to a legacy frame, compression is skipped and attachments
+ are moved into the message as Base64 strings, see [TMFSerializableObject encodeBinaryData:].
+ TMFFrameOptionCommandIdentifier is ignored, it needs requestDataForCommand:arguments:options:
+ @param data framed request or response data, must not be nil
+ @param options TMFFrameOption bits, usually provided by frameOptionsForPeer:
+ @return the converted data, data itself if nothing had to be changed
+ */
+- (NSData *)data:(NSData *)data withOptions:(TMFFrameOption)options;
+
+/**
+ Decodes a data package without attachments and compression into a TMFRequest object.
+ The data package must not contain any headers and must not be nil.
  @param data data package for decoding
  @return a decoded TMFRequest
  */
 - (TMFRequest *)requestFromData:(NSData *)data;
 
 /**
- Decodes a data package into a TMFResponse object. The data package must not contain any headers and must not be nil.
+ Decodes a data package into a TMFRequest object. The data package must not contain any headers and must not be nil.
+ Binary arguments reference the data package without copying it.
+ @param data data package for decoding
+ @param flags TMFFrameFlag bits of the message header, they tell whether the body is compressed and carries attachments
+ @return a decoded TMFRequest
+ */
+- (TMFRequest *)requestFromData:(NSData *)data flags:(uint8_t)flags;
+
+/**
+ Decodes a data package without attachments and compression into a TMFResponse object.
+ The data package must not contain any headers and must not be nil.
  @param data data package for decoding
  @return a decoded TMFResponse
  */
 - (TMFResponse *)responseFromData:(NSData *)data;
 
+/**
+ Decodes a data package into a TMFResponse object. The data package must not contain any headers and must not be nil.
+ Binary data within the result references the data package without copying it.
+ @param data data package for decoding
+ @param flags TMFFrameFlag bits of the message header, they tell whether the body is compressed and carries attachments
+ @return a decoded TMFResponse
+ */
+- (TMFResponse *)responseFromData:(NSData *)data flags:(uint8_t)flags;
+
 /**
  Encodes a request into several data packages with a maximal size.
  @param request the request object to encode, must not be nil
  @param maxSize maximum size for each individual data package
  @return an array containing 1 to n data packages
  */
-- (NSArray *)broadcastPackagesForRequest:(TMFRequest *)request maxSize:(NSUInteger)maxSize; // unused
+- (NSArray *)broadcastPackagesForRequest:(TMFRequest *)request maxSize:(NSUInteger)maxSize;
+
+/**
+ Splits request data with a compact header into several data packages with a maximal size.
+ @param requestData data created by requestDataForCommand:arguments: or requestDataForRequest:, must not be nil
+ @param maxSize maximum size for each individual data package
+ @return an array containing requestData if it fits into one package or 2 to n fragment packages, nil if the request is too large to be split
+ */
+- (NSArray *)broadcastPackagesForRequestData:(NSData *)requestData maxSize:(NSUInteger)maxSize;
+
+/**
+ Splits request data into several data packages with a maximal size.
+ @param requestData data created by requestDataForCommand:arguments: or requestDataForRequest:, must not be nil
+ @param maxSize maximum size for each individual data package
+ @param legacy YES if requestData got converted for 1.0 peers with data:withOptions:
+ @return an array containing requestData if it fits into one package or 2 to n fragment packages, nil if the request is too large to be split
+ */
+- (NSArray *)broadcastPackagesForRequestData:(NSData *)requestData maxSize:(NSUInteger)maxSize legacy:(BOOL)legacy;
+
+/**
+ Extracts the body of a broadcast package.
+ A package is either a complete request or a fragment created by broadcastPackagesForRequestData:maxSize:legacy:
+ @param package the received data package, must not be nil
+ @param legacy YES if the package got sent by a 1.0 peer
+ @param fragmentHeader set to the fragment header, count is 0 if the package contains a complete request. Must not be NULL.
+ Its flags are needed to decode the request, see requestFromData:flags:
+ @return the request or fragment body, nil if the package is invalid
+ */
+- (NSData *)bodyOfBroadcastPackage:(NSData *)package legacy:(BOOL)legacy fragmentHeader:(TMFFragmentHeader *)fragmentHeader;
+
+/**
+ Checks if peers using the given protocol identifiers can talk to each other.
+ Identifiers need the same protocol name and major version, 2.x peers also talk to 1.0 peers using legacy frames.
+ @param identifier protocol identifier in the form "name,version"
+ @param otherIdentifier protocol identifier in the form "name,version"
+ @return YES if the protocols are compatible
+ */
++ (BOOL)isIdentifier:(NSString *)identifier compatibleWithIdentifier:(NSString *)otherIdentifier;
 
 @end
@@ -25,13 +25,38 @@
 
 #import "TMFProtocol.h"
 #import "TMFCommand.h"
+#import "TMFPublishSubscribeCommand.h"
+#import "TMFPeer.h"
 #import "TMFError.h"
+#import "TMFLog.h"
 
 #import "TMFRequest.h"
 #import "TMFResponse.h"
+#import "TMFSerializableObject.h"
+#import "TMFDataSlice.h"
+#import "TMFAttachmentReference.h"
 
 #import "TMFJsonRpcCoder.h"
 
+#import <libkern/OSByteOrder.h>
+#include <stdatomic.h>
+#include <zlib.h>
+
+#define FRAGMENT_HEADER_LENGTH (3 * sizeof(uint16_t))
+
+#define TMF_HEADER_MAGIC          0xA0       /* high nibble of the first header byte */
+#define TMF_HEADER_VERSION        2          /* low nibble of the first header byte */
+#define TMF_HEADER_TYPE_MASK      0x03       /* TMFMessageType bits of the second header byte */
+#define TMF_HEADER_RESERVED_MASK  0xE0       /* unused flag bits, must be 0 */
+#define TMF_VARINT_MAX_LENGTH     10         /* bytes of a 64 bit varint */
+#define TMF_HEADER_MAX_LENGTH     (2 + TMF_VARINT_MAX_LENGTH)
+#define TMF_LEGACY_HEADER_LENGTH  sizeof(uint64_t)
+#define TMF_LEGACY_VERSION        @"1.0"     /* protocol version of peers understanding legacy frames */
+
+#define TMF_MAX_INFLATED_LENGTH   134217728  /* 128MB */
+
+static atomic_uint __fragmentIdentifier;
+
 @interface TMFProtocol() {
     NSObject<TMFProtocolCoder> *_coder;
     NSString *_identifier;
@@ -51,6 +76,7 @@
     self = [super init];
     if (self) {
         _coder = coder;
+        _compressionThreshold = TMF_COMPRESSION_THRESHOLD;
         _identifier = [NSString stringWithFormat:@"%@,%@", self.name, self.version];
     }
     return self;
@@ -65,7 +91,7 @@
 }
 
 - (NSString *)version {
-    return @"1.0";
+    return @"2.0";
 }
 
 - (NSString *)identifier {
@@ -74,76 +100,295 @@
 
 - (void)parseHeader:(NSData *)data completion:(headerParserCompletion_t)completion {
     NSParameterAssert(completion!=nil);
-    if(data != nil && ([data length] == self.requestResponseHeaderLength || [data length] == self.publishSubscribeHeaderLength )) {
-        uint64_t length = 0;
-        [data getBytes:&length range:NSMakeRange(0, sizeof(uint64_t))];
-        completion(length, (length == 0 ? [TMFError errorForCode:TMFMessageParsingErrorCode message:@"Could not parse message header."] : nil));
+    TMFFrameHeader header;
+    NSError *error = nil;
+    if(data != nil && [data length] <= MAX(self.requestResponseHeaderLength, self.publishSubscribeHeaderLength) &&
+       [self parseFrameHeader:&header bytes:[data bytes] length:[data length] error:&error]) {
+        completion(header.bodyLength, nil);
     }
     else {
-        completion(0, [TMFError errorForCode:TMFMessageParsingErrorCode message:@"Could not parse message header."]);
+        completion(0, error ? error : [TMFError errorForCode:TMFMessageParsingErrorCode message:@"Could not parse message header."]);
+    }
+}
+
+- (BOOL)parseFrameHeader:(TMFFrameHeader *)header bytes:(const void *)bytes length:(NSUInteger)length error:(NSError **)error {
+    return [self parseFrameHeader:header bytes:bytes length:length legacy:NO error:error];
+}
+
+- (BOOL)parseFrameHeader:(TMFFrameHeader *)header bytes:(const void *)bytes length:(NSUInteger)length legacy:(BOOL)legacy error:(NSError **)error {
+    NSParameterAssert(header!=NULL);
+    memset(header, 0, sizeof(TMFFrameHeader));
+    const uint8_t *buffer = bytes;
+    uint64_t bodyLength = 0;
+
+    if(legacy) {
+        if(length < TMF_LEGACY_HEADER_LENGTH) {
+            return NO;
+        }
+        memcpy(&bodyLength, bytes, sizeof(uint64_t));
+        header->headerLength = TMF_LEGACY_HEADER_LENGTH;
+        header->legacy = YES;
+    }
+    else {
+        if(length < 2) {
+            return NO;
+        }
+        if(buffer[0] != (TMF_HEADER_MAGIC | TMF_HEADER_VERSION) || (buffer[1] & TMF_HEADER_TYPE_MASK) == 0 || (buffer[1] & TMF_HEADER_RESERVED_MASK) != 0) {
+            if(error) {
+                *error = [TMFError errorForCode:TMFMessageParsingErrorCode message:[NSString stringWithFormat:@"Unsupported message header 0x%02x%02x.", buffer[0], buffer[1]]];
+            }
+            return NO;
+        }
+
+        // varint, 7 bits per byte starting with the lowest
+        NSUInteger offset = 2;
+        unsigned int shift = 0;
+        uint8_t byte = 0;
+        do {
+            if(offset >= length) {
+                return NO;
+            }
+            if(offset - 2 == TMF_VARINT_MAX_LENGTH) {
+                bodyLength = 0; // invalid
+                break;
+            }
+            byte = buffer[offset++];
+            bodyLength |= (uint64_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while(byte & 0x80);
+
+        header->headerLength = offset;
+        header->type = (TMFMessageType)(buffer[1] & TMF_HEADER_TYPE_MASK);
+        header->flags = buffer[1] & ~TMF_HEADER_TYPE_MASK;
+    }
+
+    if(bodyLength == 0) {
+        if(error) {
+            *error = [TMFError errorForCode:TMFMessageParsingErrorCode message:@"Could not parse message header."];
+        }
+        return NO;
     }
+
+    header->bodyLength = bodyLength;
+    return YES;
 }
 
 - (NSData *)requestDataForCommand:(TMFCommand *)command arguments:(TMFArguments *)arguments {
     NSParameterAssert(command != nil);
-    return [self requestDataForRequest:[TMFRequest requestWithCommandName:command.name arguments:[arguments argumentList] identifier:@(arguments.identifier)]];
+    TMFMessageType type = [command isKindOfClass:[TMFPublishSubscribeCommand class]] ? TMFMessageTypePublish : TMFMessageTypeRequest;
+    return [self requestDataForRequest:[TMFRequest requestWithCommandName:command.name arguments:[arguments argumentList] identifier:@(arguments.identifier)] type:type];
+}
+
+- (NSData *)requestDataForCommand:(TMFCommand *)command arguments:(TMFArguments *)arguments options:(TMFFrameOption)options {
+    NSParameterAssert(command != nil);
+    NSUInteger commandIdentifier = [command isKindOfClass:[TMFPublishSubscribeCommand class]] ? ((TMFPublishSubscribeCommand *)command).commandIdentifier : 0;
+    if(!(options & TMFFrameOptionCommandIdentifier) || commandIdentifier == 0) {
+        return [self data:[self requestDataForCommand:command arguments:arguments] withOptions:options];
+    }
+
+    TMFRequest *request = [TMFRequest requestWithCommandName:nil arguments:[arguments argumentList] identifier:@(arguments.identifier)];
+    request.commandIdentifier = commandIdentifier;
+    return [self data:[self requestDataForRequest:request type:TMFMessageTypePublish] withOptions:options];
 }
 
 - (NSData *)requestDataForRequest:(TMFRequest *)request {
-    NSParameterAssert(request != nil);
-    NSData *requestData = [_coder encodeRequest:request];
-    return [self dataPackageForResponseRequestData:requestData];
+    return [self requestDataForRequest:request type:TMFMessageTypeRequest];
 }
 
 - (NSData *)responseDataForResponse:(TMFResponse *)response {
     NSParameterAssert(response != nil);
-    NSData *responseData = [_coder encodeResponse:response];
-    return [self dataPackageForResponseRequestData:responseData];
+    NSMutableArray *attachments = [NSMutableArray new];
+    id result = [self extractAttachments:[TMFSerializableObject encode:response.result] into:attachments];
+    NSData *responseData = [_coder encodeResponse:[TMFResponse responseWithidentifier:response.identifier result:NilIfNSNull(result) error:response.error]];
+    return [self dataPackageForType:TMFMessageTypeResponse data:responseData attachments:attachments];
+}
+
+- (NSData *)compressedData:(NSData *)data {
+    NSParameterAssert(data != nil);
+    TMFFrameHeader header;
+    if(![self parseFrameHeader:&header bytes:[data bytes] length:[data length] error:nil] ||
+       header.headerLength + header.bodyLength != [data length] || (header.flags & (TMFFrameFlagCompressed | TMFFrameFlagFragment))) {
+        return data;
+    }
+
+    const uint8_t *bytes = (const uint8_t *)[data bytes] + header.headerLength;
+    NSUInteger length = (NSUInteger)header.bodyLength;
+    if(length < self.compressionThreshold || length > TMF_MAX_INFLATED_LENGTH) {
+        return data;
+    }
+
+    if(length >= 4 * TMF_COMPRESSION_PROBE) {
+        uint8_t probe[TMF_COMPRESSION_PROBE + 64];
+        uLongf probeLength = sizeof(probe);
+        if(compress2(probe, &probeLength, bytes + length / 2, TMF_COMPRESSION_PROBE, Z_BEST_SPEED) != Z_OK ||
+           probeLength > TMF_COMPRESSION_PROBE - TMF_COMPRESSION_PROBE / TMF_COMPRESSION_MIN_SAVING) {
+            return data;
+        }
+    }
+
+    uLongf compressedLength = compressBound(length);
+    NSMutableData *compressed = [[NSMutableData alloc] initWithLength:compressedLength];
+    if(compress2([compressed mutableBytes], &compressedLength, bytes, length, Z_BEST_SPEED) != Z_OK || compressedLength > length - length / TMF_COMPRESSION_MIN_SAVING) {
+        return data;
+    }
+
+    // body: compressed body, inflated length (little-endian)
+    uint64_t inflatedLength = OSSwapHostToLittleInt64(length);
+    uint64_t bodyLength = compressedLength + sizeof(uint64_t);
+    NSMutableData *result = [[NSMutableData alloc] initWithCapacity:TMF_HEADER_MAX_LENGTH + (NSUInteger)bodyLength];
+    [self appendHeaderToData:result length:bodyLength type:header.type flags:(header.flags | TMFFrameFlagCompressed) legacy:NO];
+    [result appendBytes:[compressed bytes] length:compressedLength];
+    [result appendBytes:&inflatedLength length:sizeof(uint64_t)];
+    return result;
+}
+
+- (TMFFrameOption)frameOptionsForPeer:(TMFPeer *)peer {
+    NSParameterAssert(peer != nil);
+    TMFFrameOption options = 0;
+    if(peer.supportsCompression) {
+        options |= TMFFrameOptionCompress;
+    }
+    if(peer.protocolMajorVersion < TMF_HEADER_VERSION) {
+        options |= TMFFrameOptionLegacyHeader;
+    }
+    else {
+        options |= TMFFrameOptionCommandIdentifier;
+    }
+    return options;
+}
+
+- (NSData *)data:(NSData *)data withOptions:(TMFFrameOption)options {
+    NSParameterAssert(data != nil);
+    if(options & TMFFrameOptionLegacyHeader) {
+        return [self legacyData:data]; // 1.0 peers know neither compression nor attachments
+    }
+    if(options & TMFFrameOptionCompress) {
+        data = [self compressedData:data];
+    }
+    return data;
 }
 
 - (TMFRequest *)requestFromData:(NSData *)data {
+    return [self requestFromData:data flags:0];
+}
+
+- (TMFRequest *)requestFromData:(NSData *)data flags:(uint8_t)flags {
     NSParameterAssert(data != nil);
-    return [_coder decodeRequest:data];
+    NSArray *attachments = nil;
+    NSData *message = [self messageOfBody:data flags:flags attachments:&attachments];
+    if(!message) {
+        return nil;
+    }
+
+    TMFRequest *request = [_coder decodeRequest:message];
+    request.compressed = (flags & TMFFrameFlagCompressed) != 0;
+    if([attachments count] > 0) {
+        request.arguments = [self insertAttachments:attachments into:request.arguments];
+    }
+    return request;
 }
 
 - (TMFResponse *)responseFromData:(NSData *)data {
+    return [self responseFromData:data flags:0];
+}
+
+- (TMFResponse *)responseFromData:(NSData *)data flags:(uint8_t)flags {
     NSParameterAssert(data != nil);
-    return [_coder decodeResponse:data];
+    NSArray *attachments = nil;
+    NSData *message = [self messageOfBody:data flags:flags attachments:&attachments];
+    if(!message) {
+        return nil;
+    }
+
+    TMFResponse *response = [_coder decodeResponse:message];
+    id result = response.result;
+    if([attachments count] > 0) {
+        result = [self insertAttachments:attachments into:result];
+    }
+    response.result = NilIfNSNull([TMFSerializableObject decode:result]);
+    return response;
 }
 
 - (NSArray *)broadcastPackagesForRequest:(TMFRequest *)request maxSize:(NSUInteger)maxSize {
     NSParameterAssert(request != nil);
-    NSParameterAssert(maxSize > 0);
-    NSData *data = [_coder encodeRequest:request];
-
-    NSUInteger read = 0, next = 0;
-    NSUInteger maxBodySize = maxSize - [self publishSubscribeHeaderLength];
-    NSMutableArray *result = [NSMutableArray new];
-
-    NSUInteger packages = ceil([data length] / maxSize);
-    NSUInteger identifier = ((rand() + 13) * 42) % UINT16_MAX;
-    
-    while(read < data.length) {
-        NSRange range = NSMakeRange(read, maxBodySize);
-        next += range.length;
-        // overflow
-        if(next >= data.length) {
-            range = NSMakeRange(range.location, (data.length - read));
-        }
+    return [self broadcastPackagesForRequestData:[self requestDataForRequest:request] maxSize:maxSize];
+}
+
+- (NSArray *)broadcastPackagesForRequestData:(NSData *)requestData maxSize:(NSUInteger)maxSize {
+    return [self broadcastPackagesForRequestData:requestData maxSize:maxSize legacy:NO];
+}
 
-        NSMutableData *datagram = [self headerForData:[data subdataWithRange:range]];
+- (NSArray *)broadcastPackagesForRequestData:(NSData *)requestData maxSize:(NSUInteger)maxSize legacy:(BOOL)legacy {
+    NSParameterAssert(requestData != nil);
+    NSParameterAssert(maxSize > [self publishSubscribeHeaderLength] + FRAGMENT_HEADER_LENGTH);
+    if([requestData length] <= maxSize) {
+        return @[ requestData ];
+    }
+
+    // fragments keep the format, type and flags of the request
+    TMFFrameHeader header;
+    if(![self parseFrameHeader:&header bytes:[requestData bytes] length:[requestData length] legacy:legacy error:nil]) {
+        return nil;
+    }
+    NSUInteger headerLength = header.headerLength;
+    NSData *data = [requestData subdataWithRange:NSMakeRange(headerLength, [requestData length] - headerLength)];
+
+    NSUInteger maxBodySize = maxSize - [self publishSubscribeHeaderLength] - FRAGMENT_HEADER_LENGTH;
+    NSUInteger packages = ([data length] + maxBodySize - 1) / maxBodySize;
+    if(packages > UINT16_MAX) {
+        return nil;
+    }
+
+    NSUInteger identifier = (NSUInteger)(atomic_fetch_add(&__fragmentIdentifier, 1) + 1) % UINT16_MAX;
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:packages];
+
+    NSUInteger read = 0;
+    while(read < [data length]) {
+        NSRange range = NSMakeRange(read, MIN(maxBodySize, [data length] - read));
+        NSData *fragment = [data subdataWithRange:range];
+
+        NSMutableData *datagram = [[NSMutableData alloc] initWithCapacity:maxSize];
+        [self appendHeaderToData:datagram length:[fragment length] type:header.type flags:(header.flags | TMFFrameFlagFragment) legacy:header.legacy];
         [self appendBroadcastPackageHeader:datagram index:[result count] numberOfPackage:packages identifier:identifier];
-        [datagram appendData:[data subdataWithRange:range]];
+        [datagram appendData:fragment];
         [result addObject:datagram];
 
         read = read + range.length;
-    }    
+    }
 
     return [NSArray arrayWithArray:result]; // immutable
 }
 
+- (NSData *)bodyOfBroadcastPackage:(NSData *)package legacy:(BOOL)legacy fragmentHeader:(TMFFragmentHeader *)fragmentHeader {
+    NSParameterAssert(package != nil);
+    NSParameterAssert(fragmentHeader != NULL);
+
+    TMFFrameHeader header;
+    if(![self parseFrameHeader:&header bytes:[package bytes] length:[package length] legacy:legacy error:nil]) {
+        return nil;
+    }
+    return [self bodyOfBroadcastPackage:package header:header fragmentHeader:fragmentHeader];
+}
+
++ (BOOL)isIdentifier:(NSString *)identifier compatibleWithIdentifier:(NSString *)otherIdentifier {
+    NSArray *components = [identifier componentsSeparatedByString:@","];
+    NSArray *otherComponents = [otherIdentifier componentsSeparatedByString:@","];
+    if([components count] != 2 || [otherComponents count] != 2) {
+        return [identifier isEqualToString:otherIdentifier];
+    }
+
+    // legacy frames are what 1.0 peers send, other 1.x versions had different message bodies
+    NSString *version = [components lastObject];
+    NSString *otherVersion = [otherComponents lastObject];
+    NSInteger major = [version integerValue];
+    NSInteger otherMajor = [otherVersion integerValue];
+    BOOL legacy = (major == TMF_HEADER_VERSION && [otherVersion isEqualToString:TMF_LEGACY_VERSION]) ||
+                  (otherMajor == TMF_HEADER_VERSION && [version isEqualToString:TMF_LEGACY_VERSION]);
+    return [[components objectAtIndex:0] isEqualToString:[otherComponents objectAtIndex:0]] && (major == otherMajor || legacy);
+}
+
 - (NSUInteger)requestResponseHeaderLength {
-    return sizeof(uint64_t);
+    return TMF_HEADER_MAX_LENGTH;
 }
 
 - (NSUInteger)publishSubscribeHeaderLength {
@@ -167,27 +412,288 @@
 #pragma mark -
 #pragma mark Private
 //............................................................................
-- (NSMutableData *)headerForData:(NSData *)request {
-    uint64_t length = [request length];
-    NSMutableData *data = [[NSMutableData alloc] initWithBytes:&length length:sizeof(uint64_t)];
-    return data;
+- (void)appendHeaderToData:(NSMutableData *)data length:(uint64_t)length type:(TMFMessageType)type flags:(uint8_t)flags legacy:(BOOL)legacy {
+    if(legacy) {
+        [data appendBytes:&length length:sizeof(uint64_t)];
+        return;
+    }
+
+    uint8_t header[TMF_HEADER_MAX_LENGTH];
+    NSUInteger count = 0;
+    header[count++] = TMF_HEADER_MAGIC | TMF_HEADER_VERSION;
+    header[count++] = (type & TMF_HEADER_TYPE_MASK) | (flags & ~(TMF_HEADER_TYPE_MASK | TMF_HEADER_RESERVED_MASK));
+    do {
+        uint8_t byte = length & 0x7F;
+        length >>= 7;
+        header[count++] = byte | (length ? 0x80 : 0);
+    } while(length);
+    [data appendBytes:header length:count];
 }
 
 - (void)appendBroadcastPackageHeader:(NSMutableData *)data index:(NSUInteger)index numberOfPackage:(NSUInteger)numberOfPackages identifier:(NSUInteger)identifier {
-    uint16_t identitiy = identifier;
+    uint16_t identitiy = OSSwapHostToLittleInt16(identifier);
     [data appendBytes:&identitiy length:sizeof(uint16_t)];
 
-    uint16_t idx = index;
+    uint16_t idx = OSSwapHostToLittleInt16(index);
     [data appendBytes:&idx length:sizeof(uint16_t)];
 
-    uint16_t packages = numberOfPackages;
+    uint16_t packages = OSSwapHostToLittleInt16(numberOfPackages);
     [data appendBytes:&packages length:sizeof(uint16_t)];
 }
 
-- (NSData *)dataPackageForResponseRequestData:(NSData *)data {
-    NSMutableData *result = [self headerForData:data];
+- (NSData *)bodyOfBroadcastPackage:(NSData *)package header:(TMFFrameHeader)header fragmentHeader:(TMFFragmentHeader *)fragmentHeader {
+    memset(fragmentHeader, 0, sizeof(TMFFragmentHeader));
+
+    // legacy packages tell by their length if there is a fragment header between message header and body
+    uint64_t remaining = [package length] - header.headerLength;
+    BOOL fragment = header.legacy ? (remaining == header.bodyLength + FRAGMENT_HEADER_LENGTH) : (header.flags & TMFFrameFlagFragment) != 0;
+    if(!fragment && remaining == header.bodyLength) {
+        fragmentHeader->flags = header.flags;
+        return [TMFDataSlice sliceOfData:package range:NSMakeRange(header.headerLength, (NSUInteger)header.bodyLength)];
+    }
+    else if(fragment && remaining == header.bodyLength + FRAGMENT_HEADER_LENGTH) {
+        uint16_t values[3];
+        [package getBytes:values range:NSMakeRange(header.headerLength, FRAGMENT_HEADER_LENGTH)];
+        for(NSUInteger i = 0; i < 3; i++) {
+            values[i] = OSSwapLittleToHostInt16(values[i]);
+        }
+        if(values[2] == 0 || values[1] >= values[2]) {
+            return nil;
+        }
+        fragmentHeader->flags = header.flags & ~TMFFrameFlagFragment;
+        fragmentHeader->identifier = values[0];
+        fragmentHeader->index = values[1];
+        fragmentHeader->count = values[2];
+        return [TMFDataSlice sliceOfData:package range:NSMakeRange(header.headerLength + FRAGMENT_HEADER_LENGTH, (NSUInteger)header.bodyLength)];
+    }
+
+    return nil;
+}
+
+- (NSData *)requestDataForRequest:(TMFRequest *)request type:(TMFMessageType)type {
+    NSParameterAssert(request != nil);
+    NSMutableArray *attachments = [NSMutableArray new];
+    NSArray *arguments = [self extractAttachments:request.arguments into:attachments];
+    if([attachments count] > 0) {
+        NSUInteger commandIdentifier = request.commandIdentifier;
+        request = [TMFRequest requestWithCommandName:request.commandName arguments:arguments identifier:request.identifier];
+        request.commandIdentifier = commandIdentifier;
+    }
+    NSData *requestData = [_coder encodeRequest:request];
+    return [self dataPackageForType:type data:requestData attachments:attachments];
+}
+
+- (NSData *)dataPackageForType:(TMFMessageType)type data:(NSData *)data attachments:(NSArray *)attachments {
+    // body: message, with TMFFrameFlagAttachments followed by attachments, attachment lengths, number of attachments (little-endian)
+    uint32_t count = (uint32_t)[attachments count];
+    uint64_t length = [data length];
+    if(count > 0) {
+        length += count * sizeof(uint64_t) + sizeof(uint32_t);
+        for(NSData *attachment in attachments) {
+            length += [attachment length];
+        }
+    }
+
+    NSMutableData *result = [[NSMutableData alloc] initWithCapacity:TMF_HEADER_MAX_LENGTH + (NSUInteger)length];
+    [self appendHeaderToData:result length:length type:type flags:(count > 0 ? TMFFrameFlagAttachments : 0) legacy:NO];
     [result appendData:data];
-    return [NSData dataWithData:result]; // immutable
+    if(count > 0) {
+        for(NSData *attachment in attachments) {
+            [result appendData:attachment];
+        }
+        for(NSData *attachment in attachments) {
+            uint64_t attachmentLength = OSSwapHostToLittleInt64([attachment length]);
+            [result appendBytes:&attachmentLength length:sizeof(uint64_t)];
+        }
+        count = OSSwapHostToLittleInt32(count);
+        [result appendBytes:&count length:sizeof(uint32_t)];
+    }
+    return result;
+}
+
+- (NSData *)legacyData:(NSData *)data {
+    TMFFrameHeader header;
+    if(![self parseFrameHeader:&header bytes:[data bytes] length:[data length] legacy:NO error:nil] ||
+       header.headerLength + header.bodyLength != [data length] || (header.flags & TMFFrameFlagFragment)) {
+        return data; // already legacy
+    }
+
+    NSData *body = [NSData dataWithBytesNoCopy:(uint8_t *)[data bytes] + header.headerLength length:(NSUInteger)header.bodyLength freeWhenDone:NO];
+    body = [self legacyBodyOfBody:body header:header];
+    if(!body) {
+        TMFLogError(@"Could not convert message of %@ bytes for a 1.0 peer.", @([data length]));
+        return data;
+    }
+
+    NSMutableData *result = [[NSMutableData alloc] initWithCapacity:TMF_LEGACY_HEADER_LENGTH + [body length]];
+    [self appendHeaderToData:result length:[body length] type:header.type flags:0 legacy:YES];
+    [result appendData:body];
+    return result;
+}
+
+- (NSData *)legacyBodyOfBody:(NSData *)body header:(TMFFrameHeader)header {
+    NSArray *attachments = nil;
+    NSData *message = [self messageOfBody:body flags:header.flags attachments:&attachments];
+    if(!message || !(header.flags & TMFFrameFlagAttachments)) {
+        return message;
+    }
+
+    // 1.0 peers expect binary data as Base64 strings within the message
+    NSMutableArray *encoded = [[NSMutableArray alloc] initWithCapacity:[attachments count]];
+    for(NSData *attachment in attachments) {
+        [encoded addObject:[TMFSerializableObject encodeBinaryData:attachment]];
+    }
+
+    if(header.type == TMFMessageTypeResponse) {
+        TMFResponse *response = [_coder decodeResponse:message];
+        response.result = [self insertAttachments:encoded into:response.result];
+        return response ? [_coder encodeResponse:response] : nil;
+    }
+    TMFRequest *request = [_coder decodeRequest:message];
+    request.arguments = [self insertAttachments:encoded into:request.arguments];
+    return request ? [_coder encodeRequest:request] : nil;
+}
+
+- (NSData *)inflatedBody:(NSData *)body {
+    NSUInteger length = [body length];
+    const uint8_t *bytes = [body bytes];
+    uint64_t inflatedLength = 0;
+    if(length < sizeof(uint64_t)) {
+        return nil;
+    }
+    length -= sizeof(uint64_t);
+    memcpy(&inflatedLength, bytes + length, sizeof(uint64_t));
+    inflatedLength = OSSwapLittleToHostInt64(inflatedLength);
+    if(inflatedLength > TMF_MAX_INFLATED_LENGTH) {
+        return nil;
+    }
+
+    NSMutableData *result = [[NSMutableData alloc] initWithLength:(NSUInteger)inflatedLength];
+    uLongf resultLength = (uLongf)inflatedLength;
+    if(uncompress([result mutableBytes], &resultLength, bytes, length) != Z_OK || resultLength != inflatedLength) {
+        return nil;
+    }
+    return result;
+}
+
+- (NSData *)messageOfBody:(NSData *)body flags:(uint8_t)flags attachments:(NSArray **)attachments {
+    BOOL compressed = (flags & TMFFrameFlagCompressed) != 0;
+    if(compressed) {
+        body = [self inflatedBody:body];
+        if(!body) {
+            return nil;
+        }
+    }
+
+    *attachments = nil;
+    if(!(flags & TMFFrameFlagAttachments)) {
+        return body;
+    }
+
+    NSUInteger length = [body length];
+    const uint8_t *bytes = [body bytes];
+    if(length < sizeof(uint32_t)) {
+        return nil;
+    }
+
+    uint32_t count = 0;
+    memcpy(&count, bytes + length - sizeof(uint32_t), sizeof(uint32_t));
+    count = OSSwapLittleToHostInt32(count);
+    length -= sizeof(uint32_t);
+    if(count > length / sizeof(uint64_t)) {
+        return nil;
+    }
+
+    NSUInteger table = length - count * sizeof(uint64_t);
+    NSUInteger end = table;
+    NSMutableArray *result = [[NSMutableArray alloc] initWithCapacity:count];
+    for(uint32_t i = 0; i < count; i++) {
+        uint64_t attachmentLength = 0;
+        memcpy(&attachmentLength, bytes + table + (count - 1 - i) * sizeof(uint64_t), sizeof(uint64_t));
+        attachmentLength = OSSwapLittleToHostInt64(attachmentLength);
+        if(attachmentLength > end) {
+            return nil;
+        }
+        end -= (NSUInteger)attachmentLength;
+        // attachments reference the received data, no copies
+        [result insertObject:[TMFDataSlice sliceOfData:body range:NSMakeRange(end, (NSUInteger)attachmentLength)] atIndex:0];
+    }
+
+    *attachments = result;
+    // the message is only decoded during the call, an inflated body has to outlive this method though
+    return compressed ? [TMFDataSlice sliceOfData:body range:NSMakeRange(0, end)] : [NSData dataWithBytesNoCopy:(void *)bytes length:end freeWhenDone:NO];
+}
+
+- (id)extractAttachments:(id)value into:(NSMutableArray *)attachments {
+    if([value isKindOfClass:[NSData class]]) {
+        [attachments addObject:value];
+        return [TMFAttachmentReference referenceWithIndex:[attachments count] - 1];
+    }
+    else if([value isKindOfClass:[NSArray class]]) {
+        NSMutableArray *array = nil;
+        NSUInteger i = 0;
+        for(id element in value) {
+            id extracted = [self extractAttachments:element into:attachments];
+            if(extracted != element && !array) {
+                array = [value mutableCopy];
+            }
+            if(array) {
+                [array replaceObjectAtIndex:i withObject:extracted];
+            }
+            i++;
+        }
+        return array ? array : value;
+    }
+    else if([value isKindOfClass:[NSDictionary class]]) {
+        __block NSMutableDictionary *dictionary = nil;
+        [value enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+            id extracted = [self extractAttachments:obj into:attachments];
+            if(extracted != obj) {
+                if(!dictionary) {
+                    dictionary = [value mutableCopy];
+                }
+                [dictionary setObject:extracted forKey:key];
+            }
+        }];
+        return dictionary ? dictionary : value;
+    }
+    return value;
+}
+
+- (id)insertAttachments:(NSArray *)attachments into:(id)value {
+    if([value isKindOfClass:[TMFAttachmentReference class]]) {
+        NSUInteger index = [value index];
+        return index < [attachments count] ? [attachments objectAtIndex:index] : [NSNull null];
+    }
+    else if([value isKindOfClass:[NSArray class]]) {
+        NSMutableArray *array = nil;
+        NSUInteger i = 0;
+        for(id element in value) {
+            id inserted = [self insertAttachments:attachments into:element];
+            if(inserted != element && !array) {
+                array = [value mutableCopy];
+            }
+            if(array) {
+                [array replaceObjectAtIndex:i withObject:inserted];
+            }
+            i++;
+        }
+        return array ? array : value;
+    }
+    else if([value isKindOfClass:[NSDictionary class]]) {
+        __block NSMutableDictionary *dictionary = nil;
+        [value enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+            id inserted = [self insertAttachments:attachments into:obj];
+            if(inserted != obj) {
+                if(!dictionary) {
+                    dictionary = [value mutableCopy];
+                }
+                [dictionary setObject:inserted forKey:key];
+            }
+        }];
+        return dictionary ? dictionary : value;
+    }
+    return value;
 }
 
 @end
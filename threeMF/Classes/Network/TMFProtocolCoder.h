@@ -29,11 +29,14 @@
 
 #import "TMFResponse.h"
 #import "TMFRequest.h"
+#import "TMFAttachmentReference.h"
 
 /**
  This protocol defines the contract for any encoder / decoder used within threeMF.
  Each coder must conform to this protocol and each peer communicating
  has to use the same encoding / decoding strategy in order to understand each other.
+ Request arguments and response results may contain TMFAttachmentReference objects, decoding has to restore them
+ and must never turn any other value into a reference.
 */
 @protocol TMFProtocolCoder <NSObject>
 
@@ -52,6 +55,7 @@
 
 /**
  Encodes requests to an appropriate data package
+ Requests of interned publish subscribe commands carry a commandIdentifier instead of a commandName.
  @param request request to encode, must not be nil
  @return data representation of the given request
  */
@@ -59,6 +63,7 @@
 
 /**
  Encodes responses to an appropriate data package
+ The result is already serialized by TMFProtocol.
  @param response response to encode, must not be nil
  @return data representation of the given response
  */
@@ -66,6 +71,7 @@
 
 /**
  Decodes requests from an appropriate data package
+ Sets either commandName or commandIdentifier, depending on what got encoded.
  @param data data representation of a TMFRequest, must not be nil
  @return the request instance of the given data package, should return nil if the data package did not match
  */
@@ -73,6 +79,7 @@
 
 /**
  Decodes responses from an appropriate data package
+ The result is returned as decoded, TMFProtocol takes care of deserializing it.
  @param data data representation of a TMFResponse, must not be nil
  @return the response instance of the given data package, should return nil if the data package did not match
  */
@@ -37,6 +37,12 @@
  */
 @property (nonatomic, copy) NSString *commandName;
 
+/**
+ Interned identifier of the TMFPublishSubscribeCommand this request corresponds to, 0 if the request carries a commandName.
+ Assigned by the publisher on subscription, see [TMFPublishSubscribeCommand commandIdentifier].
+ */
+@property (nonatomic) NSUInteger commandIdentifier;
+
 /**
  Arguments for the request.
  */
@@ -48,6 +54,11 @@
  */
 @property (nonatomic, copy) id identifier;
 
+/**
+ YES if the request was received compressed, its sender accepts compressed responses.
+ */
+@property (nonatomic) BOOL compressed;
+
 /**
  Creates a new request.
  @param commandName name of the TMFCommand in this request
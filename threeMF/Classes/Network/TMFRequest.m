@@ -49,7 +49,7 @@
 #pragma mark Override
 //............................................................................
 - (NSString *)description {
-    return [NSString stringWithFormat:@"%@, %@, %@", _commandName, _arguments, _identifier];
+    return [NSString stringWithFormat:@"%@, %@, %@", (_commandName ? _commandName : @(_commandIdentifier)), _arguments, _identifier];
 }
 
 //............................................................................
@@ -27,7 +27,6 @@
 
 #import <Foundation/Foundation.h>
 #import "TMFChannelDelegate.h"
-#import "GCDAsyncSocket.h"
 
 /**
  Object storing responseBlock_t corresponding to a tuple of one TMFPeer and an identifier.
@@ -45,22 +44,27 @@
 @property (nonatomic, readonly) TMFPeer *peer;
 
 /**
- Socket the response belongs to
+ Connection the response belongs to, a GCDAsyncSocket or the connection object of the channel.
  */
-@property (nonatomic, readonly) GCDAsyncSocket *socket;
+@property (nonatomic, readonly) id connection;
 
 /**
  Identifier of the request
  */
 @property (nonatomic) NSUInteger identifier;
 
+/**
+ Time in seconds the request waits for its response, 0 uses the default timeout of the channel.
+ */
+@property (nonatomic) NSTimeInterval timeout;
+
 /**
  Createst a new instance
  @param identifier The identifier of the request.
  @param peer The request's destination peer.
- @param socket The request's source socket.
+ @param connection The connection the request was sent with.
  @param block Response callback block for the request send with id identifier
  */
-- (id)initWithIdentifier:(NSUInteger)identifier peer:(TMFPeer *)peer socket:(GCDAsyncSocket *)socket block:(responseBlock_t)block;
+- (id)initWithIdentifier:(NSUInteger)identifier peer:(TMFPeer *)peer connection:(id)connection block:(responseBlock_t)block;
 
 @end
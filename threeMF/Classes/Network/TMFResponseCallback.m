@@ -31,13 +31,13 @@
 #pragma mark -
 #pragma mark Memory Management
 //............................................................................
-- (id)initWithIdentifier:(NSUInteger)identifier peer:(TMFPeer *)peer socket:(GCDAsyncSocket *)socket block:(responseBlock_t)block {
+- (id)initWithIdentifier:(NSUInteger)identifier peer:(TMFPeer *)peer connection:(id)connection block:(responseBlock_t)block {
     self = [super init];
     if (self) {
         _identifier = identifier;
         _peer = peer;
         _responseBlock = [block copy];
-        _socket = socket;
+        _connection = connection;
     }
     return self;
 }
@@ -0,0 +1,102 @@
+//
+//  TMFResponseCallbackTable.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "TMFResponseCallback.h"
+
+@class TMFPeer;
+
+/**
+ Block called with all callbacks whose response did not arrive in time.
+ The callbacks are already removed from the table.
+ */
+typedef void (^responseCallbacksExpiredBlock_t)(NSArray *callbacks);
+
+/**
+ Thread safe registry of outstanding TMFResponseCallback objects.
+
+ Callbacks are indexed by request identifier, by connection and by peer, so completing a response
+ and failing all requests of a connection or peer do not need to scan all outstanding requests.
+ Expired callbacks get swept by a TMFTimerWheel.
+ */
+@interface TMFResponseCallbackTable : NSObject
+
+/**
+ Initializes a new instance.
+ @param timeout Default time in seconds a callback waits for its response before it expires.
+ @param queue The queue the expiration sweep runs on. Must not be NULL.
+ @param expiration Block called with expired callbacks on queue.
+ */
+- (id)initWithTimeout:(NSTimeInterval)timeout queue:(dispatch_queue_t)queue expiration:(responseCallbacksExpiredBlock_t)expiration;
+
+/**
+ Adds a callback. A callback with the same identifier gets replaced.
+ The callback expires after its own timeout or the table's timeout if it has none.
+ @param callback The callback to add. Must not be nil.
+ */
+- (void)addCallback:(TMFResponseCallback *)callback;
+
+/**
+ Removes the callback for a request.
+ @param identifier The request identifier.
+ @return the removed callback or nil
+ */
+- (TMFResponseCallback *)removeCallbackForIdentifier:(NSUInteger)identifier;
+
+/**
+ Removes all callbacks of requests sent with a connection.
+ @param connection The connection the requests were sent with.
+ @return the removed callbacks
+ */
+- (NSArray *)removeCallbacksForConnection:(id)connection;
+
+/**
+ Removes all callbacks of requests sent to a peer.
+ @param peer The destination peer.
+ @return the removed callbacks
+ */
+- (NSArray *)removeCallbacksForPeer:(TMFPeer *)peer;
+
+/**
+ Removes all callbacks.
+ @return the removed callbacks
+ */
+- (NSArray *)removeAllCallbacks;
+
+/**
+ Checks if there are outstanding responses for a connection.
+ @param connection The connection the requests were sent with.
+ @return YES if at least one callback is registered for the connection
+ */
+- (BOOL)hasCallbacksForConnection:(id)connection;
+
+/**
+ Number of outstanding callbacks.
+ */
+- (NSUInteger)count;
+
+@end
@@ -0,0 +1,233 @@
+//
+//  TMFResponseCallbackTable.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFResponseCallbackTable.h"
+#import "TMFTimerWheel.h"
+#import "TMFPeer.h"
+#import "TMFDefine.h"
+
+#define TMF_CALLBACK_TICK   0.05 /* resolution of response timeouts in seconds */
+#define TMF_CALLBACK_SLOTS  64   /* number of slots per timer wheel level */
+#define TMF_CALLBACK_LEVELS 4    /* 3.2s, 3.4min, 3.6h and 9.7 days */
+
+@interface TMFResponseCallbackTable() {
+    NSMutableDictionary *_callbacksByIdentifier;
+    NSMutableDictionary *_callbacksByConnection;
+    NSMutableDictionary *_callbacksByPeer;
+    TMFTimerWheel *_timerWheel;
+    NSLock *_lock;
+
+    NSTimeInterval _timeout;
+    responseCallbacksExpiredBlock_t _expiration;
+    dispatch_queue_t _queue;
+    dispatch_source_t _timer;
+    BOOL _timerRunning;
+}
+@end
+
+@implementation TMFResponseCallbackTable
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithTimeout:(NSTimeInterval)timeout queue:(dispatch_queue_t)queue expiration:(responseCallbacksExpiredBlock_t)expiration {
+    NSParameterAssert(queue!=NULL);
+
+    self = [super init];
+    if(self) {
+        _callbacksByIdentifier = [NSMutableDictionary new];
+        _callbacksByConnection = [NSMutableDictionary new];
+        _callbacksByPeer = [NSMutableDictionary new];
+        _timerWheel = [[TMFTimerWheel alloc] initWithTickInterval:TMF_CALLBACK_TICK slots:TMF_CALLBACK_SLOTS levels:TMF_CALLBACK_LEVELS];
+        _lock = [NSLock new];
+
+        _timeout = timeout;
+        _expiration = [expiration copy];
+        _queue = queue;
+#if ARC_HANDLES_QUEUES
+        dispatch_retain(_queue);
+#endif
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+        dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(TMF_CALLBACK_TICK * NSEC_PER_SEC)), (uint64_t)(TMF_CALLBACK_TICK * NSEC_PER_SEC), (uint64_t)(TMF_CALLBACK_TICK * NSEC_PER_SEC / 10));
+
+        __weak TMFResponseCallbackTable *weakSelf = self;
+        dispatch_source_set_event_handler(_timer, ^{
+            [weakSelf sweep];
+        });
+    }
+    return self;
+}
+
+- (void)dealloc {
+    dispatch_source_cancel(_timer);
+    if(!_timerRunning) {
+        // a suspended source must be resumed before it gets released
+        dispatch_resume(_timer);
+    }
+#if ARC_HANDLES_QUEUES
+    dispatch_release(_timer);
+    dispatch_release(_queue);
+#endif
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
+- (void)addCallback:(TMFResponseCallback *)callback {
+    NSParameterAssert(callback!=nil);
+    NSNumber *identifier = @(callback.identifier);
+
+    [_lock lock];
+    [self removeCallbackWithKey:identifier];
+    [_callbacksByIdentifier setObject:callback forKey:identifier];
+    [[self indexForKey:[self connectionKey:callback.connection] inDictionary:_callbacksByConnection create:YES] setObject:callback forKey:identifier];
+    [[self indexForKey:callback.peer.UUID inDictionary:_callbacksByPeer create:YES] setObject:callback forKey:identifier];
+    [_timerWheel scheduleKey:identifier timeout:(callback.timeout > 0 ? callback.timeout : _timeout)];
+    if(!_timerRunning) {
+        _timerRunning = YES;
+        dispatch_resume(_timer);
+    }
+    [_lock unlock];
+}
+
+- (TMFResponseCallback *)removeCallbackForIdentifier:(NSUInteger)identifier {
+    [_lock lock];
+    TMFResponseCallback *callback = [self removeCallbackWithKey:@(identifier)];
+    [_lock unlock];
+    return callback;
+}
+
+- (NSArray *)removeCallbacksForConnection:(id)connection {
+    [_lock lock];
+    NSArray *callbacks = [self removeCallbacksInIndex:[self indexForKey:[self connectionKey:connection] inDictionary:_callbacksByConnection create:NO]];
+    [_lock unlock];
+    return callbacks;
+}
+
+- (NSArray *)removeCallbacksForPeer:(TMFPeer *)peer {
+    [_lock lock];
+    NSArray *callbacks = [self removeCallbacksInIndex:[self indexForKey:peer.UUID inDictionary:_callbacksByPeer create:NO]];
+    [_lock unlock];
+    return callbacks;
+}
+
+- (NSArray *)removeAllCallbacks {
+    [_lock lock];
+    NSArray *callbacks = [_callbacksByIdentifier allValues];
+    [_callbacksByIdentifier removeAllObjects];
+    [_callbacksByConnection removeAllObjects];
+    [_callbacksByPeer removeAllObjects];
+    [_timerWheel removeAllKeys];
+    [_lock unlock];
+    return callbacks;
+}
+
+- (BOOL)hasCallbacksForConnection:(id)connection {
+    [_lock lock];
+    BOOL found = [[self indexForKey:[self connectionKey:connection] inDictionary:_callbacksByConnection create:NO] count] > 0;
+    [_lock unlock];
+    return found;
+}
+
+- (NSUInteger)count {
+    [_lock lock];
+    NSUInteger count = [_callbacksByIdentifier count];
+    [_lock unlock];
+    return count;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (void)sweep {
+    NSMutableArray *expired = [NSMutableArray new];
+
+    [_lock lock];
+    for(NSNumber *identifier in [_timerWheel advanceToTime:[NSDate timeIntervalSinceReferenceDate]]) {
+        TMFResponseCallback *callback = [self removeCallbackWithKey:identifier];
+        if(callback) {
+            [expired addObject:callback];
+        }
+    }
+
+    // no need to wake up while there is nothing to expire
+    if(_timerRunning && [_callbacksByIdentifier count] == 0) {
+        _timerRunning = NO;
+        dispatch_suspend(_timer);
+    }
+    [_lock unlock];
+
+    if([expired count] > 0 && _expiration) {
+        _expiration(expired);
+    }
+}
+
+- (id)connectionKey:(id)connection {
+    return connection ? [NSValue valueWithNonretainedObject:connection] : nil;
+}
+
+- (NSMutableDictionary *)indexForKey:(id)key inDictionary:(NSMutableDictionary *)dictionary create:(BOOL)create {
+    if(!key) {
+        return nil;
+    }
+
+    NSMutableDictionary *index = [dictionary objectForKey:key];
+    if(!index && create) {
+        index = [NSMutableDictionary new];
+        [dictionary setObject:index forKey:key];
+    }
+    return index;
+}
+
+- (void)removeObjectForKey:(NSNumber *)identifier fromIndexForKey:(id)key inDictionary:(NSMutableDictionary *)dictionary {
+    NSMutableDictionary *index = [self indexForKey:key inDictionary:dictionary create:NO];
+    [index removeObjectForKey:identifier];
+    if(index && [index count] == 0) {
+        [dictionary removeObjectForKey:key];
+    }
+}
+
+- (TMFResponseCallback *)removeCallbackWithKey:(NSNumber *)identifier {
+    TMFResponseCallback *callback = [_callbacksByIdentifier objectForKey:identifier];
+    if(callback) {
+        [_callbacksByIdentifier removeObjectForKey:identifier];
+        [self removeObjectForKey:identifier fromIndexForKey:[self connectionKey:callback.connection] inDictionary:_callbacksByConnection];
+        [self removeObjectForKey:identifier fromIndexForKey:callback.peer.UUID inDictionary:_callbacksByPeer];
+        [_timerWheel cancelKey:identifier];
+    }
+    return callback;
+}
+
+- (NSArray *)removeCallbacksInIndex:(NSDictionary *)index {
+    NSArray *callbacks = [index allValues];
+    for(TMFResponseCallback *callback in callbacks) {
+        [self removeCallbackWithKey:@(callback.identifier)];
+    }
+    return callbacks;
+}
+
+@end
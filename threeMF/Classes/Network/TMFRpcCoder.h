@@ -30,6 +30,9 @@
 
 /**
  Abstract coder translating RPC requests and responses between dictionary and data representations.
+ A TMFAttachmentReference is encoded as string "3mf@<index>". Messages containing references are marked with an
+ "attachments" entry and other strings starting with "3mf@" get an additional "@" after the prefix, so references never
+ collide with strings. Messages without references are encoded like 1.0 peers expect them.
  */
 @interface TMFRpcCoder : NSObject <TMFProtocolCoder>
 
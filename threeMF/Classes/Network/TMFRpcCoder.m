@@ -25,6 +25,11 @@
 
 #import "TMFRpcCoder.h"
 #import "TMFSerializableObject.h"
+#import "TMFAttachmentReference.h"
+
+#define kAttachmentPrefix @"3mf@" /* followed by the index of an attachment reference */
+#define kEscapedPrefix    @"3mf@@" /* strings starting with kAttachmentPrefix get an additional @ */
+#define kAttachmentsKey   @"attachments" /* set in messages containing attachment references */
 
 @implementation TMFRpcCoder
 //............................................................................
@@ -65,9 +70,15 @@
     NSArray *arguments = [dict objectForKey:@"params"];
 
     TMFRequest *request = [TMFRequest new];
-    request.commandName = NilIfNSNull([dict objectForKey:@"method"]);
+    id method = NilIfNSNull([dict objectForKey:@"method"]);
+    if([method isKindOfClass:[NSNumber class]]) {
+        request.commandIdentifier = [method unsignedIntegerValue];
+    }
+    else {
+        request.commandName = method;
+    }
     request.identifier = NilIfNSNull([dict objectForKey:@"id"]);
-    request.arguments = arguments;
+    request.arguments = [self containsReferences:dict] ? [self decodedValue:arguments] : arguments;
 
     return request;
 }
@@ -76,19 +87,28 @@
     NSDictionary *dict = [self decode:data];
     TMFResponse *response = [TMFResponse new];
     response.identifier = NilIfNSNull([dict objectForKey:@"id"]);
-    response.result = NilIfNSNull([TMFSerializableObject decode:[dict objectForKey:@"result"]]);
+    response.result = NilIfNSNull([dict objectForKey:@"result"]);
+    if([self containsReferences:dict]) {
+        response.result = [self decodedValue:response.result];
+    }
     response.error = NilIfNSNull([dict objectForKey:@"error"]);
     return response;
 }
 
 - (NSData *)encodeRequest:(TMFRequest *)request {
-    NSAssert(request.commandName!=nil, @"Command name may not be nil!");
-    NSArray *params = (request.arguments ? request.arguments : @[ ]);
-    return [self encode:@{ @"method" : request.commandName, @"params" : params, @"id" : NSNullIfNil(request.identifier) }];
+    NSAssert(request.commandName!=nil || request.commandIdentifier!=0, @"Command name may not be nil!");
+    BOOL references = NO;
+    NSArray *params = (request.arguments ? [self encodedValue:request.arguments references:&references] : @[ ]);
+    id method = request.commandName ? request.commandName : @(request.commandIdentifier);
+    NSDictionary *message = @{ @"method" : method, @"params" : params, @"id" : NSNullIfNil(request.identifier) };
+    return [self encode:(references ? [self messageMarkedWithReferences:message] : message)];
 }
 
 - (NSData *)encodeResponse:(TMFResponse *)response {
-    return [self encode:@{ @"result" : NSNullIfNil([TMFSerializableObject encode:response.result]), @"error" : NSNullIfNil(response.error), @"id" : NSNullIfNil(response.identifier) }];
+    BOOL references = NO;
+    id result = [self encodedValue:response.result references:&references];
+    NSDictionary *message = @{ @"result" : NSNullIfNil(result), @"error" : NSNullIfNil(response.error), @"id" : NSNullIfNil(response.identifier) };
+    return [self encode:(references ? [self messageMarkedWithReferences:message] : message)];
 }
 
 //............................................................................
@@ -105,6 +125,83 @@
 #pragma mark -
 #pragma mark Private
 //............................................................................
+- (id)encodedValue:(id)value references:(BOOL *)references {
+    // attachment references become strings, strings looking like one get escaped
+    __block BOOL found = NO;
+    id encoded = [self value:value byReplacingLeaves:^id(id leaf) {
+        if([leaf isKindOfClass:[TMFAttachmentReference class]]) {
+            found = YES;
+            return [NSString stringWithFormat:@"%@%@", kAttachmentPrefix, @([leaf index])];
+        }
+        else if([leaf isKindOfClass:[NSString class]] && [leaf hasPrefix:kAttachmentPrefix]) {
+            return [kEscapedPrefix stringByAppendingString:[leaf substringFromIndex:[kAttachmentPrefix length]]];
+        }
+        return leaf;
+    }];
+    *references = found;
+    // without references the message stays as understood by 1.0 peers
+    return found ? encoded : value;
+}
 
+- (NSDictionary *)messageMarkedWithReferences:(NSDictionary *)message {
+    NSMutableDictionary *result = [message mutableCopy];
+    [result setObject:@YES forKey:kAttachmentsKey];
+    return result;
+}
+
+- (BOOL)containsReferences:(NSDictionary *)message {
+    return [[message objectForKey:kAttachmentsKey] isEqual:@YES];
+}
+
+- (id)decodedValue:(id)value {
+    return [self value:value byReplacingLeaves:^id(id leaf) {
+        if(![leaf isKindOfClass:[NSString class]] || ![leaf hasPrefix:kAttachmentPrefix]) {
+            return leaf;
+        }
+        else if([leaf hasPrefix:kEscapedPrefix]) {
+            return [kAttachmentPrefix stringByAppendingString:[leaf substringFromIndex:[kEscapedPrefix length]]];
+        }
+
+        NSString *suffix = [leaf substringFromIndex:[kAttachmentPrefix length]];
+        long long index = [suffix longLongValue];
+        if(index >= 0 && [suffix isEqualToString:[@(index) stringValue]]) {
+            return [TMFAttachmentReference referenceWithIndex:(NSUInteger)index];
+        }
+        return leaf;
+    }];
+}
+
+- (id)value:(id)value byReplacingLeaves:(id(^)(id leaf))block {
+    // containers are only copied if one of their values changes
+    if([value isKindOfClass:[NSArray class]]) {
+        NSMutableArray *array = nil;
+        NSUInteger i = 0;
+        for(id element in value) {
+            id replaced = [self value:element byReplacingLeaves:block];
+            if(replaced != element && !array) {
+                array = [value mutableCopy];
+            }
+            if(array) {
+                [array replaceObjectAtIndex:i withObject:replaced];
+            }
+            i++;
+        }
+        return array ? array : value;
+    }
+    else if([value isKindOfClass:[NSDictionary class]]) {
+        __block NSMutableDictionary *dictionary = nil;
+        [value enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+            id replaced = [self value:obj byReplacingLeaves:block];
+            if(replaced != obj) {
+                if(!dictionary) {
+                    dictionary = [value mutableCopy];
+                }
+                [dictionary setObject:replaced forKey:key];
+            }
+        }];
+        return dictionary ? dictionary : value;
+    }
+    return value ? block(value) : nil;
+}
 
 @end
@@ -0,0 +1,100 @@
+//
+//  TMFSendQueue.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "TMFPublishSubscribeCommand.h"
+
+#define TMF_SEND_QUEUE_MESSAGES 64      /* limit of queued outgoing messages per connection */
+#define TMF_SEND_QUEUE_BYTES    4194304 /* 4MB, limit of queued outgoing bytes per connection */
+
+/**
+ Bounded queue of framed messages waiting to be written to one connection.
+ If the queue is full, new data is handled according to its TMFSendQueuePolicy: queued data of the same stream gets replaced or older droppable data gets evicted, otherwise the data is rejected.
+ Data may be written in parts, the partially written first message is never replaced or dropped.
+ The queue is not thread safe, owners guard it with their lock or queue.
+ */
+@interface TMFSendQueue : NSObject
+
+/**
+ Maximum number of queued messages. Default 64.
+ */
+@property (nonatomic) NSUInteger maximumMessages;
+
+/**
+ Maximum number of queued bytes. Default 4MB.
+ A single larger message is accepted if nothing else is queued.
+ */
+@property (nonatomic) NSUInteger maximumBytes;
+
+/**
+ Number of queued messages, including a partially written one.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ Number of queued bytes not written yet.
+ */
+@property (nonatomic, readonly) NSUInteger length;
+
+/**
+ Bytes of the first message already written.
+ */
+@property (nonatomic, readonly) NSUInteger offset;
+
+/**
+ Queues data according to the policy.
+ @param data The framed message.
+ @param policy Defines what happens if the queue is full.
+ @param key Identifies the stream for TMFSendQueuePolicyKeepLatest and whose data TMFSendQueuePolicyDropOldest drops first, usually the command name. May be nil.
+ @return YES if the data got queued, NO if it was rejected
+ */
+- (BOOL)enqueueData:(NSData *)data policy:(TMFSendQueuePolicy)policy key:(NSString *)key;
+
+/**
+ @param index Index of a queued message, 0 is the first.
+ @return The queued message. Only the bytes after offset of the first message are left to write.
+ */
+- (NSData *)dataAtIndex:(NSUInteger)index;
+
+/**
+ Removes the first message, it must not be partially written.
+ @return The first message or nil if the queue is empty.
+ */
+- (NSData *)dequeueData;
+
+/**
+ Removes written bytes from the front of the queue.
+ @param length Number of bytes written, starting at offset of the first message.
+ */
+- (void)consumeLength:(NSUInteger)length;
+
+/**
+ Drops all queued data.
+ */
+- (void)removeAllData;
+
+@end
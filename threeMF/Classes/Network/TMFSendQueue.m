@@ -0,0 +1,177 @@
+//
+//  TMFSendQueue.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFSendQueue.h"
+
+/**
+ Queued message with the stream it belongs to
+ */
+@interface TMFQueuedData : NSObject
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, readonly) TMFSendQueuePolicy policy;
+@property (nonatomic, readonly, copy) NSString *key;
+- (id)initWithData:(NSData *)data policy:(TMFSendQueuePolicy)policy key:(NSString *)key;
+@end
+
+@implementation TMFQueuedData
+- (id)initWithData:(NSData *)data policy:(TMFSendQueuePolicy)policy key:(NSString *)key {
+    self = [super init];
+    if(self) {
+        _data = data;
+        _policy = policy;
+        _key = [key copy];
+    }
+    return self;
+}
+@end
+
+@interface TMFSendQueue() {
+    NSMutableArray *_queue;
+}
+@end
+
+@implementation TMFSendQueue
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)init {
+    self = [super init];
+    if(self) {
+        _queue = [NSMutableArray new];
+        _maximumMessages = TMF_SEND_QUEUE_MESSAGES;
+        _maximumBytes = TMF_SEND_QUEUE_BYTES;
+    }
+    return self;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
+- (NSUInteger)count {
+    return [_queue count];
+}
+
+- (BOOL)enqueueData:(NSData *)data policy:(TMFSendQueuePolicy)policy key:(NSString *)key {
+    if(policy == TMFSendQueuePolicyKeepLatest && key) {
+        // conflate with a sample of the same stream still waiting
+        NSUInteger index = [self indexOfDroppableDataForKey:key latestOnly:YES];
+        if(index != NSNotFound) {
+            TMFQueuedData *queued = [_queue objectAtIndex:index];
+            _length = _length - [queued.data length] + [data length];
+            queued.data = data;
+            return YES;
+        }
+    }
+
+    // droppable data makes room by evicting older data, the caller never waits for a slow reader
+    while(policy != TMFSendQueuePolicyReject && [self isFullForLength:[data length]] && [self dropOldestDataForKey:key]) {
+    }
+
+    if([self isFullForLength:[data length]]) {
+        return NO;
+    }
+
+    [_queue addObject:[[TMFQueuedData alloc] initWithData:data policy:policy key:key]];
+    _length += [data length];
+    return YES;
+}
+
+- (NSData *)dataAtIndex:(NSUInteger)index {
+    return ((TMFQueuedData *)[_queue objectAtIndex:index]).data;
+}
+
+- (NSData *)dequeueData {
+    NSAssert(_offset == 0, @"The first message is partially written.");
+    if([_queue count] == 0) {
+        return nil;
+    }
+    TMFQueuedData *queued = [_queue objectAtIndex:0];
+    [_queue removeObjectAtIndex:0];
+    _length -= [queued.data length];
+    return queued.data;
+}
+
+- (void)consumeLength:(NSUInteger)length {
+    _length -= length;
+    NSUInteger completed = 0;
+    for(TMFQueuedData *queued in _queue) {
+        NSUInteger left = [queued.data length] - _offset;
+        if(length < left) {
+            _offset += length;
+            break;
+        }
+        length -= left;
+        _offset = 0;
+        completed++;
+    }
+    [_queue removeObjectsInRange:NSMakeRange(0, completed)];
+}
+
+- (void)removeAllData {
+    [_queue removeAllObjects];
+    _length = 0;
+    _offset = 0;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (BOOL)isFullForLength:(NSUInteger)length {
+    NSUInteger count = [_queue count];
+    return count >= _maximumMessages || (count > 0 && _length + length > _maximumBytes);
+}
+
+- (NSUInteger)indexOfDroppableDataForKey:(NSString *)key latestOnly:(BOOL)latestOnly {
+    // a partially written message has to go out completely
+    NSUInteger start = (_offset > 0) ? 1 : 0;
+    for(NSUInteger index = start; index < [_queue count]; index++) {
+        TMFQueuedData *queued = [_queue objectAtIndex:index];
+        if(queued.policy != TMFSendQueuePolicyReject && (!latestOnly || queued.policy == TMFSendQueuePolicyKeepLatest) && (!key || [queued.key isEqualToString:key])) {
+            return index;
+        }
+    }
+    return NSNotFound;
+}
+
+- (BOOL)dropOldestDataForKey:(NSString *)key {
+    // data which must not get lost stays in the queue, other streams only lose data if the same stream has nothing queued
+    NSUInteger index = key ? [self indexOfDroppableDataForKey:key latestOnly:NO] : NSNotFound;
+    if(index == NSNotFound) {
+        index = [self indexOfDroppableDataForKey:nil latestOnly:NO];
+    }
+
+    if(index == NSNotFound) {
+        return NO;
+    }
+
+    _length -= [((TMFQueuedData *)[_queue objectAtIndex:index]).data length];
+    [_queue removeObjectAtIndex:index];
+    return YES;
+}
+
+@end
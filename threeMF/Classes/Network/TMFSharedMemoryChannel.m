@@ -0,0 +1,236 @@
+//
+//  TMFSharedMemoryChannel.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFSharedMemoryChannel.h"
+#import "TMFUnixStream.h"
+#import "TMFSharedRing.h"
+#import "TMFLog.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* SO_NOSIGPIPE is set on the socket instead */
+#endif
+
+#define TMF_SHARED_MEMORY_CAPACITY 1048576  /* 1MB per direction */
+
+/**
+ Unix stream passing messages through shared memory rings once they are attached.
+ The socket then only carries single bytes waking up the other side.
+ */
+@interface TMFSharedMemoryStream : TMFUnixStream {
+    TMFSharedRing *_inbound;
+    TMFSharedRing *_outbound;
+}
+@property (nonatomic, copy) NSString *ringPath;
+@property (nonatomic, strong) NSArray *pendingRings;
+- (BOOL)attachInboundRing:(TMFSharedRing *)inbound outboundRing:(TMFSharedRing *)outbound;
+@end
+
+@implementation TMFSharedMemoryStream
+- (BOOL)attachInboundRing:(TMFSharedRing *)inbound outboundRing:(TMFSharedRing *)outbound {
+    // bytes already queued for the socket must not end up in the ring
+    if(self.closed || [_sendQueue count] > 0) {
+        return NO;
+    }
+
+    _inbound = inbound;
+    _outbound = outbound;
+
+    // the decoder may be busy with the message announcing the rings
+    __weak TMFSharedMemoryStream *weakSelf = self;
+    dispatch_async(_queue, ^{
+        [weakSelf drainInboundRing];
+    });
+    return YES;
+}
+
+- (void)close {
+    if(!self.closed) {
+        _inbound = nil;
+        _outbound = nil;
+        _pendingRings = nil;
+        if(_ringPath) {
+            unlink([_ringPath fileSystemRepresentation]);
+        }
+    }
+    [super close];
+}
+
+- (void)readAvailableData {
+    if(!_inbound) {
+        [super readAvailableData];
+        return;
+    }
+
+    // the socket only carries wake ups, their number does not matter
+    uint8_t bytes[64];
+    ssize_t length;
+    while((length = read(_fd, bytes, sizeof(bytes))) > 0) {
+    }
+    if(length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        [self close];
+        return;
+    }
+
+    [self drainInboundRing];
+    [self writePendingData];
+}
+
+- (void)writePendingData {
+    if(!_outbound) {
+        [super writePendingData];
+        return;
+    }
+
+    while(!self.closed) {
+        while([_sendQueue count] > 0) {
+            NSData *data = [_sendQueue dataAtIndex:0];
+            NSUInteger offset = [_sendQueue offset];
+            NSUInteger written = [_outbound writeBytes:(const uint8_t *)[data bytes] + offset length:[data length] - offset];
+            if(written == 0) {
+                break;
+            }
+            [_sendQueue consumeLength:written];
+        }
+
+        if([_outbound wakeConsumer]) {
+            [self wakeUpPeer];
+        }
+
+        // the consumer wakes us up once it freed space in a full ring
+        if([_sendQueue count] == 0 || [_outbound prepareToWaitForSpace]) {
+            return;
+        }
+    }
+}
+
+- (void)drainInboundRing {
+    // bounded per turn, so other streams on the queue get a chance to run
+    NSUInteger budget = [_inbound capacity];
+    while(!self.closed) {
+        const void *bytes = NULL;
+        NSUInteger available = [_inbound readableBytes:&bytes];
+        if(available == 0) {
+            if([_inbound prepareToSleep]) {
+                return;
+            }
+            continue;
+        }
+
+        NSData *data = [_decoder readBytes:bytes length:available];
+        [_inbound consumeLength:[data length]];
+        if([_inbound wakeProducer]) {
+            [self wakeUpPeer];
+        }
+
+        NSError *error = nil;
+        frameDecoderBlock_t frameBlock = self.frameBlock;
+        if(frameBlock && ![_decoder decodeReadData:data frames:frameBlock error:&error]) {
+            TMFLogError(@"Invalid message in shared memory of %@: %@", self.remotePath, error);
+            [self close];
+            return;
+        }
+
+        if([data length] >= budget) {
+            __weak TMFSharedMemoryStream *weakSelf = self;
+            dispatch_async(_queue, ^{
+                [weakSelf drainInboundRing];
+            });
+            return;
+        }
+        budget -= [data length];
+    }
+}
+
+- (void)wakeUpPeer {
+    // a full socket buffer means the peer has unread wake ups anyway
+    uint8_t byte = 1;
+    while(send(_fd, &byte, 1, MSG_NOSIGNAL) < 0 && errno == EINTR) {
+    }
+}
+@end
+
+@implementation TMFSharedMemoryChannel
+//............................................................................
+#pragma mark -
+#pragma mark Override
+//............................................................................
++ (Class)streamClass {
+    return [TMFSharedMemoryStream class];
+}
+
+- (NSArray *)helloArgumentsForStream:(TMFSharedMemoryStream *)stream {
+    // one ring per direction: requests to the peer, responses from the peer
+    NSString *path = [[self.socketPath stringByDeletingPathExtension] stringByAppendingFormat:@"-%08x.ring", arc4random()];
+    NSError *error = nil;
+    NSArray *rings = [TMFSharedRing createRingsAtPath:path count:2 capacity:TMF_SHARED_MEMORY_CAPACITY error:&error];
+    if(!rings) {
+        TMFLogError(@"Could not create shared memory: %@", error);
+        return @[];
+    }
+
+    stream.ringPath = path;
+    stream.pendingRings = rings;
+    return @[ path ];
+}
+
+- (BOOL)didSendHelloOnStream:(TMFSharedMemoryStream *)stream {
+    NSArray *rings = stream.pendingRings;
+    stream.pendingRings = nil;
+    if(rings && ![stream attachInboundRing:[rings objectAtIndex:1] outboundRing:[rings objectAtIndex:0]]) {
+        // the hello did not fit into the socket buffer of a new connection, give up this stream
+        TMFLogError(@"Could not attach shared memory for %@", stream.remotePath);
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)acceptHelloArguments:(NSArray *)arguments stream:(TMFSharedMemoryStream *)stream {
+    // the other side could not create shared memory, messages pass through the socket
+    if([arguments count] == 0) {
+        return YES;
+    }
+
+    NSString *ringPath = ([arguments count] == 1) ? [arguments objectAtIndex:0] : nil;
+    if(![ringPath isKindOfClass:[NSString class]]) {
+        return NO;
+    }
+
+    NSError *error = nil;
+    NSArray *rings = [TMFSharedRing mapRingsAtPath:ringPath error:&error];
+    if([rings count] < 2) {
+        TMFLogError(@"Could not map shared memory of %@: %@", stream.remotePath, error);
+        return NO;
+    }
+
+    // both sides mapped the file, it is not needed anymore
+    unlink([ringPath fileSystemRepresentation]);
+    return [stream attachInboundRing:[rings objectAtIndex:0] outboundRing:[rings objectAtIndex:1]];
+}
+
+@end
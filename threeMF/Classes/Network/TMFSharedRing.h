@@ -0,0 +1,111 @@
+//
+//  TMFSharedRing.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Single producer single consumer byte ring living in memory shared between two processes.
+
+ Rings are created in a memory mapped file, the peer process maps the same file. Writing and reading only copy
+ bytes and move counters, no system call is involved. Each side announces when it goes to sleep: the consumer when
+ the ring is empty, the producer when the ring is full. The other side then has to wake it up, usually by writing
+ a byte to a socket both sides watch.
+
+ A ring is not thread safe, one thread or serial queue may produce and one may consume.
+ */
+@interface TMFSharedRing : NSObject
+
+/**
+ Number of bytes the ring can hold.
+ */
+@property (nonatomic, readonly) NSUInteger capacity;
+
+/**
+ Creates a new memory mapped file holding count empty rings.
+ The file is only accessible by the current user.
+ @param path Path of the file to create, must not exist.
+ @param count Number of rings to create.
+ @param capacity Capacity of each ring, gets rounded up to a power of two.
+ @param error set if the file could not be created
+ @return array of TMFSharedRing objects, nil on error
+ */
++ (NSArray *)createRingsAtPath:(NSString *)path count:(NSUInteger)count capacity:(NSUInteger)capacity error:(NSError **)error;
+
+/**
+ Maps the rings of a file created by createRingsAtPath:count:capacity:error:
+ @param path Path of the file.
+ @param error set if the file could not be mapped or is invalid
+ @return array of TMFSharedRing objects in creation order, nil on error
+ */
++ (NSArray *)mapRingsAtPath:(NSString *)path error:(NSError **)error;
+
+/**
+ Producer: Copies as many bytes as fit into the ring.
+ @param bytes The bytes to write.
+ @param length Number of bytes to write.
+ @return number of bytes written, 0 if the ring is full
+ */
+- (NSUInteger)writeBytes:(const void *)bytes length:(NSUInteger)length;
+
+/**
+ Consumer: Gets the readable bytes up to the end of the ring's memory.
+ @param bytes set to the first readable byte, must not be NULL.
+ @return number of contiguous readable bytes, 0 if the ring is empty
+ */
+- (NSUInteger)readableBytes:(const void **)bytes;
+
+/**
+ Consumer: Frees bytes returned by readableBytes: for writing.
+ @param length Number of bytes consumed.
+ */
+- (void)consumeLength:(NSUInteger)length;
+
+/**
+ Consumer: Announces that the consumer waits for a wake up.
+ @return NO if bytes arrived meanwhile and the consumer should read again
+ */
+- (BOOL)prepareToSleep;
+
+/**
+ Producer: Checks if the consumer has to be woken up after writing. Only one call returns YES per sleep.
+ @return YES if the consumer sleeps
+ */
+- (BOOL)wakeConsumer;
+
+/**
+ Producer: Announces that the producer waits for free space.
+ @return NO if space got freed meanwhile and the producer should write again
+ */
+- (BOOL)prepareToWaitForSpace;
+
+/**
+ Consumer: Checks if the producer has to be woken up after consuming. Only one call returns YES per wait.
+ @return YES if the producer waits for free space
+ */
+- (BOOL)wakeProducer;
+
+@end
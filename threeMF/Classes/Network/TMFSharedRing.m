@@ -0,0 +1,289 @@
+//
+//  TMFSharedRing.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFSharedRing.h"
+#import "TMFError.h"
+
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TMF_RING_MAGIC        0x544d4652  /* "TMFR" */
+#define TMF_RING_LINE         64          /* counters of producer and consumer live on separate cache lines */
+#define TMF_RING_MAX_RINGS    16
+#define TMF_RING_MIN_CAPACITY 4096
+#define TMF_RING_MAX_CAPACITY 0x40000000  /* 1GB, counters wrap at 32 bit */
+
+/**
+ Header at the beginning of a ring file, padded to TMF_RING_LINE
+ */
+typedef struct {
+    _Atomic uint32_t magic;
+    uint32_t count;     /* number of rings in the file */
+    uint32_t capacity;  /* capacity of each ring, a power of two */
+} TMFRingFileHeader;
+
+/**
+ Header in front of the data of each ring
+ */
+typedef struct {
+    _Atomic uint32_t head;              /* bytes written, moved by the producer */
+    _Atomic int32_t producerWaiting;    /* set by the producer if the ring is full */
+    uint8_t producerPadding[TMF_RING_LINE - 2 * sizeof(uint32_t)];
+    _Atomic uint32_t tail;              /* bytes consumed, moved by the consumer */
+    _Atomic int32_t consumerSleeping;   /* set by the consumer if the ring is empty */
+    uint8_t consumerPadding[TMF_RING_LINE - 2 * sizeof(uint32_t)];
+} TMFRingHeader;
+
+static NSError *TMFRingError(NSString *message) {
+    return [TMFError errorForCode:TMFChannelErrorCode message:[NSString stringWithFormat:@"%@ (%s).", message, strerror(errno)]];
+}
+
+/**
+ Memory mapping shared by all rings of a file
+ */
+@interface TMFSharedMapping : NSObject
+@property (nonatomic, readonly) uint8_t *bytes;
+@property (nonatomic, readonly) size_t length;
+- (id)initWithFileDescriptor:(int)fd length:(size_t)length;
+@end
+
+@implementation TMFSharedMapping
+- (id)initWithFileDescriptor:(int)fd length:(size_t)length {
+    self = [super init];
+    if(self) {
+        void *bytes = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(bytes == MAP_FAILED) {
+            return nil;
+        }
+        _bytes = bytes;
+        _length = length;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    munmap(_bytes, _length);
+}
+@end
+
+@interface TMFSharedRing() {
+    TMFSharedMapping *_mapping; // keeps the memory mapped as long as the ring lives
+    TMFRingHeader *_header;
+    uint8_t *_data;
+    uint32_t _mask;
+}
+@end
+
+@implementation TMFSharedRing
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithMapping:(TMFSharedMapping *)mapping offset:(size_t)offset capacity:(uint32_t)capacity {
+    self = [super init];
+    if(self) {
+        _mapping = mapping;
+        _header = (TMFRingHeader *)(mapping.bytes + offset);
+        _data = mapping.bytes + offset + sizeof(TMFRingHeader);
+        _capacity = capacity;
+        _mask = capacity - 1;
+    }
+    return self;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
++ (NSArray *)createRingsAtPath:(NSString *)path count:(NSUInteger)count capacity:(NSUInteger)capacity error:(NSError **)error {
+    NSParameterAssert(path!=nil);
+    NSParameterAssert(count > 0 && count <= TMF_RING_MAX_RINGS);
+
+    uint32_t ringCapacity = TMF_RING_MIN_CAPACITY;
+    while(ringCapacity < capacity && ringCapacity < TMF_RING_MAX_CAPACITY) {
+        ringCapacity <<= 1;
+    }
+
+    size_t length = TMF_RING_LINE + count * (sizeof(TMFRingHeader) + ringCapacity);
+    const char *fileSystemPath = [path fileSystemRepresentation];
+    int fd = open(fileSystemPath, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if(fd < 0) {
+        if(error) {
+            *error = TMFRingError(@"Could not create ring file");
+        }
+        return nil;
+    }
+
+    // the file is zero filled, all rings start empty
+    TMFSharedMapping *mapping = nil;
+    if(ftruncate(fd, (off_t)length) == 0) {
+        mapping = [[TMFSharedMapping alloc] initWithFileDescriptor:fd length:length];
+    }
+    if(!mapping) {
+        if(error) {
+            *error = TMFRingError(@"Could not map ring file");
+        }
+        close(fd);
+        unlink(fileSystemPath);
+        return nil;
+    }
+    close(fd);
+
+    TMFRingFileHeader *header = (TMFRingFileHeader *)mapping.bytes;
+    header->count = (uint32_t)count;
+    header->capacity = ringCapacity;
+    atomic_store_explicit(&header->magic, TMF_RING_MAGIC, memory_order_release);
+
+    return [self ringsWithMapping:mapping count:count capacity:ringCapacity];
+}
+
++ (NSArray *)mapRingsAtPath:(NSString *)path error:(NSError **)error {
+    NSParameterAssert(path!=nil);
+
+    int fd = open([path fileSystemRepresentation], O_RDWR);
+    struct stat status;
+    if(fd < 0 || fstat(fd, &status) != 0 || status.st_size < TMF_RING_LINE) {
+        if(error) {
+            *error = TMFRingError(@"Could not open ring file");
+        }
+        if(fd >= 0) {
+            close(fd);
+        }
+        return nil;
+    }
+
+    TMFSharedMapping *mapping = [[TMFSharedMapping alloc] initWithFileDescriptor:fd length:(size_t)status.st_size];
+    close(fd);
+    if(!mapping) {
+        if(error) {
+            *error = TMFRingError(@"Could not map ring file");
+        }
+        return nil;
+    }
+
+    // the creator is another process, do not trust the header
+    TMFRingFileHeader *header = (TMFRingFileHeader *)mapping.bytes;
+    uint32_t magic = atomic_load_explicit(&header->magic, memory_order_acquire);
+    uint32_t count = header->count;
+    uint32_t capacity = header->capacity;
+    BOOL valid = magic == TMF_RING_MAGIC && count > 0 && count <= TMF_RING_MAX_RINGS
+                 && capacity >= TMF_RING_MIN_CAPACITY && capacity <= TMF_RING_MAX_CAPACITY && (capacity & (capacity - 1)) == 0
+                 && TMF_RING_LINE + (uint64_t)count * (sizeof(TMFRingHeader) + capacity) <= mapping.length;
+    if(!valid) {
+        if(error) {
+            *error = [TMFError errorForCode:TMFChannelErrorCode message:@"Invalid ring file."];
+        }
+        return nil;
+    }
+
+    return [self ringsWithMapping:mapping count:count capacity:capacity];
+}
+
+- (NSUInteger)writeBytes:(const void *)bytes length:(NSUInteger)length {
+    uint32_t head = atomic_load_explicit(&_header->head, memory_order_relaxed); // only moved by this side
+    uint32_t used = head - atomic_load_explicit(&_header->tail, memory_order_acquire); // the consumer is done with all bytes before the tail
+
+    NSUInteger count = (used < _capacity) ? MIN(length, _capacity - used) : 0;
+    if(count == 0) {
+        return 0;
+    }
+
+    uint32_t offset = head & _mask;
+    NSUInteger first = MIN(count, _capacity - offset);
+    memcpy(_data + offset, bytes, first);
+    memcpy(_data, (const uint8_t *)bytes + first, count - first);
+
+    atomic_store_explicit(&_header->head, head + (uint32_t)count, memory_order_release); // bytes are visible before the head moves
+    return count;
+}
+
+- (NSUInteger)readableBytes:(const void **)bytes {
+    NSParameterAssert(bytes!=NULL);
+
+    uint32_t tail = atomic_load_explicit(&_header->tail, memory_order_relaxed); // only moved by this side
+    uint32_t available = atomic_load_explicit(&_header->head, memory_order_acquire) - tail; // all bytes before the head are visible
+
+    uint32_t offset = tail & _mask;
+    *bytes = _data + offset;
+    return MIN(MIN(available, _capacity), _capacity - offset);
+}
+
+- (void)consumeLength:(NSUInteger)length {
+    uint32_t tail = atomic_load_explicit(&_header->tail, memory_order_relaxed);
+    atomic_store_explicit(&_header->tail, tail + (uint32_t)length, memory_order_release); // done reading before the producer may overwrite
+}
+
+- (BOOL)prepareToSleep {
+    // the flag is visible before checking the head, the producer checks them the other way around
+    atomic_store_explicit(&_header->consumerSleeping, 1, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&_header->head, memory_order_acquire) != atomic_load_explicit(&_header->tail, memory_order_relaxed)) {
+        atomic_store_explicit(&_header->consumerSleeping, 0, memory_order_relaxed);
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)wakeConsumer {
+    atomic_thread_fence(memory_order_seq_cst); // the head is visible before checking the flag
+    int32_t sleeping = 1;
+    return atomic_load_explicit(&_header->consumerSleeping, memory_order_relaxed) != 0 && atomic_compare_exchange_strong(&_header->consumerSleeping, &sleeping, 0);
+}
+
+- (BOOL)prepareToWaitForSpace {
+    // the flag is visible before checking the tail, the consumer checks them the other way around
+    atomic_store_explicit(&_header->producerWaiting, 1, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+    if((uint32_t)(atomic_load_explicit(&_header->head, memory_order_relaxed) - atomic_load_explicit(&_header->tail, memory_order_acquire)) < _capacity) {
+        atomic_store_explicit(&_header->producerWaiting, 0, memory_order_relaxed);
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)wakeProducer {
+    atomic_thread_fence(memory_order_seq_cst); // the tail is visible before checking the flag
+    int32_t waiting = 1;
+    return atomic_load_explicit(&_header->producerWaiting, memory_order_relaxed) != 0 && atomic_compare_exchange_strong(&_header->producerWaiting, &waiting, 0);
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
++ (NSArray *)ringsWithMapping:(TMFSharedMapping *)mapping count:(NSUInteger)count capacity:(uint32_t)capacity {
+    NSMutableArray *rings = [NSMutableArray arrayWithCapacity:count];
+    for(NSUInteger i = 0; i < count; i++) {
+        size_t offset = TMF_RING_LINE + i * (sizeof(TMFRingHeader) + capacity);
+        [rings addObject:[[TMFSharedRing alloc] initWithMapping:mapping offset:offset capacity:capacity]];
+    }
+    return rings;
+}
+
+@end
@@ -44,6 +44,12 @@
  */
 @property (nonatomic) Class commandClass;
 
+/**
+ The identifier the peer assigned to the command on subscription, messages of the subscription carry it instead of the command name.
+ 0 if the peer identifies the command by name.
+ */
+@property (nonatomic) NSUInteger commandIdentifier;
+
 /**
  The pubSubArgumentsReceivedBlock_t callback block tied to the subscription. This block gets called every time TMFArguments for TMFPublishSubscribeCommand get delivered from the subscribed TMFPeer.
  */
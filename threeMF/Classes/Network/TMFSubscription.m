@@ -67,7 +67,7 @@
 }
 
 - (NSString *)description {
-    return [NSString stringWithFormat:@"Subscription: %@ at %@", [_commandClass name], _peer.name];
+    return [NSString stringWithFormat:@"Subscription: %@ (%@) at %@", [_commandClass name], @(_commandIdentifier), _peer.name];
 }
 
 //............................................................................
@@ -42,4 +42,12 @@
  */
 + (NSUInteger)nextIdentifier;
 
+/**
+ Number of serial queue pairs incoming connections and outgoing sessions are spread over.
+ All sockets of one host share a queue pair, so one busy peer does not hold up the others.
+ By default one pair per active processor is used, override this method in a sub-class to change it.
+ @return the size of the queue pool, clamped to 1...16
+ */
++ (NSUInteger)queuePoolSize;
+
 @end
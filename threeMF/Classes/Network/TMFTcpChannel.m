@@ -25,37 +25,35 @@
 
 #import "TMFTcpChannel.h"
 #import "TMFTcpChannelConnection.h"
+#import "TMFTcpChannelSession.h"
 #import "GCDAsyncSocket.h"
 #import "TMFPublishSubscribeCommand.h"
-#import "TMFRequestResponseCommand.h"
-#import "TMFResponseCallback.h"
 
 #import "TMFError.h"
 #import "TMFLog.h"
 #import "TMFDefine.h"
 
-#import <sys/socket.h>
-#import <arpa/inet.h>
-#include <netinet/tcp.h>
+#define QUEUE_POOL_MAX_SIZE 16 /* upper bound for the number of connection queue pairs */
 
 static NSUInteger __counter;
 static NSLock *__counterLock;
 
-@interface TMFTcpChannel()<GCDAsyncSocketDelegate, TMFTcpChannelConnectionDelegate> {
-    NSMutableDictionary *_responseCallbacks;
-    NSMutableDictionary *_outPubSubSockets;
-    NSMutableArray *_outReqResSockets;
+@interface TMFTcpChannel()<GCDAsyncSocketDelegate, TMFTcpChannelConnectionDelegate, TMFTcpChannelSessionDelegate> {
+    NSMutableDictionary *_sessions;
     NSMutableArray *_connections;
 
-    NSLock *_callbacksLock;
     NSLock *_socketsLock;
     NSLock *_startupLock;
 
     GCDAsyncSocket *_socket;
     dispatch_queue_t _socketQueue;
-    dispatch_queue_t _connectionsQueue;
     dispatch_queue_t _socketDelegationQueue;
 
+    // connections and sessions are spread over a pool of queue pairs, sockets of one host share a pair
+    NSUInteger _queuePoolSize;
+    dispatch_queue_t _connectionQueues[QUEUE_POOL_MAX_SIZE];
+    dispatch_queue_t _connectionDelegationQueues[QUEUE_POOL_MAX_SIZE];
+
     // tmp
     stopCompletionBlock_t _shutdownCompletionBlock;
 }
@@ -73,18 +71,23 @@ static NSLock *__counterLock;
 - (id)initWithPort:(NSUInteger)port protocol:(TMFProtocol *)protocol delegate:(NSObject<TMFChannelDelegate> *)delegate {
     self = [super initWithPort:port protocol:protocol delegate:delegate];
     if(self) {
-        _responseCallbacks = [NSMutableDictionary new];
-        _outPubSubSockets = [NSMutableDictionary new];
-        _outReqResSockets = [NSMutableArray new];
+        _sessions = [NSMutableDictionary new];
         _connections = [NSMutableArray new];
 
         _socketsLock = [NSLock new];
-        _callbacksLock = [NSLock new];
         _startupLock = [NSLock new];
 
         _socketQueue = dispatch_queue_create("tmf.channel.tcp", DISPATCH_QUEUE_SERIAL);
-        _connectionsQueue = dispatch_queue_create("tmf.channel.tcp.connections", DISPATCH_QUEUE_SERIAL);
         _socketDelegationQueue = dispatch_queue_create("tmf.channel.tcp.working", DISPATCH_QUEUE_SERIAL);
+
+        _queuePoolSize = MAX(1, MIN([[self class] queuePoolSize], QUEUE_POOL_MAX_SIZE));
+        for(NSUInteger i = 0; i < _queuePoolSize; i++) {
+            char label[64];
+            snprintf(label, sizeof(label), "tmf.channel.tcp.connections.%lu", (unsigned long)i);
+            _connectionQueues[i] = dispatch_queue_create(label, DISPATCH_QUEUE_SERIAL);
+            snprintf(label, sizeof(label), "tmf.channel.tcp.connections.working.%lu", (unsigned long)i);
+            _connectionDelegationQueues[i] = dispatch_queue_create(label, DISPATCH_QUEUE_SERIAL);
+        }
     }
     return self;
 }
@@ -95,12 +98,13 @@ static NSLock *__counterLock;
         [_socket disconnect];
     }];
 
-    [_responseCallbacks removeAllObjects];
-
 #if ARC_HANDLES_QUEUES
     dispatch_release(_socketQueue);
-    dispatch_release(_connectionsQueue);
     dispatch_release(_socketDelegationQueue);
+    for(NSUInteger i = 0; i < _queuePoolSize; i++) {
+        dispatch_release(_connectionQueues[i]);
+        dispatch_release(_connectionDelegationQueues[i]);
+    }
 #endif
 }
 
@@ -116,11 +120,19 @@ static NSLock *__counterLock;
     return identifier;
 }
 
++ (NSUInteger)queuePoolSize {
+    return [[NSProcessInfo processInfo] activeProcessorCount];
+}
+
 //............................................................................
 #pragma mark -
 #pragma mark Override
 //............................................................................
 - (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer responseBlock:(responseBlock_t)responseBlock {
+    [self send:command arguments:arguments destination:peer timeout:0 responseBlock:responseBlock];
+}
+
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(NSTimeInterval)timeout responseBlock:(responseBlock_t)responseBlock {
     NSParameterAssert(peer!=nil);
     NSParameterAssert(command!=nil);
     BOOL publishSubscribe = [command isKindOfClass:[TMFPublishSubscribeCommand class]];
@@ -130,14 +142,15 @@ static NSLock *__counterLock;
 
     arguments.identifier = [[self class] nextIdentifier];
 
-    GCDAsyncSocket *socket = [self socketForCommand:command peer:peer];
+    TMFTcpChannelSession *session = [self sessionForCommand:command peer:peer];
 
-    if(socket) {
-        [self addResponseBlock:responseBlock identifier:arguments.identifier peer:peer socket:socket];
-        NSData *data = [self.protocol requestDataForCommand:command arguments:arguments];
-        [socket writeData:data withTimeout:TIMEOUT tag:0];
-        if(!publishSubscribe) {
-            [socket readDataToLength:[self.protocol requestResponseHeaderLength] withTimeout:TIMEOUT tag:RESPONSE_HEADER_TAG];
+    if(session) {
+        // responses are read continuously by the session and matched by identifier
+        [self addResponseBlock:responseBlock identifier:arguments.identifier peer:peer connection:session.socket timeout:timeout];
+        NSData *data = [self.protocol requestDataForCommand:command arguments:arguments options:[self frameOptionsForPeer:peer]];
+        NSError *error = nil;
+        if(![session sendData:data policy:[self sendQueuePolicyForCommand:command] key:command.name error:&error]) {
+            [self failResponseBlockForIdentifier:arguments.identifier error:error];
         }
     }
     else {
@@ -149,30 +162,31 @@ static NSLock *__counterLock;
     }
 }
 
-- (void)removePeer:(TMFPeer *)peer {
-    
-    // gettig rid of publish subscribe
-    NSArray *peerSocketKeys = [[_outPubSubSockets allKeys] filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(NSString *key, __unused NSDictionary *bindings) {
-        return [key hasSuffix:peer.UUID];
-    }]];
-
-    // gettig rid of reqest response sockets
-    NSArray *sockets = [_outReqResSockets filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(GCDAsyncSocket *evaluatedObject, __unused NSDictionary *bindings) {
-        return [[evaluatedObject userData] isEqual:peer];
-    }]];
-
-    for(NSString *key in peerSocketKeys) {
-        [[_outPubSubSockets objectForKey:key] disconnect];
-    }
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destinations:(NSArray *)peers {
+    NSParameterAssert(command!=nil);
 
-    for(GCDAsyncSocket *socket in sockets) {
-        [socket disconnect];
-    }
+    arguments.identifier = [[self class] nextIdentifier];
+    NSArray *messages = [self requestDataForCommand:command arguments:arguments destinations:peers];
+
+    TMFSendQueuePolicy policy = [self sendQueuePolicyForCommand:command];
+    [peers enumerateObjectsUsingBlock:^(TMFPeer *peer, NSUInteger idx, __unused BOOL *stop) {
+        [[self sessionForCommand:command peer:peer] sendData:[messages objectAtIndex:idx] policy:policy key:command.name error:NULL];
+    }];
+}
 
+- (void)removePeer:(TMFPeer *)peer {
+    // gettig rid of all sessions to the peer
     [_socketsLock lock];
-    [_outPubSubSockets removeObjectsForKeys:peerSocketKeys];
-    [_outReqResSockets removeObjectsInArray:sockets];
+    NSSet *keys = [_sessions keysOfEntriesPassingTest:^BOOL(__unused id key, TMFTcpChannelSession *session, __unused BOOL *stop) {
+        return [session.peer isEqual:peer];
+    }];
+    NSArray *sessions = [_sessions objectsForKeys:[keys allObjects] notFoundMarker:[NSNull null]];
+    [_sessions removeObjectsForKeys:[keys allObjects]];
     [_socketsLock unlock];
+
+    for(TMFTcpChannelSession *session in sessions) {
+        [session disconnect];
+    }
 }
 
 - (NSUInteger)port {
@@ -225,86 +239,46 @@ static NSLock *__counterLock;
 #pragma mark Delegates
 //............................................................................
 #pragma mark TMFConnectionDelegate
-- (void)connection:(TMFTcpChannelConnection *)connection didReadRequest:(TMFRequest *)request fromAddress:(NSData *)address {
-    if(connection && request && address) {
-        dispatch_async(self.delegate.callbackQueue, ^{
-            [self.delegate receiveOnChannel:self
-                                commandName:request.commandName
-                                  arguments:request.arguments
-                                    address:address
-                                   response:^(NSDictionary *result, NSError *error) {
-                                       dispatch_async(_connectionsQueue, ^{
-                                           [connection sendResponseForRequest:request result:result error:error];
-                                       });
-                                   }];
-        });
+- (void)connection:(TMFTcpChannelConnection *)connection didReadRequests:(NSArray *)requests fromAddress:(NSData *)address {
+    if(connection && [requests count] > 0 && address) {
+        [self receiveRequests:requests address:address response:^(TMFRequest *request, id result, NSError *error) {
+            dispatch_async(_connectionQueues[[self queueIndexForAddress:address]], ^{
+                [connection sendResponseForRequest:request result:result error:error];
+            });
+        }];
     }
     else {
-        TMFLogInfo(@"Empty request (%@), conneciton (%@) or address (%@)", request, connection, address);
+        TMFLogInfo(@"Empty requests (%@), conneciton (%@) or address (%@)", requests, connection, address);
     }
 }
 
 - (void)connection:(TMFTcpChannelConnection *)conneciton didDisconnect:(GCDAsyncSocket *)socket withError:(NSError *)error {
-    dispatch_async(_connectionsQueue, ^{
-        [_socketsLock lock];
-        [_connections removeObject:conneciton];
-        [_socketsLock unlock];
-    });
+    [_socketsLock lock];
+    [_connections removeObject:conneciton];
+    [_socketsLock unlock];
 
     TMFLogVerbose(@"Connection <%@> to %@ disconnected with error %@.", conneciton, socket.userData, error);
 }
 
-#pragma mark GCDAsyncSocketDelegate
-/**
- * Called when a socket has completed reading the requested data into memory.
- * Not called if there is an error.
- **/
-- (void)socket:(GCDAsyncSocket *)sock didReadData:(NSData *)data withTag:(long)tag {
-    if (sock != _socket) {
-        TMFResponse *response = nil;
-        __block NSError *error = nil;
-        NSMutableArray *callbacks = [NSMutableArray new];
-
-        if(tag == RESPONSE_HEADER_TAG) {
-            [self.protocol parseHeader:data completion:^(uint64_t length, NSError *parseError) {
-                if(!parseError && length > 0) {
-                    [sock readDataToLength:length withTimeout:-1 tag:RESPONSE_BODY_TAG];
-                }
-                else {
-                    TMFLogError(@"Invalid message header (%@)", parseError);
-                    error = parseError;
-                    [callbacks addObjectsFromArray:[self removeResponseBlocksForSocket:sock]];
-                }
-            }];
-        }
-        else if(tag == RESPONSE_BODY_TAG) {         
-            response = [self.protocol responseFromData:data];
-            if(response) {
-                [callbacks addObject:[self removeResponseCallback:response]];
-                if([callbacks count] == 0) {
-                    error = [TMFError errorForCode:TMFChannelErrorCode message:@"No response callback block found!"];
-                }
-            }
-            else {
-                error = [TMFError errorForCode:TMFChannelErrorCode message:@"Received empty TMFResponse"];
-                [callbacks addObjectsFromArray:[self removeResponseBlocksForSocket:sock]];
-            }           
-        }
+#pragma mark TMFTcpChannelSessionDelegate
+- (void)session:(__unused TMFTcpChannelSession *)session didReadResponses:(NSArray *)responses {
+    [self executeResponseBlocksForResponses:responses];
+}
 
-        if(!error && response.error != nil) {
-            error = [TMFError errorForCode:TMFResponseErrorCode message:response.error];
-        }
+- (void)session:(TMFTcpChannelSession *)session didDisconnectWithError:(NSError *)error {
+    [_socketsLock lock];
+    NSString *key = [TMFTcpChannelSession keyForPeer:session.peer port:session.port];
+    if([_sessions objectForKey:key] == session) {
+        [_sessions removeObjectForKey:key];
+    }
+    [_socketsLock unlock];
 
-        // execute response blocks
-        [self executeResponseCallbacks:callbacks result:response.result error:error];
+    [self failResponseBlocksForConnection:session.socket error:error];
 
-        // FIXME: each request response gets a new connection at the moment, this disconnect needs to get removed if error == nil when refactoring for reusable connections!
-        if(error || tag == RESPONSE_BODY_TAG) {
-            [sock disconnect];
-        }
-    }
+    TMFLogVerbose(@"Session %@ disconnected with error %@.", session, error);
 }
 
+#pragma mark GCDAsyncSocketDelegate
 /**
  * This method is called immediately prior to socket:didAcceptNewSocket:.
  * It optionally allows a listening socket to specify the socketQueue for a new accepted socket.
@@ -324,10 +298,11 @@ static NSLock *__counterLock;
  * return myExistingQueue;
  **/
 - (dispatch_queue_t)newSocketQueueForConnectionFromAddress:(NSData *)address onSocket:(GCDAsyncSocket *)sock {
+    dispatch_queue_t queue = _connectionQueues[[self queueIndexForAddress:address]];
 #if ARC_HANDLES_QUEUES
-    dispatch_retain(_connectionsQueue);
+    dispatch_retain(queue);
 #endif
-    return _connectionsQueue;
+    return queue;
 }
 
 /**
@@ -342,8 +317,13 @@ static NSLock *__counterLock;
  **/
 - (void)socket:(GCDAsyncSocket *)sock didAcceptNewSocket:(GCDAsyncSocket *)newSocket {
     if(sock == _socket) {
-        dispatch_async(_connectionsQueue, ^{
-            TMFTcpChannelConnection *connection = [[TMFTcpChannelConnection alloc] initWithSocket:newSocket protocol:self.protocol delegate:self];
+        // the socket queue got picked by address, move the delegate callbacks next to it
+        NSData *address = [newSocket connectedAddress];
+        NSUInteger index = [self queueIndexForAddress:address];
+        [newSocket setDelegateQueue:_connectionDelegationQueues[index]];
+        dispatch_async(_connectionQueues[index], ^{
+            BOOL legacyFraming = [self legacyFramingForAddress:address];
+            TMFTcpChannelConnection *connection = [[TMFTcpChannelConnection alloc] initWithSocket:newSocket protocol:self.protocol legacyFraming:legacyFraming delegate:self];
             [_socketsLock lock];
             [_connections addObject:connection];
             [_socketsLock unlock];
@@ -360,19 +340,20 @@ static NSLock *__counterLock;
 - (void)socketDidDisconnect:(GCDAsyncSocket *)sock withError:(NSError *)error {
     if(error && error.code != GCDAsyncSocketClosedError) {
         TMFLogError(@"TCP Socket (%@) disconnected with Error: %@", sock, error);
-        // lets make sure response callbacks get called even if we have an error (e.g. timeout)
-        NSArray *blocks = [self removeResponseBlocksForSocket:sock];
-        [self executeResponseCallbacks:blocks result:nil error:error];
     }
 
     if(sock == _socket) {
         // close all connections
         [_socketsLock lock];
+        NSArray *sessions = [_sessions allValues];
         [_connections removeAllObjects];
-        [_outPubSubSockets removeAllObjects];
-        [_outReqResSockets removeAllObjects];
+        [_sessions removeAllObjects];
         [_socketsLock unlock];
 
+        for(TMFTcpChannelSession *session in sessions) {
+            [session disconnect];
+        }
+
         TMFLogInfo(@"System TCP channel socket disconnected!");
         if(_shutdownCompletionBlock != nil && ![self isRunning]) {
             stopCompletionBlock_t stopCompletion = [_shutdownCompletionBlock copy];
@@ -382,9 +363,6 @@ static NSLock *__counterLock;
             });
         }
     }
-    else {
-        [self removeSocket:sock];
-    }
 
     TMFLogVerbose(@"Socked <%@> to %@ disconnected with error %@.", sock, sock.userData, error);
 }
@@ -414,61 +392,44 @@ static NSLock *__counterLock;
     return done;
 }
 
-- (GCDAsyncSocket *)createSocketForPeer:(TMFPeer *)peer {
-    TMFLogVerbose(@"Creating socket for peer %@", peer);
-    GCDAsyncSocket *socket = [[GCDAsyncSocket alloc] initWithDelegate:self delegateQueue:_socketDelegationQueue socketQueue:_socketQueue];
-    [socket setUserData:peer];
-    return socket;
-}
-
-- (GCDAsyncSocket *)socketForCommand:(TMFCommand *)command peer:(TMFPeer *)peer {
+- (TMFTcpChannelSession *)sessionForCommand:(TMFCommand *)command peer:(TMFPeer *)peer {
+    // all commands sent to the same peer endpoint share one session,
+    // requests are identified by command name and identifier within the session
+    NSUInteger port = [peer portForCommandName:command.name];
+    NSString *key = [TMFTcpChannelSession keyForPeer:peer port:port];
 
-    GCDAsyncSocket *socket = nil;
-    if([command isKindOfClass:[TMFRequestResponseCommand class]]) {
-        // disabling reuse for request response commands because
-        // sending a request while waiting for a response is not supported
-        // TODO: a better strategy may be queing requests to avoid new sockets for each request
-        socket = [self createSocketForPeer:peer];
-        [_socketsLock lock];
-        [_outReqResSockets addObject:socket];
-        [_socketsLock unlock];        
-    } else {
-        // reuse previously created socket for publish subscribe
-        NSString *key = [NSString stringWithFormat:@"%@:%@", command.name, peer.UUID];
-        socket = [_outPubSubSockets objectForKey:key];
-        if(!socket) {
-            socket = [self createSocketForPeer:peer];
-            [_socketsLock lock];
-            [_outPubSubSockets setObject:socket forKey:key];
-            [_socketsLock unlock];
-        }
+    [_socketsLock lock];
+    TMFTcpChannelSession *session = [_sessions objectForKey:key];
+    if(session && [session isDisconnected]) {
+        // disconnect notification is still pending
+        [_sessions removeObjectForKey:key];
+        session = nil;
+    }
 
-        // disablel nagle's algorithm for small messages
-        if([command isKindOfClass:[TMFPublishSubscribeCommand class]] && [[command class] isRealTime]) {
-            [self disableDelay:YES socket:socket];
-        }
+    BOOL connect = NO;
+    if(!session) {
+        TMFLogVerbose(@"Creating session for peer %@", peer);
+        NSUInteger index = [self queueIndexForAddress:[peer addressForPort:port]];
+        session = [[TMFTcpChannelSession alloc] initWithPeer:peer port:port protocol:self.protocol delegate:self delegateQueue:_connectionDelegationQueues[index] socketQueue:_connectionQueues[index]];
+        [_sessions setObject:session forKey:key];
+        connect = YES;
     }
+    [_socketsLock unlock];
 
-    // connect
-    if(![socket isConnected]) {
-        NSError *error = nil;
-        NSUInteger port = [peer portForCommandName:command.name];
-        TMFLogVerbose(@"Trying to connect to %@:%@", peer.hostName, @(port));
-        if([socket connectToHost:peer.hostName onPort:port error:&error]){
-            if(!error) {
-                error = nil;
-                TMFLogVerbose(@"Connected to %@:%@", peer.hostName, @(port));
-            }
-        }
+    // connect outside of the lock, the socket synchronizes with the socket queue
+    NSError *error = nil;
+    if(connect && ![session connect:&error]) {
+        TMFLogError(@"Could not connect to %@. Reason: %@", peer, error);
+        [self session:session didDisconnectWithError:error];
+        return nil;
+    }
 
-        if(error) {
-            TMFLogError(@"Could not connect to %@. Reason: %@", peer, error);
-            [self removeSocket:socket];
-            return nil;
-        }
+    // disablel nagle's algorithm for small messages
+    if([command isKindOfClass:[TMFPublishSubscribeCommand class]] && [[command class] isRealTime]) {
+        [session setNoDelay:YES];
     }
 
-    return socket;
+    return session;
 }
 
 - (void)closeTcpSocketAndDisconnectAllClients {
@@ -478,91 +439,9 @@ static NSLock *__counterLock;
     [_socketsLock unlock];
 }
 
-- (void)removeSocket:(GCDAsyncSocket *)sock {
-    // remove stored references
-    __block id socketKey = nil;
-    [_outPubSubSockets enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
-        if(obj == sock) {
-            socketKey = key;
-            *stop = YES;
-        }
-    }];
-
-    [_socketsLock lock];
-    [_outReqResSockets removeObject:sock];
-    if(socketKey) {
-        [_outPubSubSockets removeObjectForKey:socketKey];
-    }
-    [_socketsLock unlock];
-}
-
-- (void)executeResponseCallbacks:(NSArray *)callbacks result:(id)result error:(NSError *)error {
-    dispatch_async(self.delegate.callbackQueue, ^{
-        for(TMFResponseCallback *callback in callbacks) {
-            callback.responseBlock(result, error);
-        }
-    });
-}
-
-- (NSArray *)removeResponseBlocksForPeer:(TMFPeer *)peer {
-    return [self removeResponseBlocksWithPredicate:[NSPredicate predicateWithBlock:^BOOL(TMFResponseCallback *callback, __unused NSDictionary *bindings) {
-        return [callback.peer isEqual:peer];
-    }]];
-}
-
-- (NSArray *)removeResponseBlocksForSocket:(GCDAsyncSocket *)socket {
-    return [self removeResponseBlocksWithPredicate:[NSPredicate predicateWithBlock:^BOOL(TMFResponseCallback *callback, __unused NSDictionary *bindings) {
-        return callback.socket == socket;
-    }]];
-}
-
-- (NSArray *)removeResponseBlocksWithPredicate:(NSPredicate *)predicate {
-    NSArray *blocks = [[_responseCallbacks allValues] filteredArrayUsingPredicate:predicate];
-    NSSet *keys = [_responseCallbacks keysOfEntriesPassingTest:^BOOL(__unused id key, id obj, __unused BOOL *stop) {
-        return [blocks containsObject:obj];
-    }];
-
-    [_callbacksLock lock];
-    [_responseCallbacks removeObjectsForKeys:[keys allObjects]];
-    [_callbacksLock unlock];
-
-    return [NSArray arrayWithArray:blocks];
-}
-
-- (TMFResponseCallback *)removeResponseCallback:(TMFResponse *)response {
-    TMFResponseCallback *callback = [_responseCallbacks objectForKey:response.identifier];
-    if(callback) {
-        [_callbacksLock lock];
-        [_responseCallbacks removeObjectForKey:response.identifier];
-        [_callbacksLock unlock];
-    }
-    return callback;
-}
-
-- (void)addResponseBlock:(responseBlock_t)block identifier:(NSUInteger)identifier peer:(TMFPeer *)peer socket:(GCDAsyncSocket *)socket {
-    if(block) {
-        [_callbacksLock lock];
-        [_responseCallbacks setObject:[[TMFResponseCallback alloc] initWithIdentifier:identifier peer:peer socket:socket block:block] forKey:@(identifier)];
-        [_callbacksLock unlock];
-    }
-}
-
-- (void)disableDelay:(BOOL)disable socket:(GCDAsyncSocket *)socket {
-    // set Nagle delayed ack algorithm
-    // http://www.unixguide.net/network/socketfaq/2.16.shtml
-    // http://www.stuartcheshire.org/papers/NagleDelayedAck/
-    [socket performBlock:^{
-        int socketFD = [socket socketFD];
-        int flag = [@(disable) intValue];
-        int result = setsockopt(socketFD,        /* socket affected */
-                                IPPROTO_TCP,     /* set option at TCP level */
-                                TCP_NODELAY,     /* name of option */
-                                (char *) &flag,  /* the cast is historical cruft */
-                                sizeof(int));    /* length of option value */
-        if (result != 0) {
-            TMFLogError(@"Could not set TCP_NODELAY.");
-        }
-    }];
+- (NSUInteger)queueIndexForAddress:(NSData *)address {
+    // ports differ for every connection of a peer
+    return [TMFPeer hostHashFromAddressData:address] % _queuePoolSize;
 }
 
 - (void)performBlockOnSocketQueue:(dispatch_block_t)block {
@@ -33,11 +33,10 @@
 #import "TMFChannelDelegate.h"
 #import "TMFChannel.h"
 
-#define REQUEST_HEADER_TAG  100 /* GCDAsyncSocket tag for reading request headers */
-#define REQUEST_BODY_TAG    101 /* GCDAsyncSocket tag for reading request bodies */
-#define RESPONSE_HEADER_TAG 200 /* GCDAsyncSocket tag for reading response headers */
-#define RESPONSE_BODY_TAG   201 /* GCDAsyncSocket tag for reading response bodies */
+#define REQUEST_STREAM_TAG  102 /* GCDAsyncSocket tag for reading request streams */
+#define REQUEST_SEND_TAG    201 /* GCDAsyncSocket tag for sending request data */
 #define RESPONSE_SEND_TAG   202 /* GCDAsyncSocket tag for sending response data */
+#define RESPONSE_STREAM_TAG 203 /* GCDAsyncSocket tag for reading response streams */
 
 #define TIMEOUT             60.0 /* default time out for GCDAsyncSocket operations */
 
@@ -50,12 +49,13 @@
 @protocol TMFTcpChannelConnectionDelegate <NSObject>
 @required
 /**
- This callback gets triggered when a connection finished reading a request.
+ This callback gets triggered when a connection finished reading requests.
+ All requests decoded out of one socket read are delivered at once.
  @param connection The connection sending the message.
- @param request The read request object.
+ @param requests The read TMFRequest objects in order.
  @param address The senders address.
  */
-- (void)connection:(TMFTcpChannelConnection *)connection didReadRequest:(TMFRequest *)request fromAddress:(NSData *)address;
+- (void)connection:(TMFTcpChannelConnection *)connection didReadRequests:(NSArray *)requests fromAddress:(NSData *)address;
 
 /**
  This callback gets called after the socket of a connection gets disconnected.
@@ -93,9 +93,10 @@
  Initializes a new instance.
  @param socket  The corresponding TCP socket for this connection. The **delegate** of this socket **gets changed** to the current class.
  @param protocol The protocol used for decoding incoming TMFRequests and outgoing TMFResponses
+ @param legacyFraming YES if the connected peer is a 1.0 peer using legacy headers, see [TMFChannel legacyFramingForAddress:]
  @param delegate The corresponding delegate getting notified about new incoming TMFRequests
  */
-- (id)initWithSocket:(GCDAsyncSocket *)socket protocol:(TMFProtocol *)protocol delegate:(NSObject<TMFTcpChannelConnectionDelegate> *)delegate;
+- (id)initWithSocket:(GCDAsyncSocket *)socket protocol:(TMFProtocol *)protocol legacyFraming:(BOOL)legacyFraming delegate:(NSObject<TMFTcpChannelConnectionDelegate> *)delegate;
 
 /**
  Send a response to the connected peer's socket.
@@ -24,14 +24,20 @@
 //
 
 #import "TMFTcpChannelConnection.h"
+#import "TMFFrameDecoder.h"
 #import "TMFLog.h"
 
+@interface TMFTcpChannelConnection() {
+    TMFFrameDecoder *_decoder;
+}
+@end
+
 @implementation TMFTcpChannelConnection
 //............................................................................
 #pragma mark -
 #pragma mark Memory Management
 //............................................................................
-- (id)initWithSocket:(GCDAsyncSocket *)socket protocol:(TMFProtocol *)protocol delegate:(NSObject<TMFTcpChannelConnectionDelegate> *)delegate {
+- (id)initWithSocket:(GCDAsyncSocket *)socket protocol:(TMFProtocol *)protocol legacyFraming:(BOOL)legacyFraming delegate:(NSObject<TMFTcpChannelConnectionDelegate> *)delegate {
     NSParameterAssert(socket!=nil);
     NSParameterAssert([socket isConnected]);
     NSParameterAssert(delegate!=nil);
@@ -41,6 +47,8 @@
         _delegate = delegate;
         _protocol = protocol;
         _socket = socket;
+        _decoder = [[TMFFrameDecoder alloc] initWithProtocol:protocol];
+        _decoder.legacyFraming = legacyFraming;
         [_socket setDelegate:self];
         [self readNextRequest];
     }
@@ -58,7 +66,9 @@
 //............................................................................
 - (void)sendResponseForRequest:(TMFRequest *)request result:(id)result error:(NSError *)error {
     TMFResponse *response = [TMFResponse responseWithidentifier:request.identifier result:result error:[error description]];
-    NSData *data = [self.protocol responseDataForResponse:response];
+    // answers in the format of the request
+    TMFFrameOption options = (request.compressed ? TMFFrameOptionCompress : 0) | (_decoder.legacyFraming ? TMFFrameOptionLegacyHeader : 0);
+    NSData *data = [self.protocol data:[self.protocol responseDataForResponse:response] withOptions:options];
     [self.socket writeData:data withTimeout:TIMEOUT tag:RESPONSE_SEND_TAG];
 }
 
@@ -89,23 +99,28 @@
  * Not called if there is an error.
  **/
 - (void)socket:(GCDAsyncSocket *)sock didReadData:(NSData *)data withTag:(long)tag {
-    if(tag == REQUEST_HEADER_TAG) {
-        [self.protocol parseHeader:data completion:^(uint64_t length, NSError *error) {
-            if(!error && length > 0) {
-                [sock readDataToLength:length withTimeout:-1 tag:REQUEST_BODY_TAG];
+    if(tag == REQUEST_STREAM_TAG) {
+        NSMutableArray *requests = [NSMutableArray new];
+        NSError *error = nil;
+        BOOL valid = [_decoder decodeReadData:data frames:^(NSData *body, uint8_t flags) {
+            TMFRequest *request = [self.protocol requestFromData:body flags:flags];
+            if(request) {
+                [requests addObject:request];
             }
-            else {
-                [self readNextRequest];
-            }
-        }];
-    }
-    else if(tag == REQUEST_BODY_TAG) {
-        TMFRequest *request = [self.protocol requestFromData:data];
-        [self.delegate connection:self didReadRequest:request fromAddress:sock.connectedAddress];
-        [self readNextRequest];
-    }
-    else {
-        [self readNextRequest];
+        } error:&error];
+
+        if([requests count] > 0) {
+            [self.delegate connection:self didReadRequests:requests fromAddress:sock.connectedAddress];
+        }
+
+        if(valid) {
+            [self readNextRequest];
+        }
+        else {
+            // the stream is out of sync, there is no way to recover
+            TMFLogError(@"Invalid message header (%@)", error);
+            [sock disconnect];
+        }
     }
 }
 
@@ -127,7 +142,7 @@
 #pragma mark Private
 //............................................................................
 - (void)readNextRequest {
-    [_socket readDataToLength:[self.protocol requestResponseHeaderLength] withTimeout:-1 tag:REQUEST_HEADER_TAG];
+    [_decoder readFromSocket:_socket timeout:-1 tag:REQUEST_STREAM_TAG];
 }
 
 @end
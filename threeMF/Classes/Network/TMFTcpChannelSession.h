@@ -0,0 +1,163 @@
+//
+//  TMFTcpChannelSession.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "GCDAsyncSocket.h"
+#import "TMFResponse.h"
+#import "TMFPeer.h"
+#import "TMFProtocol.h"
+#import "TMFPublishSubscribeCommand.h"
+
+@class TMFTcpChannelSession;
+
+/**
+ An instance of TMFTcpChannelSession uses methods in this protocol
+ to communicate it's underlying sockets events.
+ */
+@protocol TMFTcpChannelSessionDelegate <NSObject>
+@required
+/**
+ This callback gets triggered when a session finished reading responses.
+ All responses decoded out of one socket read are delivered at once.
+ @param session The session sending the message.
+ @param responses The read TMFResponse objects in order.
+ */
+- (void)session:(TMFTcpChannelSession *)session didReadResponses:(NSArray *)responses;
+
+/**
+ This callback gets called after the socket of a session gets disconnected.
+ @param session The session sending the message.
+ @param error The error message containing the reason for the disconnection. The reason could also be an expected close of the socket.
+ */
+- (void)session:(TMFTcpChannelSession *)session didDisconnectWithError:(NSError *)error;
+@end
+
+
+/**
+ The class is used to handle an outgoing connection to one TMFPeer endpoint.
+ It is the counterpart of TMFTcpChannelConnection, all commands sent to the same peer and port share one session.
+ Requests are framed by the protocol and identified by their command name and identifier, responses are read continuously and matched by identifier.
+ */
+@interface TMFTcpChannelSession : NSObject <GCDAsyncSocketDelegate>
+
+/**
+ The corresponding TCP socket for this session
+ */
+@property (nonatomic, readonly) GCDAsyncSocket *socket;
+
+/**
+ The destination peer
+ */
+@property (nonatomic, readonly) TMFPeer *peer;
+
+/**
+ The destination port
+ */
+@property (nonatomic, readonly) NSUInteger port;
+
+/**
+ The protocol used for decoding incoming TMFResponses
+ */
+@property (nonatomic, strong) TMFProtocol *protocol;
+
+/**
+ The object that acts as delegate of the session.
+ */
+@property (nonatomic, weak) NSObject<TMFTcpChannelSessionDelegate> *delegate;
+
+/**
+ Maximum number of framed requests waiting to be handed to the socket. Default 64.
+ */
+@property (nonatomic) NSUInteger maximumQueuedMessages;
+
+/**
+ Maximum number of bytes waiting to be handed to the socket. Default 4MB.
+ A single larger request is accepted if nothing else is queued.
+ */
+@property (nonatomic) NSUInteger maximumQueuedBytes;
+
+/**
+ Initializes a new, not yet connected instance.
+ @param peer The destination peer. Must not be nil.
+ @param port The destination port.
+ @param protocol The protocol used for decoding incoming TMFResponses
+ @param delegate The corresponding delegate getting notified about responses
+ @param delegateQueue The queue socket events are delivered on
+ @param socketQueue The queue the socket operates on
+ */
+- (id)initWithPeer:(TMFPeer *)peer port:(NSUInteger)port protocol:(TMFProtocol *)protocol delegate:(NSObject<TMFTcpChannelSessionDelegate> *)delegate delegateQueue:(dispatch_queue_t)delegateQueue socketQueue:(dispatch_queue_t)socketQueue;
+
+/**
+ Connects the session's socket and starts reading responses.
+ @param error set if the connection attempt could not be started
+ @return YES if the connection attempt was started
+ */
+- (BOOL)connect:(NSError **)error;
+
+/**
+ Closes the connection.
+ */
+- (void)disconnect;
+
+/**
+ Queues framed request data with TMFSendQueuePolicyReject.
+ @param data The framed request data.
+ */
+- (void)sendData:(NSData *)data;
+
+/**
+ Queues framed request data for writing, never waits for the socket.
+ Only a few writes are handed to the socket at once, the rest waits in a bounded queue handled according to the policy.
+ @param data The framed request data.
+ @param policy Defines what happens if the send queue is full.
+ @param key Identifies the stream for TMFSendQueuePolicyKeepLatest and whose writes TMFSendQueuePolicyDropOldest drops first, usually the command name. May be nil.
+ @param error set if the data was not queued
+ @return YES if the data got queued
+ */
+- (BOOL)sendData:(NSData *)data policy:(TMFSendQueuePolicy)policy key:(NSString *)key error:(NSError **)error;
+
+/**
+ Enables or disables Nagle's algorithm for the session's socket.
+ Sessions carrying real time commands should disable the delay.
+ @param noDelay YES to set TCP_NODELAY
+ */
+- (void)setNoDelay:(BOOL)noDelay;
+
+/**
+ YES if the session's socket got disconnected and it should not be used anymore.
+ */
+- (BOOL)isDisconnected;
+
+/**
+ Key identifying a session for a peer endpoint.
+ @param peer The destination peer.
+ @param port The destination port.
+ @return key string
+ */
++ (NSString *)keyForPeer:(TMFPeer *)peer port:(NSUInteger)port;
+
+@end
@@ -0,0 +1,308 @@
+//
+//  TMFTcpChannelSession.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFTcpChannelSession.h"
+#import "TMFTcpChannelConnection.h"
+#import "TMFFrameDecoder.h"
+#import "TMFSendQueue.h"
+#import "TMFError.h"
+#import "TMFLog.h"
+
+#import <sys/socket.h>
+#include <netinet/tcp.h>
+
+#define TMF_SEND_WINDOW 2 /* writes handed to the socket at once */
+
+@interface TMFTcpChannelSession() {
+    TMFFrameDecoder *_decoder;
+    NSError *_failure;
+    BOOL _noDelay;
+
+    // bounded send queue, guarded by the lock
+    NSLock *_sendLock;
+    TMFSendQueue *_sendQueue;
+    NSUInteger _writing;
+    BOOL _closed;
+}
+@end
+
+@implementation TMFTcpChannelSession
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithPeer:(TMFPeer *)peer port:(NSUInteger)port protocol:(TMFProtocol *)protocol delegate:(NSObject<TMFTcpChannelSessionDelegate> *)delegate delegateQueue:(dispatch_queue_t)delegateQueue socketQueue:(dispatch_queue_t)socketQueue {
+    NSParameterAssert(peer!=nil);
+    NSParameterAssert(delegate!=nil);
+
+    self = [self init];
+    if(self) {
+        _peer = peer;
+        _port = port;
+        _protocol = protocol;
+        _delegate = delegate;
+        _decoder = [[TMFFrameDecoder alloc] initWithProtocol:protocol];
+        _decoder.legacyFraming = ([protocol frameOptionsForPeer:peer] & TMFFrameOptionLegacyHeader) != 0; // responses come in the format of our requests
+        _sendLock = [NSLock new];
+        _sendQueue = [TMFSendQueue new];
+        _socket = [[GCDAsyncSocket alloc] initWithDelegate:self delegateQueue:delegateQueue socketQueue:socketQueue];
+        [_socket setUserData:peer];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_socket setDelegate:nil];
+    [_socket disconnect];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
++ (NSString *)keyForPeer:(TMFPeer *)peer port:(NSUInteger)port {
+    return [NSString stringWithFormat:@"%@:%@", peer.UUID, @(port)];
+}
+
+- (BOOL)connect:(NSError **)error {
+    TMFLogVerbose(@"Trying to connect to %@:%@", self.peer.hostName, @(self.port));
+    // connect to the resolved endpoint, the host name would get resolved again
+    NSData *address = [self.peer addressForPort:self.port];
+    BOOL connecting = address ? [self.socket connectToAddress:address error:error] : [self.socket connectToHost:self.peer.hostName onPort:self.port error:error];
+    if(connecting) {
+        [self readNextResponse];
+    }
+    return connecting;
+}
+
+- (void)disconnect {
+    [self.socket disconnect];
+}
+
+- (void)sendData:(NSData *)data {
+    [self sendData:data policy:TMFSendQueuePolicyReject key:nil error:NULL];
+}
+
+- (BOOL)sendData:(NSData *)data policy:(TMFSendQueuePolicy)policy key:(NSString *)key error:(NSError **)error {
+    if(!data) {
+        return NO;
+    }
+
+    [_sendLock lock];
+    BOOL closed = _closed;
+    BOOL queued = !closed && [_sendQueue enqueueData:data policy:policy key:key];
+    [self writePendingData];
+    [_sendLock unlock];
+
+    if(!queued) {
+        if(policy == TMFSendQueuePolicyReject) {
+            TMFLogError(@"Send queue of %@ is full, rejecting %@.", self, key);
+        }
+        else {
+            TMFLogVerbose(@"Send queue of %@ is full, dropping %@.", self, key);
+        }
+        if(error) {
+            *error = [TMFError errorForCode:TMFChannelErrorCode message:(closed ? @"Session closed before sending." : @"Send queue is full.")];
+        }
+    }
+    return queued;
+}
+
+- (NSUInteger)maximumQueuedMessages {
+    [_sendLock lock];
+    NSUInteger maximum = _sendQueue.maximumMessages;
+    [_sendLock unlock];
+    return maximum;
+}
+
+- (void)setMaximumQueuedMessages:(NSUInteger)maximumQueuedMessages {
+    [_sendLock lock];
+    _sendQueue.maximumMessages = maximumQueuedMessages;
+    [_sendLock unlock];
+}
+
+- (NSUInteger)maximumQueuedBytes {
+    [_sendLock lock];
+    NSUInteger maximum = _sendQueue.maximumBytes;
+    [_sendLock unlock];
+    return maximum;
+}
+
+- (void)setMaximumQueuedBytes:(NSUInteger)maximumQueuedBytes {
+    [_sendLock lock];
+    _sendQueue.maximumBytes = maximumQueuedBytes;
+    [_sendLock unlock];
+}
+
+- (void)setNoDelay:(BOOL)noDelay {
+    [self.socket performBlock:^{
+        if(_noDelay != noDelay) {
+            _noDelay = noDelay;
+            [self applyNoDelay];
+        }
+    }];
+}
+
+- (BOOL)isDisconnected {
+    return [self.socket isDisconnected];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Override
+//............................................................................
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p %@:%@>", NSStringFromClass([self class]), self, self.peer.hostName, @(self.port)];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Delegates
+//............................................................................
+
+#pragma mark GCDAsyncSocketDelegate
+/**
+ * Called when a socket connects and is ready for reading and writing.
+ **/
+- (void)socket:(GCDAsyncSocket *)sock didConnectToHost:(NSString *)host port:(uint16_t)port {
+    TMFLogVerbose(@"Connected to %@:%@", host, @(port));
+    [sock performBlock:^{
+        if(_noDelay) {
+            [self applyNoDelay];
+        }
+    }];
+}
+
+/**
+ * Called when a socket has completed reading the requested data into memory.
+ * Not called if there is an error.
+ **/
+- (void)socket:(GCDAsyncSocket *)sock didReadData:(NSData *)data withTag:(long)tag {
+    if(tag == RESPONSE_STREAM_TAG) {
+        NSMutableArray *responses = [NSMutableArray new];
+        __block BOOL empty = NO;
+        NSError *error = nil;
+        BOOL valid = [_decoder decodeReadData:data frames:^(NSData *body, uint8_t flags) {
+            TMFResponse *response = [self.protocol responseFromData:body flags:flags];
+            if(response) {
+                [responses addObject:response];
+            }
+            else {
+                empty = YES;
+            }
+        } error:&error];
+
+        if([responses count] > 0) {
+            [self.delegate session:self didReadResponses:responses];
+        }
+
+        if(valid && empty) {
+            valid = NO;
+            error = [TMFError errorForCode:TMFChannelErrorCode message:@"Received empty TMFResponse"];
+        }
+
+        if(valid) {
+            [self readNextResponse];
+        }
+        else {
+            TMFLogError(@"Invalid response (%@)", error);
+            [self failWithError:error];
+        }
+    }
+}
+
+/**
+ * Called when a socket has completed writing the requested data. Not called if there is an error.
+ **/
+- (void)socket:(GCDAsyncSocket *)sock didWriteDataWithTag:(long)tag {
+    if(tag == REQUEST_SEND_TAG) {
+        [_sendLock lock];
+        _writing--;
+        [self writePendingData];
+        [_sendLock unlock];
+    }
+}
+
+/**
+ * Called when a socket disconnects with or without error.
+ *
+ * If you call the disconnect method, and the socket wasn't already disconnected,
+ * this delegate method will be called before the disconnect method returns.
+ **/
+- (void)socketDidDisconnect:(GCDAsyncSocket *)sock withError:(NSError *)error {
+    if(!error) {
+        error = _failure;
+    }
+
+    if(error && error.code != GCDAsyncSocketClosedError) {
+        TMFLogError(@"TCP Session (%@) disconnected with Error: %@", self, error);
+    }
+
+    // queued requests will never be written
+    [_sendLock lock];
+    _closed = YES;
+    [_sendQueue removeAllData];
+    [_sendLock unlock];
+
+    [self.delegate session:self didDisconnectWithError:error];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (void)readNextResponse {
+    // no socket timeout, the response callback table expires single requests
+    [_decoder readFromSocket:_socket timeout:-1 tag:RESPONSE_STREAM_TAG];
+}
+
+- (void)writePendingData {
+    // the socket queues writes without limit, only hand over a small window
+    while(!_closed && _writing < TMF_SEND_WINDOW && [_sendQueue count] > 0) {
+        _writing++;
+        [_socket writeData:[_sendQueue dequeueData] withTimeout:TIMEOUT tag:REQUEST_SEND_TAG];
+    }
+}
+
+- (void)failWithError:(NSError *)error {
+    // the stream is out of sync, there is no way to recover
+    _failure = error;
+    [_socket disconnect];
+}
+
+- (void)applyNoDelay {
+    // set Nagle delayed ack algorithm
+    // http://www.unixguide.net/network/socketfaq/2.16.shtml
+    // http://www.stuartcheshire.org/papers/NagleDelayedAck/
+    int socketFD = [_socket socketFD];
+    if(socketFD >= 0) {
+        int flag = _noDelay ? 1 : 0;
+        if (setsockopt(socketFD, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof(int)) != 0) {
+            TMFLogError(@"Could not set TCP_NODELAY.");
+        }
+    }
+}
+
+@end
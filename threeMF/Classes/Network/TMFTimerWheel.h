@@ -0,0 +1,90 @@
+//
+//  TMFTimerWheel.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Hierarchical timer wheel used to expire large numbers of timeouts in O(1) per entry.
+
+ Entries are identified by a key and placed into the slot of their deadline tick. Near deadlines live in the
+ finest level, each further level covers a range slots times larger with a coarser resolution. Entries cascade
+ down one level whenever the finer level completed a revolution, so fine ticks and long deadlines can be mixed
+ without scanning. The wheel is not thread safe, owners have to synchronize access.
+ */
+@interface TMFTimerWheel : NSObject
+
+/**
+ Duration of one tick in seconds. Deadlines are rounded up to whole ticks.
+ */
+@property (nonatomic, readonly) NSTimeInterval tickInterval;
+
+/**
+ Number of scheduled entries.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ Initializes a new instance with four levels.
+ @param tickInterval Duration of one tick in seconds. Must be greater than 0.
+ @param slots Number of slots of each level. Must be greater than 0, gets rounded up to a power of two.
+ */
+- (id)initWithTickInterval:(NSTimeInterval)tickInterval slots:(NSUInteger)slots;
+
+/**
+ Initializes a new instance.
+ @param tickInterval Duration of one tick in seconds. Must be greater than 0.
+ @param slots Number of slots of each level. Must be greater than 0, gets rounded up to a power of two.
+ @param levels Number of levels. Must be greater than 0. Deadlines beyond the range of all levels get rescheduled until they expire.
+ */
+- (id)initWithTickInterval:(NSTimeInterval)tickInterval slots:(NSUInteger)slots levels:(NSUInteger)levels;
+
+/**
+ Schedules a key for expiration. A previously scheduled entry for the same key gets replaced.
+ @param key The key identifying the entry. Must not be nil.
+ @param timeout Time in seconds from now until the entry expires.
+ */
+- (void)scheduleKey:(id<NSCopying>)key timeout:(NSTimeInterval)timeout;
+
+/**
+ Removes a scheduled entry.
+ @param key The key identifying the entry.
+ */
+- (void)cancelKey:(id<NSCopying>)key;
+
+/**
+ Removes all scheduled entries.
+ */
+- (void)removeAllKeys;
+
+/**
+ Advances the wheel to the given time and removes all expired entries.
+ @param time Reference date based time, see [NSDate timeIntervalSinceReferenceDate].
+ @return the keys of all expired entries
+ */
+- (NSArray *)advanceToTime:(NSTimeInterval)time;
+
+@end
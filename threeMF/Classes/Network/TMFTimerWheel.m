@@ -0,0 +1,232 @@
+//
+//  TMFTimerWheel.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFTimerWheel.h"
+
+#define TMF_TIMER_WHEEL_LEVELS 4
+
+@interface TMFTimerWheel() {
+    NSArray *_levels;                // NSArray of NSMutableSet slots per level
+    NSMutableDictionary *_deadlines; // key -> deadline tick
+    NSMutableDictionary *_locations; // key -> NSIndexPath (level, slot)
+    NSUInteger _slotBits;
+    uint64_t _slotMask;
+    uint64_t _nextTick;              // next tick to process
+}
+@end
+
+@implementation TMFTimerWheel
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithTickInterval:(NSTimeInterval)tickInterval slots:(NSUInteger)slots {
+    return [self initWithTickInterval:tickInterval slots:slots levels:TMF_TIMER_WHEEL_LEVELS];
+}
+
+- (id)initWithTickInterval:(NSTimeInterval)tickInterval slots:(NSUInteger)slots levels:(NSUInteger)levels {
+    NSParameterAssert(tickInterval > 0);
+    NSParameterAssert(slots > 0);
+    NSParameterAssert(levels > 0);
+
+    self = [super init];
+    if(self) {
+        _tickInterval = tickInterval;
+
+        // power of two slots, the slot of a level is a bit range of the deadline tick
+        _slotBits = 0;
+        while(((NSUInteger)1 << _slotBits) < slots) {
+            _slotBits++;
+        }
+        _slotMask = ((uint64_t)1 << _slotBits) - 1;
+        levels = MAX((NSUInteger)1, MIN(levels, (NSUInteger)(63 / MAX(_slotBits, (NSUInteger)1))));
+
+        NSMutableArray *wheel = [NSMutableArray arrayWithCapacity:levels];
+        for(NSUInteger level = 0; level < levels; level++) {
+            NSMutableArray *levelSlots = [NSMutableArray arrayWithCapacity:(NSUInteger)(_slotMask + 1)];
+            for(uint64_t i = 0; i <= _slotMask; i++) {
+                [levelSlots addObject:[NSMutableSet new]];
+            }
+            [wheel addObject:[NSArray arrayWithArray:levelSlots]];
+        }
+        _levels = [NSArray arrayWithArray:wheel];
+        _deadlines = [NSMutableDictionary new];
+        _locations = [NSMutableDictionary new];
+        _nextTick = [self tickForTime:[NSDate timeIntervalSinceReferenceDate]] + 1;
+    }
+    return self;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
+- (NSUInteger)count {
+    return [_deadlines count];
+}
+
+- (void)scheduleKey:(id<NSCopying>)key timeout:(NSTimeInterval)timeout {
+    NSParameterAssert(key!=nil);
+    [self cancelKey:key];
+
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    if([_deadlines count] == 0) {
+        // an empty wheel is usually not advanced, skip the ticks passed meanwhile
+        _nextTick = MAX(_nextTick, [self tickForTime:now] + 1);
+    }
+
+    // round up, an entry never expires before its timeout
+    uint64_t deadline = (uint64_t)ceil((now + MAX(timeout, 0.0)) / _tickInterval);
+    deadline = MAX(deadline, _nextTick);
+
+    [_deadlines setObject:@(deadline) forKey:key];
+    [self placeKey:key deadline:deadline];
+}
+
+- (void)cancelKey:(id<NSCopying>)key {
+    NSIndexPath *location = [_locations objectForKey:key];
+    if(location) {
+        [[self slotAtLevel:[location indexAtPosition:0] index:[location indexAtPosition:1]] removeObject:key];
+        [_locations removeObjectForKey:key];
+        [_deadlines removeObjectForKey:key];
+    }
+}
+
+- (void)removeAllKeys {
+    for(NSArray *levelSlots in _levels) {
+        for(NSMutableSet *slot in levelSlots) {
+            [slot removeAllObjects];
+        }
+    }
+    [_deadlines removeAllObjects];
+    [_locations removeAllObjects];
+}
+
+- (NSArray *)advanceToTime:(NSTimeInterval)time {
+    uint64_t tick = [self tickForTime:time];
+    if(tick < _nextTick) {
+        return @[];
+    }
+
+    if(tick - _nextTick > _slotMask) {
+        // the finest level passed a whole revolution, placing all entries again is cheaper than visiting every tick
+        return [self rebuildForTick:tick];
+    }
+
+    NSMutableArray *expired = [NSMutableArray new];
+    while(_nextTick <= tick) {
+        if([_deadlines count] == 0) {
+            // nothing to cascade or expire
+            _nextTick = tick + 1;
+            break;
+        }
+
+        // a finer level completed a revolution, move the next coarser slot down
+        NSUInteger index = (NSUInteger)(_nextTick & _slotMask);
+        for(NSUInteger level = 1; index == 0 && level < [_levels count]; level++) {
+            index = (NSUInteger)((_nextTick >> (_slotBits * level)) & _slotMask);
+            [self cascadeLevel:level index:index];
+        }
+
+        NSMutableSet *slot = [self slotAtLevel:0 index:(NSUInteger)(_nextTick & _slotMask)];
+        for(id key in [slot allObjects]) {
+            [slot removeObject:key];
+            [_locations removeObjectForKey:key];
+            uint64_t deadline = [[_deadlines objectForKey:key] unsignedLongLongValue];
+            if(deadline <= _nextTick) {
+                [_deadlines removeObjectForKey:key];
+                [expired addObject:key];
+            }
+            else {
+                // beyond the range of the wheel when it got scheduled
+                [self placeKey:key deadline:deadline];
+            }
+        }
+        _nextTick++;
+    }
+
+    return expired;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (uint64_t)tickForTime:(NSTimeInterval)time {
+    return (uint64_t)floor(time / _tickInterval);
+}
+
+- (NSMutableSet *)slotAtLevel:(NSUInteger)level index:(NSUInteger)index {
+    return [[_levels objectAtIndex:level] objectAtIndex:index];
+}
+
+- (void)placeKey:(id)key deadline:(uint64_t)deadline {
+    uint64_t delta = deadline > _nextTick ? deadline - _nextTick : 0;
+    NSUInteger levels = [_levels count];
+
+    // the finest level covering the delta
+    NSUInteger level = 0;
+    while(level + 1 < levels && delta >= ((uint64_t)1 << (_slotBits * (level + 1)))) {
+        level++;
+    }
+
+    // deadlines beyond the top level get placed at its end and rescheduled from there
+    uint64_t range = (uint64_t)1 << (_slotBits * levels);
+    uint64_t tick = delta < range ? deadline : _nextTick + range - 1;
+
+    NSUInteger index = (NSUInteger)((tick >> (_slotBits * level)) & _slotMask);
+    [[self slotAtLevel:level index:index] addObject:key];
+    NSUInteger location[2] = { level, index };
+    [_locations setObject:[NSIndexPath indexPathWithIndexes:location length:2] forKey:key];
+}
+
+- (NSArray *)rebuildForTick:(uint64_t)tick {
+    NSMutableArray *expired = [NSMutableArray new];
+    NSDictionary *deadlines = [_deadlines copy];
+    [self removeAllKeys];
+    _nextTick = tick + 1;
+
+    [deadlines enumerateKeysAndObjectsUsingBlock:^(id key, NSNumber *deadline, __unused BOOL *stop) {
+        if([deadline unsignedLongLongValue] <= tick) {
+            [expired addObject:key];
+        }
+        else {
+            [_deadlines setObject:deadline forKey:key];
+            [self placeKey:key deadline:[deadline unsignedLongLongValue]];
+        }
+    }];
+    return expired;
+}
+
+- (void)cascadeLevel:(NSUInteger)level index:(NSUInteger)index {
+    NSMutableSet *slot = [self slotAtLevel:level index:index];
+    NSArray *keys = [slot allObjects];
+    [slot removeAllObjects];
+    for(id key in keys) {
+        [self placeKey:key deadline:[[_deadlines objectForKey:key] unsignedLongLongValue]];
+    }
+}
+
+@end
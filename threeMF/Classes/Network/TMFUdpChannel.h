@@ -41,6 +41,12 @@
  */
 @property (nonatomic, copy) NSString * multiCastGroup;
 
+/**
+ Maximum size of a single datagram. Larger messages get split into several datagrams and reassembled by the receiver.
+ The default value is 9216 bytes, the default maximum datagram size of Darwin's UDP stack. Set it to the path MTU's payload size (e.g. 1472) to avoid IP fragmentation.
+ */
+@property (nonatomic) NSUInteger maximumDatagramSize;
+
 /**
  Creates a new instance
  @param port port the channel should be bound to
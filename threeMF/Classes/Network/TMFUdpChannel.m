@@ -23,7 +23,12 @@
 // THE SOFTWARE.
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* sendmmsg, recvmmsg */
+#endif
+
 #import "TMFUdpChannel.h"
+#import "TMFUdpReassemblyTable.h"
 #import "GCDAsyncUdpSocket.h"
 #import "TMFPeer.h"
 #import "TMFCommand.h"
@@ -33,15 +38,91 @@
 
 #import "TMFPublishSubscribeCommand.h"
 
+#import <sys/socket.h>
+#import <sys/uio.h>
+
+#define TMF_UDP_MAX_DATAGRAM 9216
+#define TMF_UDP_BATCH        64   /* datagrams per sendmmsg/recvmmsg call */
+
+/**
+ Datagram of a send batch, the objects are retained by the caller
+ */
+typedef struct {
+    __unsafe_unretained NSData *data;
+    __unsafe_unretained NSData *address;
+} TMFUdpPendingDatagram;
+
+/**
+ Sends up to TMF_UDP_BATCH datagrams with as few syscalls as possible.
+ @return number of sent datagrams, sending stops at the first failure (e.g. EAGAIN)
+ */
+static NSUInteger TMFUdpSendBatch(int fd, struct msghdr *messages, NSUInteger count) {
+#if defined(__linux__)
+    struct mmsghdr batch[TMF_UDP_BATCH];
+    memset(batch, 0, sizeof(batch));
+    for(NSUInteger i = 0; i < count; i++) {
+        batch[i].msg_hdr = messages[i];
+    }
+
+    NSUInteger sent = 0;
+    while(sent < count) {
+        int result = sendmmsg(fd, batch + sent, (unsigned int)(count - sent), 0);
+        if(result <= 0) {
+            break;
+        }
+        sent += (NSUInteger)result;
+    }
+    return sent;
+#else
+    NSUInteger sent = 0;
+    while(sent < count && sendmsg(fd, &messages[sent], 0) >= 0) {
+        sent++;
+    }
+    return sent;
+#endif
+}
+
+#if defined(__linux__)
+/**
+ Receives up to TMF_UDP_BATCH datagrams of TMF_UDP_MAX_DATAGRAM bytes into buffer without blocking.
+ @return number of received datagrams, their lengths are stored in the message headers
+ */
+static NSUInteger TMFUdpReceiveBatch(int fd, struct mmsghdr *batch, struct iovec *vectors, struct sockaddr_storage *addresses, uint8_t *buffer) {
+    memset(batch, 0, sizeof(struct mmsghdr) * TMF_UDP_BATCH);
+    for(NSUInteger i = 0; i < TMF_UDP_BATCH; i++) {
+        vectors[i].iov_base = buffer + i * TMF_UDP_MAX_DATAGRAM;
+        vectors[i].iov_len = TMF_UDP_MAX_DATAGRAM;
+        batch[i].msg_hdr.msg_name = &addresses[i];
+        batch[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        batch[i].msg_hdr.msg_iov = &vectors[i];
+        batch[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int result = recvmmsg(fd, batch, TMF_UDP_BATCH, MSG_DONTWAIT, NULL);
+    return (result > 0) ? (NSUInteger)result : 0;
+}
+#endif
+
 @interface TMFUdpChannel() <GCDAsyncUdpSocketDelegate> {
     GCDAsyncUdpSocket *_socket;
+    TMFUdpReassemblyTable *_reassemblyTable;
     dispatch_queue_t _socketQueue;
     dispatch_queue_t _socketDelegationQueue;
+    int _socket4FD;
+    int _socket6FD;
     
     startCompletionBlock_t _startupCompletionBlock;
     stopCompletionBlock_t _shutdownCompletionBlock;
 
     NSLock *_startupLock;
+
+    NSLock *_receiveLock;
+    NSMutableArray *_receivedRequests;
+    NSMutableArray *_receivedAddresses;
+    BOOL _deliveryScheduled;
+    dispatch_source_t _receive4Source;
+    dispatch_source_t _receive6Source;
+    NSMutableData *_receiveBuffer;
 }
 @end
 
@@ -54,6 +135,13 @@
     self = [super init];
     if (self) {
         _startupLock = [NSLock new];
+        _maximumDatagramSize = TMF_UDP_MAX_DATAGRAM;
+        _reassemblyTable = [TMFUdpReassemblyTable new];
+        _receiveLock = [NSLock new];
+        _receivedRequests = [NSMutableArray new];
+        _receivedAddresses = [NSMutableArray new];
+        _socket4FD = -1;
+        _socket6FD = -1;
         _socketQueue = dispatch_queue_create("tmf.channel.udp.queue", DISPATCH_QUEUE_SERIAL);
         _socketDelegationQueue = dispatch_queue_create("tmf.channel.udp.working", DISPATCH_QUEUE_SERIAL);
         [self performBlockOnSocketQueue:^{
@@ -76,6 +164,7 @@
 }
 
 - (void)dealloc {
+    [self invalidateSocketDescriptors];
 #if ARC_HANDLES_QUEUES
     dispatch_release(_socketQueue);
     dispatch_release(_socketDelegationQueue);
@@ -146,13 +235,21 @@
     }
 
     [self performBlockOnSocketQueue:^{
-        NSData *data = [self.protocol requestDataForCommand:command arguments:arguments];
-        if([[command class] isMulticast]) {
-            TMFLog(@"Multicasting");
-            [_socket sendData:data toHost:_multiCastGroup port:self.port withTimeout:-1 tag:0];
-        }
-        else {
-            [_socket sendData:data toHost:peer.hostName port:[peer portForCommandName:command.name] withTimeout:-1 tag:0];
+        // receivers pick the framing by our protocol version, multicasts are compact and never compressed
+        TMFFrameOption options = [[command class] isMulticast] ? 0 : [self.protocol frameOptionsForPeer:peer];
+        NSArray *datagrams = [self datagramsForCommand:command arguments:arguments options:options];
+        NSData *address = [[command class] isMulticast] ? nil : [peer addressForCommandName:command.name];
+        for(NSData *data in datagrams) {
+            if([[command class] isMulticast]) {
+                TMFLog(@"Multicasting");
+                [_socket sendData:data toHost:_multiCastGroup port:self.port withTimeout:-1 tag:0];
+            }
+            else if(address) {
+                [_socket sendData:data toAddress:address withTimeout:-1 tag:0];
+            }
+            else {
+                [_socket sendData:data toHost:peer.hostName port:[peer portForCommandName:command.name] withTimeout:-1 tag:0];
+            }
         }
 
         // no responses
@@ -164,6 +261,31 @@
     }];
 }
 
+- (void)send:(TMFPublishSubscribeCommand *)command arguments:(TMFArguments *)arguments destinations:(NSArray *)peers {
+    NSParameterAssert(command!=nil);
+    NSParameterAssert([command isKindOfClass:[TMFPublishSubscribeCommand class]]);
+
+    [self performBlockOnSocketQueue:^{
+        // one set of encoded datagrams per framing, sent in batches
+        // compressed and interned if every 2.x peer supports it, 1.0 peers get legacy frames
+        TMFFrameOption options = TMFFrameOptionCompress | TMFFrameOptionCommandIdentifier;
+        NSMutableArray *compactPeers = [NSMutableArray arrayWithCapacity:[peers count]];
+        NSMutableArray *legacyPeers = [NSMutableArray array];
+        for(TMFPeer *peer in peers) {
+            TMFFrameOption peerOptions = [self.protocol frameOptionsForPeer:peer];
+            if(peerOptions & TMFFrameOptionLegacyHeader) {
+                [legacyPeers addObject:peer];
+            }
+            else {
+                [compactPeers addObject:peer];
+                options &= peerOptions;
+            }
+        }
+        [self send:command arguments:arguments options:options peers:compactPeers];
+        [self send:command arguments:arguments options:TMFFrameOptionLegacyHeader peers:legacyPeers];
+    }];
+}
+
 - (void)start:(startCompletionBlock_t)completionBlock {
     [self performBlockOnSocketQueue:^{
         [_startupLock lock];
@@ -171,7 +293,7 @@
             NSError *error = nil;            
             if(![self isRunning]) {
                 if([_socket bindToPort:super.port error:&error]) {
-                    if([_socket beginReceiving:&error]) {
+                    if([self beginReceiving:&error]) {
                         if(_multiCastGroup && [_multiCastGroup length]>0) {
                             [self joinMulticastGroup:_multiCastGroup error:&error];
                         }
@@ -194,12 +316,14 @@
         }
         [_startupLock unlock];
     }];
+    [self updateSocketDescriptors];
 }
 
 - (void)stop:(stopCompletionBlock_t)completionBlock {
     [self performBlockOnSocketQueue:^{
         @autoreleasepool {
             _shutdownCompletionBlock = [completionBlock copy];
+            [self invalidateSocketDescriptors];
             [_socket close];
             _running = NO;
         }
@@ -215,13 +339,7 @@
  * Called when the socket has received the requested datagram.
  **/
 - (void)udpSocket:(GCDAsyncUdpSocket *)sock didReceiveData:(NSData *)data fromAddress:(NSData *)address withFilterContext:(id)filterContext {
-    if(data) {
-        NSData *datawithoutHeader = [data subdataWithRange:NSMakeRange(self.protocol.publishSubscribeHeaderLength, [data length] - self.protocol.publishSubscribeHeaderLength)];
-        TMFRequest *request = [self.protocol requestFromData:datawithoutHeader];
-        dispatch_async(self.delegate.callbackQueue, ^{
-            [self.delegate receiveOnChannel:self commandName:request.commandName arguments:request.arguments address:address response:nil];
-        });
-    }
+    [self receiveDatagram:data fromAddress:address];
 }
 
 /**
@@ -232,6 +350,15 @@
         TMFLogError(@"UDP Socket disconnected with Error: %@", error);
     }
 
+    // closed by the socket itself, the descriptors may be reused by the system from now on
+    if(error) {
+        dispatch_async(_socketQueue, ^{
+            [self invalidateSocketDescriptors];
+        });
+    }
+
+    [_reassemblyTable removeAllFragments];
+
     if (_shutdownCompletionBlock) {
         dispatch_async(self.delegate.callbackQueue, ^{
             _shutdownCompletionBlock();
@@ -243,6 +370,244 @@
 #pragma mark -
 #pragma mark Private
 //............................................................................
+- (void)receiveDatagram:(NSData *)data fromAddress:(NSData *)address {
+    // must be called on the socket delegation queue
+    if(data) {
+        TMFFragmentHeader fragmentHeader;
+        NSData *body = [self.protocol bodyOfBroadcastPackage:data legacy:[self legacyFramingForAddress:address] fragmentHeader:&fragmentHeader];
+        if(body && fragmentHeader.count > 0) {
+            body = [_reassemblyTable addFragment:body header:fragmentHeader fromAddress:address];
+            if(!body) {
+                return; // waiting for more fragments
+            }
+        }
+
+        TMFRequest *request = body ? [self.protocol requestFromData:body flags:fragmentHeader.flags] : nil;
+        if(request) {
+            [self enqueueReceivedRequest:request fromAddress:address];
+        }
+        else {
+            TMFLogError(@"Dropping invalid datagram of %@ bytes from %@.", @([data length]), [GCDAsyncUdpSocket hostFromAddress:address]);
+        }
+    }
+}
+
+- (BOOL)beginReceiving:(NSError *__autoreleasing *)error {
+#if defined(__linux__)
+    // the channel reads the descriptors itself in batches, see updateSocketDescriptors
+    return YES;
+#else
+    return [_socket beginReceiving:error];
+#endif
+}
+
+- (void)updateSocketDescriptors {
+    // the vendored socket only hands out its descriptors outside of its queue
+    int fd4 = [_socket socket4FD];
+    int fd6 = [_socket socket6FD];
+    [self performBlockOnSocketQueue:^{
+        if(![self isRunning] || _socket4FD >= 0 || _socket6FD >= 0) {
+            return;
+        }
+        _socket4FD = fd4;
+        _socket6FD = fd6;
+#if defined(__linux__)
+        _receive4Source = [self receiveSourceForDescriptor:_socket4FD];
+        _receive6Source = [self receiveSourceForDescriptor:_socket6FD];
+#endif
+    }];
+}
+
+- (void)invalidateSocketDescriptors {
+    // must be called on the socket queue, before the socket closes the descriptors
+    if(_receive4Source) {
+        dispatch_source_cancel(_receive4Source);
+#if ARC_HANDLES_QUEUES
+        dispatch_release(_receive4Source);
+#endif
+        _receive4Source = NULL;
+    }
+    if(_receive6Source) {
+        dispatch_source_cancel(_receive6Source);
+#if ARC_HANDLES_QUEUES
+        dispatch_release(_receive6Source);
+#endif
+        _receive6Source = NULL;
+    }
+    _socket4FD = -1;
+    _socket6FD = -1;
+}
+
+#if defined(__linux__)
+- (dispatch_source_t)receiveSourceForDescriptor:(int)fd {
+    if(fd < 0) {
+        return NULL;
+    }
+
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, _socketQueue);
+    __weak TMFUdpChannel *weakSelf = self;
+    dispatch_source_set_event_handler(source, ^{ [weakSelf receiveOnDescriptor:fd]; });
+    dispatch_resume(source);
+    return source;
+}
+
+- (void)receiveOnDescriptor:(int)fd {
+    // must be called on the socket queue, the source fires again while datagrams are left
+    if(!_receiveBuffer) {
+        _receiveBuffer = [NSMutableData dataWithLength:TMF_UDP_BATCH * TMF_UDP_MAX_DATAGRAM];
+    }
+
+    struct mmsghdr batch[TMF_UDP_BATCH];
+    struct iovec vectors[TMF_UDP_BATCH];
+    struct sockaddr_storage addresses[TMF_UDP_BATCH];
+    NSUInteger count = TMFUdpReceiveBatch(fd, batch, vectors, addresses, [_receiveBuffer mutableBytes]);
+    if(count == 0) {
+        return;
+    }
+
+    NSMutableArray *datagrams = [NSMutableArray arrayWithCapacity:count];
+    NSMutableArray *sources = [NSMutableArray arrayWithCapacity:count];
+    for(NSUInteger i = 0; i < count; i++) {
+        if(batch[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            TMFLogError(@"Dropping datagram larger than %@ bytes.", @(TMF_UDP_MAX_DATAGRAM));
+            continue;
+        }
+        [datagrams addObject:[NSData dataWithBytes:vectors[i].iov_base length:batch[i].msg_len]];
+        [sources addObject:[NSData dataWithBytes:&addresses[i] length:batch[i].msg_hdr.msg_namelen]];
+    }
+
+    dispatch_async(_socketDelegationQueue, ^{
+        [datagrams enumerateObjectsUsingBlock:^(NSData *data, NSUInteger idx, __unused BOOL *stop) {
+            [self receiveDatagram:data fromAddress:[sources objectAtIndex:idx]];
+        }];
+    });
+}
+#endif
+
+- (void)sendDatagrams:(NSArray *)datagrams toAddresses:(NSArray *)addresses {
+    // must be called on the socket queue
+    int fd4 = _socket4FD;
+    int fd6 = _socket6FD;
+
+    struct msghdr messages[TMF_UDP_BATCH];
+    struct iovec vectors[TMF_UDP_BATCH];
+    TMFUdpPendingDatagram pending[TMF_UDP_BATCH];
+    NSUInteger count = 0;
+    int batchFD = -1;
+
+    for(NSData *address in addresses) {
+        const struct sockaddr *sockaddr = [address bytes];
+        int fd = (sockaddr->sa_family == AF_INET6) ? fd6 : fd4;
+
+        for(NSData *data in datagrams) {
+            if(count > 0 && (count == TMF_UDP_BATCH || fd != batchFD)) {
+                [self flushDatagrams:pending messages:messages count:count fd:batchFD];
+                count = 0;
+            }
+
+            if(fd < 0) {
+                // socket for the address family not created yet, let the socket handle it
+                [_socket sendData:data toAddress:address withTimeout:-1 tag:0];
+                continue;
+            }
+
+            batchFD = fd;
+            vectors[count].iov_base = (void *)[data bytes];
+            vectors[count].iov_len = [data length];
+            memset(&messages[count], 0, sizeof(struct msghdr));
+            messages[count].msg_name = (void *)sockaddr;
+            messages[count].msg_namelen = (socklen_t)[address length];
+            messages[count].msg_iov = &vectors[count];
+            messages[count].msg_iovlen = 1;
+            pending[count].data = data;
+            pending[count].address = address;
+            count++;
+        }
+    }
+
+    if(count > 0) {
+        [self flushDatagrams:pending messages:messages count:count fd:batchFD];
+    }
+}
+
+- (void)flushDatagrams:(TMFUdpPendingDatagram *)pending messages:(struct msghdr *)messages count:(NSUInteger)count fd:(int)fd {
+    NSUInteger sent = TMFUdpSendBatch(fd, messages, count);
+
+    // the socket's send buffer is full, queue the rest on the socket
+    for(NSUInteger i = sent; i < count; i++) {
+        [_socket sendData:pending[i].data toAddress:pending[i].address withTimeout:-1 tag:0];
+    }
+}
+
+- (void)enqueueReceivedRequest:(TMFRequest *)request fromAddress:(NSData *)address {
+    [_receiveLock lock];
+    [_receivedRequests addObject:request];
+    [_receivedAddresses addObject:address];
+    BOOL schedule = !_deliveryScheduled;
+    _deliveryScheduled = YES;
+    [_receiveLock unlock];
+
+    // requests received until the callback queue gets to it are delivered at once
+    if(schedule) {
+        dispatch_async(self.delegate.callbackQueue, ^{
+            [self deliverReceivedRequests];
+        });
+    }
+}
+
+- (void)deliverReceivedRequests {
+    [_receiveLock lock];
+    NSArray *requests = [_receivedRequests copy];
+    NSArray *addresses = [_receivedAddresses copy];
+    [_receivedRequests removeAllObjects];
+    [_receivedAddresses removeAllObjects];
+    _deliveryScheduled = NO;
+    [_receiveLock unlock];
+
+    [requests enumerateObjectsUsingBlock:^(TMFRequest *request, NSUInteger idx, __unused BOOL *stop) {
+        if(request.commandName) {
+            [self.delegate receiveOnChannel:self commandName:request.commandName arguments:request.arguments address:[addresses objectAtIndex:idx] response:nil];
+        }
+        else if(request.commandIdentifier != 0) {
+            [self.delegate receiveOnChannel:self commandIdentifier:request.commandIdentifier arguments:request.arguments address:[addresses objectAtIndex:idx]];
+        }
+        else {
+            TMFLogError(@"Dropping request without command from %@.", [TMFPeer stringFromAddressData:[addresses objectAtIndex:idx]]);
+        }
+    }];
+}
+
+- (void)send:(TMFPublishSubscribeCommand *)command arguments:(TMFArguments *)arguments options:(TMFFrameOption)options peers:(NSArray *)peers {
+    if([peers count] == 0) {
+        return;
+    }
+
+    NSArray *datagrams = [self datagramsForCommand:command arguments:arguments options:options];
+    NSMutableArray *addresses = [NSMutableArray arrayWithCapacity:[peers count]];
+    for(TMFPeer *peer in peers) {
+        NSData *address = [peer addressForCommandName:command.name];
+        if(address) {
+            [addresses addObject:address];
+        }
+        else {
+            for(NSData *data in datagrams) {
+                [_socket sendData:data toHost:peer.hostName port:[peer portForCommandName:command.name] withTimeout:-1 tag:0];
+            }
+        }
+    }
+    [self sendDatagrams:datagrams toAddresses:addresses];
+}
+
+- (NSArray *)datagramsForCommand:(TMFCommand *)command arguments:(TMFArguments *)arguments options:(TMFFrameOption)options {
+    // compression means fewer fragments, each lost one drops the whole message
+    NSData *data = [self.protocol requestDataForCommand:command arguments:arguments options:options];
+    NSArray *datagrams = [self.protocol broadcastPackagesForRequestData:data maxSize:self.maximumDatagramSize legacy:(options & TMFFrameOptionLegacyHeader) != 0];
+    if(!datagrams) {
+        TMFLogError(@"Message of %@ bytes is too large for %@.", @([data length]), NSStringFromClass([self class]));
+    }
+    return datagrams;
+}
+
 - (void)performBlockOnSocketQueue:(dispatch_block_t)block {
     dispatch_sync(_socketQueue, block);
 }
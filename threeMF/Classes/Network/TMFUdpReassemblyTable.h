@@ -0,0 +1,73 @@
+//
+//  TMFUdpReassemblyTable.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "TMFProtocol.h"
+
+/**
+ Bounded table reassembling requests split into several UDP broadcast packages.
+
+ Incomplete messages are dropped after a timeout or if the table exceeds its message or memory limits,
+ oldest messages get dropped first. The table is not thread safe and is meant to be used from a socket's delegate queue.
+ */
+@interface TMFUdpReassemblyTable : NSObject
+
+/**
+ Time in seconds an incomplete message waits for missing fragments.
+ */
+@property (nonatomic) NSTimeInterval timeout;
+
+/**
+ Maximum number of incomplete messages.
+ */
+@property (nonatomic) NSUInteger maximumMessages;
+
+/**
+ Maximum number of buffered fragment bytes of all incomplete messages.
+ */
+@property (nonatomic) NSUInteger maximumBytes;
+
+/**
+ Maximum number of fragments of one message, messages announcing more get ignored.
+ */
+@property (nonatomic) NSUInteger maximumFragments;
+
+/**
+ Adds a received fragment.
+ @param fragment The fragment body.
+ @param header The fragment header.
+ @param address The sender's address.
+ @return the reassembled message body if the fragment completed a message, otherwise nil
+ */
+- (NSData *)addFragment:(NSData *)fragment header:(TMFFragmentHeader)header fromAddress:(NSData *)address;
+
+/**
+ Drops all incomplete messages.
+ */
+- (void)removeAllFragments;
+
+@end
@@ -0,0 +1,184 @@
+//
+//  TMFUdpReassemblyTable.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFUdpReassemblyTable.h"
+#import "TMFLog.h"
+
+#define TMF_REASSEMBLY_TIMEOUT      2.0      /* seconds */
+#define TMF_REASSEMBLY_MESSAGES     64
+#define TMF_REASSEMBLY_BYTES        8388608  /* 8MB */
+#define TMF_REASSEMBLY_FRAGMENTS    1024     /* 9KB datagrams fill the byte limit with about 900 fragments */
+
+/**
+ Fragments received for one message
+ */
+@interface TMFUdpReassembly : NSObject
+@property (nonatomic, readonly) NSMutableArray *fragments;
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic) NSUInteger received;
+@property (nonatomic) NSUInteger bytes;
+@property (nonatomic, readonly) NSTimeInterval created;
+- (id)initWithCount:(NSUInteger)count;
+@end
+
+@implementation TMFUdpReassembly
+- (id)initWithCount:(NSUInteger)count {
+    self = [super init];
+    if(self) {
+        _count = count;
+        _fragments = [NSMutableArray arrayWithCapacity:count];
+        for(NSUInteger i = 0; i < count; i++) {
+            [_fragments addObject:[NSNull null]];
+        }
+        _created = [NSDate timeIntervalSinceReferenceDate];
+    }
+    return self;
+}
+@end
+
+@interface TMFUdpReassemblyTable() {
+    NSMutableDictionary *_messages;
+    NSMutableArray *_order;
+    NSUInteger _bytes;
+}
+@end
+
+@implementation TMFUdpReassemblyTable
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)init {
+    self = [super init];
+    if(self) {
+        _messages = [NSMutableDictionary new];
+        _order = [NSMutableArray new];
+        _timeout = TMF_REASSEMBLY_TIMEOUT;
+        _maximumMessages = TMF_REASSEMBLY_MESSAGES;
+        _maximumBytes = TMF_REASSEMBLY_BYTES;
+        _maximumFragments = TMF_REASSEMBLY_FRAGMENTS;
+    }
+    return self;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
+- (NSData *)addFragment:(NSData *)fragment header:(TMFFragmentHeader)header fromAddress:(NSData *)address {
+    if(header.count == 0 || header.index >= header.count || !address) {
+        return nil;
+    }
+
+    [self removeExpiredMessages];
+
+    if(header.count == 1) {
+        return fragment;
+    }
+
+    NSMutableData *key = [NSMutableData dataWithData:address];
+    [key appendBytes:&header.identifier length:sizeof(uint16_t)];
+
+    TMFUdpReassembly *message = [_messages objectForKey:key];
+    if(message && message.count != header.count) {
+        // identifier got reused by the sender
+        [self removeMessageForKey:key];
+        message = nil;
+    }
+
+    if(!message) {
+        if(header.count > self.maximumFragments) {
+            // the table of fragments would get allocated for a single datagram
+            TMFLogVerbose(@"Ignoring message of %@ fragments.", @(header.count));
+            return nil;
+        }
+        message = [[TMFUdpReassembly alloc] initWithCount:header.count];
+        [_messages setObject:message forKey:key];
+        [_order addObject:key];
+    }
+
+    if([message.fragments objectAtIndex:header.index] != [NSNull null]) {
+        return nil; // duplicate
+    }
+
+    [message.fragments replaceObjectAtIndex:header.index withObject:fragment];
+    message.received++;
+    message.bytes += [fragment length];
+    _bytes += [fragment length];
+
+    if(message.received == message.count) {
+        NSMutableData *body = [[NSMutableData alloc] initWithCapacity:message.bytes];
+        for(NSData *part in message.fragments) {
+            [body appendData:part];
+        }
+        [self removeMessageForKey:key];
+        return body;
+    }
+
+    [self enforceLimits];
+    return nil;
+}
+
+- (void)removeAllFragments {
+    [_messages removeAllObjects];
+    [_order removeAllObjects];
+    _bytes = 0;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (void)removeMessageForKey:(NSData *)key {
+    TMFUdpReassembly *message = [_messages objectForKey:key];
+    if(message) {
+        _bytes -= message.bytes;
+        [_messages removeObjectForKey:key];
+        [_order removeObject:key];
+    }
+}
+
+- (void)removeExpiredMessages {
+    // messages are ordered by creation time
+    NSTimeInterval limit = [NSDate timeIntervalSinceReferenceDate] - self.timeout;
+    while([_order count] > 0) {
+        NSData *key = [_order objectAtIndex:0];
+        TMFUdpReassembly *message = [_messages objectForKey:key];
+        if(message.created > limit) {
+            break;
+        }
+        TMFLogVerbose(@"Dropping incomplete message, received %@ of %@ fragments.", @(message.received), @(message.count));
+        [self removeMessageForKey:key];
+    }
+}
+
+- (void)enforceLimits {
+    while([_order count] > 0 && ([_order count] > self.maximumMessages || _bytes > self.maximumBytes)) {
+        TMFLogVerbose(@"Reassembly limits exceeded, dropping oldest incomplete message.");
+        [self removeMessageForKey:[_order objectAtIndex:0]];
+    }
+}
+
+@end
@@ -0,0 +1,85 @@
+//
+//  TMFUnixChannel.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "TMFChannel.h"
+
+@class TMFUnixStream;
+
+/**
+ TMFChannel implementation communicating via Unix domain stream sockets.
+
+ Peers running on the same host reach each other through a socket file instead of the loopback TCP stack.
+ The channel listens on a socket file in the temporary directory, its path gets published with the peer's TXT record.
+ Messages carry the same framing and coder as TMFTcpChannel. Each outgoing stream starts with a hello request
+ naming the sender's own socket path, so the receiving side can map incoming requests to the sending peer.
+ */
+@interface TMFUnixChannel : TMFChannel
+
+/**
+ Path of the socket file the channel listens on, nil if the channel is not running.
+ */
+@property (nonatomic, readonly, copy) NSString *socketPath;
+
+/**
+ Class of the streams the channel creates for incoming and outgoing connections.
+ Override this method in a sub-class to move messages by other means than the socket.
+ @return TMFUnixStream or a sub-class of it
+ */
++ (Class)streamClass;
+
+/**
+ Additional arguments of the hello opening an outgoing stream, the sender's socket path always comes first.
+ Called before the hello gets written, sub-classes may prepare the stream for a transport announced with it.
+ @param stream The new outgoing stream.
+ @return arguments following the socket path, the default is none
+ */
+- (NSArray *)helloArgumentsForStream:(TMFUnixStream *)stream;
+
+/**
+ Called after the hello got queued on a new outgoing stream.
+ @param stream The new outgoing stream.
+ @return NO to close the stream, the default is YES
+ */
+- (BOOL)didSendHelloOnStream:(TMFUnixStream *)stream;
+
+/**
+ Validates the additional hello arguments received on an incoming stream.
+ @param arguments The hello arguments following the sender's socket path.
+ @param stream The incoming stream.
+ @return NO to close the stream, the default only accepts no additional arguments
+ */
+- (BOOL)acceptHelloArguments:(NSArray *)arguments stream:(TMFUnixStream *)stream;
+
+/**
+ Creates a socket address for a socket file.
+ @param path The path of the socket file.
+ @return struct sockaddr_un data, nil if the path is too long
+ */
++ (NSData *)addressForSocketPath:(NSString *)path;
+
+@end
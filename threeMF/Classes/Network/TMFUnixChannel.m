@@ -0,0 +1,501 @@
+//
+//  TMFUnixChannel.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* struct ucred */
+#endif
+
+#import "TMFUnixChannel.h"
+#import "TMFTcpChannel.h"
+#import "TMFUnixStream.h"
+#import "TMFPublishSubscribeCommand.h"
+#import "TMFRequest.h"
+#import "TMFResponse.h"
+#import "TMFPeer.h"
+
+#import "TMFError.h"
+#import "TMFLog.h"
+#import "TMFDefine.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TMF_UNIX_HELLO       @"_uds"  /* command name of the request opening an outgoing stream */
+#define TMF_UNIX_BACKLOG     16
+#define TMF_UNIX_SOCKET_NAME @"tmf-%d-"  /* prefix of socket file names, followed by a random number */
+
+static void *TMFUnixChannelQueueKey = &TMFUnixChannelQueueKey;
+
+/**
+ Reads the credentials of the process at the other end of a connected socket.
+ @return NO if the system does not tell, pid is 0 if only the user is known
+ */
+static BOOL TMFUnixPeerCredentials(int fd, uid_t *uid, pid_t *pid) {
+#if defined(SO_PEERCRED)
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+        return NO;
+    }
+    *uid = credentials.uid;
+    *pid = credentials.pid;
+    return YES;
+#else
+    gid_t gid;
+    if(getpeereid(fd, uid, &gid) != 0) {
+        return NO;
+    }
+    *pid = 0;
+#if defined(LOCAL_PEERPID)
+    socklen_t length = sizeof(*pid);
+    if(getsockopt(fd, SOL_LOCAL, LOCAL_PEERPID, pid, &length) != 0) {
+        *pid = 0;
+    }
+#endif
+    return YES;
+#endif
+}
+
+@interface TMFUnixChannel() {
+    dispatch_queue_t _queue;
+    dispatch_source_t _acceptSource;
+    NSMutableArray *_connections;     // incoming streams
+    NSMutableDictionary *_sessions;   // outgoing streams by socket path of the destination
+}
+@end
+
+@implementation TMFUnixChannel
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithPort:(NSUInteger)port protocol:(TMFProtocol *)protocol delegate:(NSObject<TMFChannelDelegate> *)delegate {
+    self = [super initWithPort:port protocol:protocol delegate:delegate];
+    if(self) {
+        _queue = dispatch_queue_create("tmf.channel.unix", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(_queue, TMFUnixChannelQueueKey, (__bridge void *)self, NULL);
+        _connections = [NSMutableArray new];
+        _sessions = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self stop:nil];
+#if ARC_HANDLES_QUEUES
+    dispatch_release(_queue);
+#endif
+    _queue = NULL;
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
++ (Class)streamClass {
+    return [TMFUnixStream class];
+}
+
+- (NSArray *)helloArgumentsForStream:(TMFUnixStream *)stream {
+    return @[];
+}
+
+- (BOOL)didSendHelloOnStream:(TMFUnixStream *)stream {
+    return YES;
+}
+
+- (BOOL)acceptHelloArguments:(NSArray *)arguments stream:(TMFUnixStream *)stream {
+    return [arguments count] == 0;
+}
+
++ (NSData *)addressForSocketPath:(NSString *)path {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+
+    const char *fileSystemPath = [path fileSystemRepresentation];
+    if(!fileSystemPath || strlen(fileSystemPath) >= sizeof(address.sun_path)) {
+        return nil;
+    }
+
+#if !defined(__linux__)
+    address.sun_len = sizeof(address);
+#endif
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, fileSystemPath, sizeof(address.sun_path) - 1);
+    return [NSData dataWithBytes:&address length:sizeof(address)];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Override
+//............................................................................
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer responseBlock:(responseBlock_t)responseBlock {
+    [self send:command arguments:arguments destination:peer timeout:0 responseBlock:responseBlock];
+}
+
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(NSTimeInterval)timeout responseBlock:(responseBlock_t)responseBlock {
+    NSParameterAssert(peer!=nil);
+    NSParameterAssert(command!=nil);
+    BOOL publishSubscribe = [command isKindOfClass:[TMFPublishSubscribeCommand class]];
+    if (!publishSubscribe) {
+        NSParameterAssert(responseBlock!=nil);
+    }
+
+    // encode on the calling thread, the channel queue only moves bytes
+    arguments.identifier = [TMFTcpChannel nextIdentifier];
+    NSUInteger identifier = arguments.identifier;
+    NSData *data = [self.protocol requestDataForCommand:command arguments:arguments options:[self frameOptionsForPeer:peer]];
+    TMFSendQueuePolicy policy = [self sendQueuePolicyForCommand:command];
+    NSString *key = command.name;
+
+    dispatch_async(_queue, ^{
+        TMFUnixStream *stream = [self sessionForPeer:peer];
+        if(stream) {
+            [self addResponseBlock:responseBlock identifier:identifier peer:peer connection:stream timeout:timeout];
+            if(![stream writeData:data policy:policy key:key]) {
+                [self failResponseBlockForIdentifier:identifier error:[TMFError errorForCode:TMFChannelErrorCode message:@"Send queue is full."]];
+            }
+        }
+        else if(responseBlock) {
+            dispatch_async(self.delegate.callbackQueue, ^{
+                responseBlock(nil, [TMFError errorForCode:TMFChannelErrorCode message:@"Could not connect to the peer's socket."]);
+            });
+        }
+    });
+}
+
+- (void)send:(TMFCommand *)command arguments:(TMFArguments *)arguments destinations:(NSArray *)peers {
+    NSParameterAssert(command!=nil);
+
+    arguments.identifier = [TMFTcpChannel nextIdentifier];
+    NSArray *messages = [self requestDataForCommand:command arguments:arguments destinations:peers];
+    TMFSendQueuePolicy policy = [self sendQueuePolicyForCommand:command];
+    NSString *key = command.name;
+
+    dispatch_async(_queue, ^{
+        [peers enumerateObjectsUsingBlock:^(TMFPeer *peer, NSUInteger idx, __unused BOOL *stop) {
+            [[self sessionForPeer:peer] writeData:[messages objectAtIndex:idx] policy:policy key:key];
+        }];
+    });
+}
+
+- (void)removePeer:(TMFPeer *)peer {
+    NSString *path = peer.localSocketPath;
+    if(path) {
+        dispatch_async(_queue, ^{
+            [[_sessions objectForKey:path] close];
+        });
+    }
+}
+
+- (void)start:(startCompletionBlock_t)completion {
+    [self performBlockOnQueue:^{
+        @autoreleasepool {
+            if(![self isRunning]) {
+                NSError *error = nil;
+                _running = [self startListening:&error];
+                if(!_running) {
+                    TMFLogError(@"Error starting %@ %@", NSStringFromClass([self class]), error);
+                }
+                else {
+                    TMFLogInfo(@"Started %@ on %@.", NSStringFromClass([self class]), _socketPath);
+                }
+
+                if(completion) {
+                    dispatch_async(self.delegate.callbackQueue, ^{ completion(error); });
+                }
+            }
+        }
+    }];
+}
+
+- (void)stop:(stopCompletionBlock_t)completion {
+    [self performBlockOnQueue:^{
+        @autoreleasepool {
+            [self stopListening];
+            for(TMFUnixStream *stream in [_connections copy]) {
+                [stream close];
+            }
+            for(TMFUnixStream *stream in [_sessions allValues]) {
+                [stream close];
+            }
+            _running = NO;
+        }
+    }];
+
+    [self failAllResponseBlocks];
+
+    if(completion) {
+        dispatch_async(self.delegate.callbackQueue, ^{
+            completion();
+        });
+    }
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (BOOL)startListening:(NSError **)error {
+    if(!self.protocol) {
+        TMFLogError(@"No protocol provided.");
+        return NO;
+    }
+
+    // sandboxed temporary directories may exceed the length of sun_path
+    NSString *name = [[NSString stringWithFormat:TMF_UNIX_SOCKET_NAME, getpid()] stringByAppendingFormat:@"%08x.sock", arc4random()];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+    NSData *address = [[self class] addressForSocketPath:path];
+    if(!address) {
+        path = [@"/tmp" stringByAppendingPathComponent:name];
+        address = [[self class] addressForSocketPath:path];
+    }
+
+    int fd = address ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+    if(fd < 0) {
+        [self setError:error systemCall:@"socket"];
+        return NO;
+    }
+
+    unlink([path fileSystemRepresentation]);
+    if(bind(fd, [address bytes], (socklen_t)[address length]) != 0 || listen(fd, TMF_UNIX_BACKLOG) != 0) {
+        [self setError:error systemCall:@"bind"];
+        close(fd);
+        unlink([path fileSystemRepresentation]);
+        return NO;
+    }
+
+    // only processes of the same user may connect
+    chmod([path fileSystemRepresentation], S_IRUSR | S_IWUSR);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    __weak TMFUnixChannel *weakSelf = self;
+    _acceptSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, _queue);
+    dispatch_source_set_event_handler(_acceptSource, ^{ [weakSelf acceptConnectionsOnSocket:fd]; });
+    dispatch_source_set_cancel_handler(_acceptSource, ^{ close(fd); });
+    dispatch_resume(_acceptSource);
+
+    _socketPath = [path copy];
+    return YES;
+}
+
+- (void)stopListening {
+    if(_acceptSource) {
+        dispatch_source_cancel(_acceptSource);
+#if ARC_HANDLES_QUEUES
+        dispatch_release(_acceptSource);
+#endif
+        _acceptSource = NULL;
+    }
+
+    if(_socketPath) {
+        unlink([_socketPath fileSystemRepresentation]);
+        _socketPath = nil;
+    }
+}
+
+- (void)acceptConnectionsOnSocket:(int)listenSocket {
+    int fd;
+    while((fd = accept(listenSocket, NULL, NULL)) >= 0) {
+        // the socket file is private, but its directory may not be
+        uid_t uid;
+        pid_t pid;
+        if(!TMFUnixPeerCredentials(fd, &uid, &pid) || uid != getuid()) {
+            TMFLogError(@"Rejecting unix connection of another user.");
+            close(fd);
+            continue;
+        }
+
+        TMFUnixStream *stream = [[[[self class] streamClass] alloc] initWithFileDescriptor:fd protocol:self.protocol queue:_queue];
+        __weak TMFUnixChannel *weakSelf = self;
+        __weak TMFUnixStream *weakStream = stream;
+        stream.frameBlock = ^(NSData *body, uint8_t flags) {
+            [weakSelf stream:weakStream didReadRequestData:body flags:flags];
+        };
+        stream.closeBlock = ^{
+            [weakSelf connectionDidClose:weakStream];
+        };
+        stream.remoteProcessIdentifier = pid;
+        [_connections addObject:stream];
+    }
+}
+
+- (TMFUnixStream *)sessionForPeer:(TMFPeer *)peer {
+    NSString *path = peer.localSocketPath;
+    if(!path || !_socketPath) {
+        return nil;
+    }
+
+    TMFUnixStream *stream = [_sessions objectForKey:path];
+    if(!stream) {
+        NSData *address = [[self class] addressForSocketPath:path];
+        int fd = address ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+        if(fd < 0 || connect(fd, [address bytes], (socklen_t)[address length]) != 0) {
+            TMFLogError(@"Could not connect to %@ at %@. Reason: %s", peer, path, strerror(errno));
+            if(fd >= 0) {
+                close(fd);
+            }
+            return nil;
+        }
+
+        TMFLogVerbose(@"Creating unix stream for peer %@", peer);
+        stream = [[[[self class] streamClass] alloc] initWithFileDescriptor:fd protocol:self.protocol queue:_queue];
+        stream.remotePath = path;
+        stream.remoteAddress = address;
+        __weak TMFUnixChannel *weakSelf = self;
+        __weak TMFUnixStream *weakStream = stream;
+        stream.frameBlock = ^(NSData *body, uint8_t flags) {
+            [weakSelf stream:weakStream didReadResponseData:body flags:flags];
+        };
+        stream.closeBlock = ^{
+            [weakSelf sessionDidClose:weakStream];
+        };
+        [_sessions setObject:stream forKey:path];
+
+        // tell the other side where requests on this stream come from
+        NSArray *arguments = [@[ _socketPath ] arrayByAddingObjectsFromArray:[self helloArgumentsForStream:stream]];
+        TMFRequest *hello = [TMFRequest requestWithCommandName:TMF_UNIX_HELLO arguments:arguments identifier:@0];
+        [stream writeData:[self.protocol data:[self.protocol requestDataForRequest:hello] withOptions:[self frameOptionsForPeer:peer]]];
+        if(![self didSendHelloOnStream:stream]) {
+            [stream close];
+            return nil;
+        }
+    }
+    return stream;
+}
+
+- (void)stream:(TMFUnixStream *)stream didReadRequestData:(NSData *)body flags:(uint8_t)flags {
+    TMFRequest *request = [self.protocol requestFromData:body flags:flags];
+    if(!stream || !request) {
+        TMFLogError(@"Could not decode request on unix stream.");
+        return;
+    }
+
+    if(!stream.remoteAddress) {
+        // the first request of a stream names the sender's socket, sub-classes may expect further arguments
+        NSArray *arguments = [request.arguments isKindOfClass:[NSArray class]] ? request.arguments : nil;
+        NSString *path = ([arguments count] > 0) ? [arguments objectAtIndex:0] : nil;
+        if([request.commandName isEqualToString:TMF_UNIX_HELLO] && [path isKindOfClass:[NSString class]] && [self isSocketPath:path ownedByStream:stream]) {
+            stream.remotePath = path;
+            stream.remoteAddress = [[self class] addressForSocketPath:path];
+            if(stream.remoteAddress && ![self acceptHelloArguments:[arguments subarrayWithRange:NSMakeRange(1, [arguments count] - 1)] stream:stream]) {
+                stream.remoteAddress = nil;
+            }
+        }
+        if(!stream.remoteAddress) {
+            TMFLogError(@"Closing unix stream without valid hello.");
+            [stream close];
+        }
+        return;
+    }
+
+    NSData *address = stream.remoteAddress;
+    [self receiveRequests:@[ request ] address:address response:^(TMFRequest *answeredRequest, id result, NSError *error) {
+        TMFResponse *response = [TMFResponse responseWithidentifier:answeredRequest.identifier result:result error:[error description]];
+        NSData *data = [self.protocol responseDataForResponse:response];
+        dispatch_async(_queue, ^{
+            if(![stream writeData:data]) {
+                [stream close]; // the peer does not read its responses
+            }
+        });
+    }];
+}
+
+- (void)stream:(__unused TMFUnixStream *)stream didReadResponseData:(NSData *)body flags:(uint8_t)flags {
+    TMFResponse *response = [self.protocol responseFromData:body flags:flags];
+    if(!response) {
+        TMFLogError(@"Could not decode response on unix stream.");
+        return;
+    }
+    [self executeResponseBlocksForResponses:@[ response ]];
+}
+
+- (void)connectionDidClose:(TMFUnixStream *)stream {
+    [_connections removeObjectIdenticalTo:stream];
+    TMFLogVerbose(@"Unix connection from %@ closed.", stream.remotePath);
+}
+
+- (void)sessionDidClose:(TMFUnixStream *)stream {
+    if(stream.remotePath && [_sessions objectForKey:stream.remotePath] == stream) {
+        [_sessions removeObjectForKey:stream.remotePath];
+    }
+
+    [self failResponseBlocksForConnection:stream error:nil];
+
+    TMFLogVerbose(@"Unix session to %@ closed.", stream.remotePath);
+}
+
+- (BOOL)isSocketPath:(NSString *)path ownedByStream:(TMFUnixStream *)stream {
+    // a socket of the same user, created by the process at the other end if the system tells its pid
+    struct stat info;
+    if(lstat([path fileSystemRepresentation], &info) != 0 || !S_ISSOCK(info.st_mode) || info.st_uid != getuid()) {
+        TMFLogError(@"Unix hello names invalid socket %@.", path);
+        return NO;
+    }
+    if(stream.remoteProcessIdentifier != 0 && ![[path lastPathComponent] hasPrefix:[NSString stringWithFormat:TMF_UNIX_SOCKET_NAME, stream.remoteProcessIdentifier]]) {
+        TMFLogError(@"Unix hello names socket %@ of another process.", path);
+        return NO;
+    }
+    return YES;
+}
+
+- (TMFFrameOption)frameOptionsForPeer:(TMFPeer *)peer {
+    // messages to local peers are never compressed, only 2.x peers publish a local socket
+    return [self.protocol frameOptionsForPeer:peer] & TMFFrameOptionCommandIdentifier;
+}
+
+- (TMFSendQueuePolicy)sendQueuePolicyForCommand:(TMFCommand *)command {
+    // unreliable commands would have been sent via UDP, losing old data is fine
+    TMFSendQueuePolicy policy = [super sendQueuePolicyForCommand:command];
+    if(policy == TMFSendQueuePolicyReject && [command isKindOfClass:[TMFPublishSubscribeCommand class]] && ![[command class] isReliable]) {
+        return TMFSendQueuePolicyDropOldest;
+    }
+    return policy;
+}
+
+- (void)setError:(NSError **)error systemCall:(NSString *)call {
+    if(error) {
+        *error = [TMFError errorForCode:TMFChannelErrorCode message:[NSString stringWithFormat:@"%@ failed (%s).", call, strerror(errno)]];
+    }
+}
+
+- (void)performBlockOnQueue:(dispatch_block_t)block {
+    // the channel may get released by a block running on its own queue
+    if(!_queue) {
+        return;
+    }
+    if(dispatch_get_specific(TMFUnixChannelQueueKey) == (__bridge void *)self) {
+        block();
+    }
+    else {
+        dispatch_sync(_queue, block);
+    }
+}
+
+@end
@@ -0,0 +1,117 @@
+//
+//  TMFUnixStream.h
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// This file is part of 3MF http://threemf.com
+//
+
+#import <Foundation/Foundation.h>
+#import "TMFFrameDecoder.h"
+#import "TMFSendQueue.h"
+
+@class TMFProtocol;
+
+/**
+ Non-blocking stream socket of TMFUnixChannel driven by dispatch sources.
+ Written data gets queued and written as soon as the socket accepts it, read data gets decoded into message frames.
+ All methods must be called on the queue passed to the initializer.
+ */
+@interface TMFUnixStream : NSObject {
+    @protected
+    int _fd;
+    dispatch_queue_t _queue;
+    TMFFrameDecoder *_decoder;
+    TMFSendQueue *_sendQueue;
+}
+
+/**
+ Called with the body of each decoded message frame.
+ */
+@property (nonatomic, copy) frameDecoderBlock_t frameBlock;
+
+/**
+ Called once after the stream got closed.
+ */
+@property (nonatomic, copy) dispatch_block_t closeBlock;
+
+/**
+ Socket path of the channel at the other end, set by the hello of an incoming stream.
+ */
+@property (nonatomic, copy) NSString *remotePath;
+
+/**
+ Socket address of the channel at the other end, nil until an incoming stream received a valid hello.
+ */
+@property (nonatomic, strong) NSData *remoteAddress;
+
+/**
+ Process at the other end of an incoming stream as reported by the system, 0 if unknown.
+ */
+@property (nonatomic) pid_t remoteProcessIdentifier;
+
+/**
+ YES after close got called.
+ */
+@property (nonatomic, readonly, getter = isClosed) BOOL closed;
+
+/**
+ Creates a new stream taking over a connected socket.
+ @param fd Connected stream socket, gets closed with the stream.
+ @param protocol Protocol for decoding message frames.
+ @param queue Serial queue all events get delivered on.
+ @return a new instance
+ */
+- (id)initWithFileDescriptor:(int)fd protocol:(TMFProtocol *)protocol queue:(dispatch_queue_t)queue;
+
+/**
+ Queues data with TMFSendQueuePolicyReject and writes as much as the socket accepts right away.
+ @param data The data to write.
+ @return YES if the data got queued
+ */
+- (BOOL)writeData:(NSData *)data;
+
+/**
+ Queues data in a bounded queue handled according to the policy and writes as much as the socket accepts right away.
+ @param data The data to write.
+ @param policy Defines what happens if the send queue is full.
+ @param key Identifies the stream for TMFSendQueuePolicyKeepLatest and whose data TMFSendQueuePolicyDropOldest drops first, usually the command name. May be nil.
+ @return YES if the data got queued
+ */
+- (BOOL)writeData:(NSData *)data policy:(TMFSendQueuePolicy)policy key:(NSString *)key;
+
+/**
+ Closes the socket and drops all queued data.
+ */
+- (void)close;
+
+/**
+ Called when the socket became readable. Sub-classes may override it to read by other means.
+ */
+- (void)readAvailableData;
+
+/**
+ Called when queued data is waiting and the socket became writable. Sub-classes may override it to write by other means.
+ */
+- (void)writePendingData;
+
+@end
@@ -0,0 +1,217 @@
+//
+//  TMFUnixStream.m
+//
+// Copyright (c) 2013 Martin Gratzer, http://www.mgratzer.com
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#import "TMFUnixStream.h"
+#import "TMFLog.h"
+#import "TMFDefine.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 /* SO_NOSIGPIPE is set on the socket instead */
+#endif
+
+@interface TMFUnixStream() {
+    dispatch_source_t _readSource;
+    dispatch_source_t _writeSource;
+    BOOL _writeSourceSuspended;
+}
+@end
+
+@implementation TMFUnixStream
+//............................................................................
+#pragma mark -
+#pragma mark Memory Management
+//............................................................................
+- (id)initWithFileDescriptor:(int)fd protocol:(TMFProtocol *)protocol queue:(dispatch_queue_t)queue {
+    self = [super init];
+    if(self) {
+        _fd = fd;
+#if ARC_HANDLES_QUEUES
+        dispatch_retain(queue);
+#endif
+        _queue = queue;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int nosigpipe = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &nosigpipe, sizeof(nosigpipe));
+#endif
+        _decoder = [[TMFFrameDecoder alloc] initWithProtocol:protocol];
+        _sendQueue = [TMFSendQueue new];
+
+        _readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, queue);
+        _writeSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_WRITE, (uintptr_t)fd, 0, queue);
+        _writeSourceSuspended = YES;
+
+        __weak TMFUnixStream *weakSelf = self;
+        dispatch_source_set_event_handler(_readSource, ^{ [weakSelf readAvailableData]; });
+        dispatch_source_set_event_handler(_writeSource, ^{ [weakSelf writePendingData]; });
+
+        // the descriptor may only be closed after both sources got cancelled
+        __block int sources = 2;
+        dispatch_block_t cancelHandler = ^{
+            if(--sources == 0) {
+                close(fd);
+            }
+        };
+        dispatch_source_set_cancel_handler(_readSource, cancelHandler);
+        dispatch_source_set_cancel_handler(_writeSource, cancelHandler);
+
+        // events are delivered on the queue, so the owner sets its blocks before the first read
+        dispatch_resume(_readSource);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    _closeBlock = nil;
+    [self close];
+#if ARC_HANDLES_QUEUES
+    dispatch_release(_queue);
+#endif
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Public
+//............................................................................
+- (BOOL)writeData:(NSData *)data {
+    return [self writeData:data policy:TMFSendQueuePolicyReject key:nil];
+}
+
+- (BOOL)writeData:(NSData *)data policy:(TMFSendQueuePolicy)policy key:(NSString *)key {
+    if(_closed || [data length] == 0) {
+        return !_closed;
+    }
+
+    if(![_sendQueue enqueueData:data policy:policy key:key]) {
+        if(policy == TMFSendQueuePolicyReject) {
+            TMFLogError(@"Send queue of unix stream %@ is full, rejecting %@.", _remotePath, key);
+        }
+        else {
+            TMFLogVerbose(@"Send queue of unix stream %@ is full, dropping %@.", _remotePath, key);
+        }
+        return NO;
+    }
+
+    if([_sendQueue count] == 1) {
+        // try to write right away, the write source only waits for a full socket buffer
+        [self writePendingData];
+    }
+    return YES;
+}
+
+- (void)close {
+    if(_closed) {
+        return;
+    }
+    _closed = YES;
+
+    [_sendQueue removeAllData];
+
+    // suspended sources never deliver their cancel handler
+    if(_writeSourceSuspended) {
+        dispatch_resume(_writeSource);
+        _writeSourceSuspended = NO;
+    }
+    dispatch_source_cancel(_readSource);
+    dispatch_source_cancel(_writeSource);
+#if ARC_HANDLES_QUEUES
+    dispatch_release(_readSource);
+    dispatch_release(_writeSource);
+#endif
+    _readSource = NULL;
+    _writeSource = NULL;
+
+    dispatch_block_t closeBlock = _closeBlock;
+    _closeBlock = nil;
+    _frameBlock = nil;
+    if(closeBlock) {
+        closeBlock();
+    }
+}
+
+- (void)readAvailableData {
+    NSError *error = nil;
+    NSData *data = [_decoder readFromFileDescriptor:_fd error:&error];
+    if(!data) {
+        if(error) {
+            TMFLogError(@"Unix stream %@ failed: %@", _remotePath, error);
+        }
+        [self close];
+        return;
+    }
+
+    frameDecoderBlock_t frameBlock = _frameBlock;
+    if([data length] > 0 && frameBlock && ![_decoder decodeReadData:data frames:frameBlock error:&error]) {
+        TMFLogError(@"Invalid message on unix stream %@: %@", _remotePath, error);
+        [self close];
+    }
+}
+
+- (void)writePendingData {
+    while([_sendQueue count] > 0) {
+        NSData *data = [_sendQueue dataAtIndex:0];
+        NSUInteger offset = [_sendQueue offset];
+        ssize_t written = send(_fd, (const uint8_t *)[data bytes] + offset, [data length] - offset, MSG_NOSIGNAL);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            TMFLogError(@"Writing to unix stream %@ failed (%s).", _remotePath, strerror(errno));
+            [self close];
+            return;
+        }
+
+        [_sendQueue consumeLength:(NSUInteger)written];
+    }
+
+    [self updateWriteSource];
+}
+
+//............................................................................
+#pragma mark -
+#pragma mark Private
+//............................................................................
+- (void)updateWriteSource {
+    // only wait for the socket to become writable while data is pending
+    BOOL pending = [_sendQueue count] > 0;
+    if(pending && _writeSourceSuspended) {
+        dispatch_resume(_writeSource);
+        _writeSourceSuspended = NO;
+    }
+    else if(!pending && !_writeSourceSuspended) {
+        dispatch_suspend(_writeSource);
+        _writeSourceSuspended = YES;
+    }
+}
+
+@end
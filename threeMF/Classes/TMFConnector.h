@@ -236,4 +236,15 @@ typedef void (^tmfCompletionBlock_t)(NSError *error);
  */
 - (void)sendCommand:(Class)commandClass arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer response:(responseBlock_t)response;
 
+/**
+ Sends a set of command arguments for a given request response command with a deadline for the response.
+ The response block gets called with a TMFTimeoutErrorCode error if no result was received in time.
+ @param commandClass TMFRequestResponseCommand to send.
+ @param arguments The corresponding arguments to send.
+ @param peer The destination peer.
+ @param timeout Time in seconds to wait for the response, 0 uses the channel's default timeout.
+ @param response a response which gets triggered after a response is received or the timeout expired.
+ */
+- (void)sendCommand:(Class)commandClass arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(NSTimeInterval)timeout response:(responseBlock_t)response;
+
 @end
@@ -29,6 +29,7 @@
 
 #import "TMFTcpChannel.h"
 #import "TMFUdpChannel.h"
+#import "TMFUnixChannel.h"
 #import "TMFJsonRpcCoder.h"
 
 #import "TMFViewCommand.h"
@@ -237,9 +238,14 @@
 
     [_subscribeCommand sendWithArguments:args
                              destination:peer
-                                response:^(NSDictionary *response, NSError *error) {
+                                response:^(id response, NSError *error) {
                                     if(!error) {
-                                        [_dispatcher subscribe:commandClass peer:peer receive:receive];
+                                        // 2.x publishers respond with the identifier of the command, 1.x ones just with YES
+                                        NSUInteger commandIdentifier = 0;
+                                        if(peer.protocolMajorVersion >= 2 && [response isKindOfClass:[NSNumber class]]) {
+                                            commandIdentifier = [response unsignedIntegerValue];
+                                        }
+                                        [_dispatcher subscribe:commandClass peer:peer commandIdentifier:commandIdentifier receive:receive];
                                     }
 
                                     if(completion) {
@@ -307,6 +313,10 @@
 #pragma mark sending request response commands
 //............................................................................
 - (void)sendCommand:(Class)commandClass arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer response:(responseBlock_t)response {
+    [self sendCommand:commandClass arguments:arguments destination:peer timeout:0 response:response];
+}
+
+- (void)sendCommand:(Class)commandClass arguments:(TMFArguments *)arguments destination:(TMFPeer *)peer timeout:(NSTimeInterval)timeout response:(responseBlock_t)response {
     NSParameterAssert(commandClass!=nil);
     NSParameterAssert([commandClass isSubclassOfClass:[TMFCommand class]]);    
     NSParameterAssert(peer!=nil);
@@ -316,7 +326,7 @@
     command.delegate = _dispatcher;
     NSParameterAssert(command!=nil);
     NSParameterAssert([command isKindOfClass:[TMFRequestResponseCommand class]]);
-    [command sendWithArguments:arguments destination:peer response:response];
+    [command sendWithArguments:arguments destination:peer timeout:timeout response:response];
 }
 
 //............................................................................
@@ -419,9 +429,16 @@
             });
         }
     }
+    else if(dispatcher == _dispatcher && [channel isKindOfClass:[TMFUnixChannel class]]) {
+        _discovery.localSocketPath = ((TMFUnixChannel *)channel).socketPath;
+    }
 }
 
 - (void)dispatcher:(TMFCommandDispatcher *)dispatcher stoppedChannel:(TMFChannel *)channel {
+    if(dispatcher == _dispatcher && [channel isKindOfClass:[TMFUnixChannel class]]) {
+        _discovery.localSocketPath = nil;
+    }
+
     if (dispatcher == _dispatcher && channel == dispatcher.systemChannel) {
 
         if(_shutdownSemaphore != NULL) {
@@ -656,7 +673,8 @@
                                                              error = [TMFError errorForCode:TMFInternalErrorCode message:[NSString stringWithFormat:@"Command '%@' not found.", arguments.commandName]];
                                                          }
 
-                                                         responseBlock(@(error == nil), error);
+                                                         // 1.x subscribers only check for an error, 2.x ones identify the command's messages by the number
+                                                         responseBlock(error ? @NO : @(command.commandIdentifier), error);
                                                      }
                                                  }];
 
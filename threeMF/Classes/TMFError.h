@@ -34,6 +34,7 @@ static const NSInteger TMFPeerNotFoundErrorCode = 300;
 static const NSInteger TMFSubscribeErrorCode = 400;
 static const NSInteger TMFResponseErrorCode = 500;
 static const NSInteger TMFCommandErrorCode = 500;
+static const NSInteger TMFTimeoutErrorCode = 600;
 
 /**
  A little NSError subclass easing the creation of error objects.
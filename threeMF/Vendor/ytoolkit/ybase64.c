@@ -20,6 +20,18 @@
 #include <assert.h>
 #include "ybase64.h"
 
+#ifndef __has_attribute
+#define __has_attribute(x) 0
+#endif
+
+// SIMD code paths for x86, selected at runtime. Other architectures use the scalar loops only.
+// Define YBASE64_NO_SIMD to build the scalar loops only, e.g. for comparison.
+#if (defined(__x86_64__) || defined(__i386__)) && __has_attribute(target) && !defined(YBASE64_NO_SIMD)
+#define YBASE64_X86_SIMD 1
+#include <immintrin.h>
+#include <pthread.h>
+#endif
+
 /* 
  RFC 1521
  MIME (Multipurpose Internet Mail Extensions) Part One:
@@ -50,6 +62,208 @@
 //                               IN ybase64_write_callback write_callback, 
 //                               IN const void * context);
 
+#ifdef YBASE64_X86_SIMD
+
+// The SIMD paths follow Wojciech Mula's and Daniel Lemire's base64 algorithms:
+// http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+// http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html
+// Each function processes whole blocks only and returns the number of input bytes consumed,
+// the scalar loops handle the rest.
+
+#define YBASE64_TARGET_SSE __attribute__((target("ssse3,sse4.1")))
+#define YBASE64_TARGET_AVX2 __attribute__((target("avx2")))
+
+typedef size_t (*ybase64_encode_blocks_t)(const unsigned char *, size_t, unsigned char *);
+typedef size_t (*ybase64_decode_blocks_t)(const unsigned char *, size_t, unsigned char *, size_t);
+
+// 6-bit indices in the 4 bytes of each 32-bit lane -> ASCII
+YBASE64_TARGET_SSE static inline __m128i ybase64_sse_lookup(const __m128i indices)
+{
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, result), indices);
+}
+
+// 3 input bytes in each 32-bit lane -> 6-bit indices
+YBASE64_TARGET_SSE static inline __m128i ybase64_sse_split(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+YBASE64_TARGET_SSE static size_t ybase64_encode_blocks_sse(const unsigned char * from, size_t from_len, unsigned char * to)
+{
+    size_t i = 0, j = 0;
+    // 12 bytes are consumed per block, but 16 are loaded
+    for (; i + 16 <= from_len; i += 12, j += 16) {
+        const __m128i in = _mm_loadu_si128((const __m128i *)(from + i));
+        _mm_storeu_si128((__m128i *)(to + j), ybase64_sse_lookup(ybase64_sse_split(in)));
+    }
+    return i;
+}
+
+// ASCII -> 6-bit values, returns 0 if the block contains invalid characters
+YBASE64_TARGET_SSE static inline int ybase64_sse_translate(const __m128i in, __m128i *values)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+    const __m128i lo_nibbles = _mm_and_si128(in, nibble);
+    const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    if (!_mm_testz_si128(lo, hi)) {
+        return 0;
+    }
+    const __m128i eq_2f = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    *values = _mm_add_epi8(in, roll);
+    return 1;
+}
+
+YBASE64_TARGET_SSE static size_t ybase64_decode_blocks_sse(const unsigned char * from, size_t from_len, unsigned char * to, size_t to_len)
+{
+    size_t i = 0, j = 0;
+    // 12 bytes are produced per block, but 16 are stored
+    for (; i + 16 <= from_len && j + 16 <= to_len; i += 16, j += 12) {
+        __m128i values;
+        if (!ybase64_sse_translate(_mm_loadu_si128((const __m128i *)(from + i)), &values)) {
+            break; // let the scalar loop deal with it
+        }
+        const __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        out = _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *)(to + j), out);
+    }
+    return i;
+}
+
+YBASE64_TARGET_AVX2 static size_t ybase64_encode_blocks_avx2(const unsigned char * from, size_t from_len, unsigned char * to)
+{
+    const __m256i shuffle = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                            10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0);
+    size_t i = 0, j = 0;
+    // 24 bytes are consumed per block, 12 per lane, but 28 are loaded
+    for (; i + 28 <= from_len; i += 24, j += 32) {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(from + i))),
+                                             _mm_loadu_si128((const __m128i *)(from + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuffle);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t1, t3);
+
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, result), indices);
+        _mm256_storeu_si256((__m256i *)(to + j), result);
+    }
+    return i;
+}
+
+YBASE64_TARGET_AVX2 static size_t ybase64_decode_blocks_avx2(const unsigned char * from, size_t from_len, unsigned char * to, size_t to_len)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i slash = _mm256_set1_epi8('/');
+    size_t i = 0, j = 0;
+    // 24 bytes are produced per block, but 32 are stored
+    for (; i + 32 <= from_len && j + 32 <= to_len; i += 32, j += 24) {
+        const __m256i in = _mm256_loadu_si256((const __m256i *)(from + i));
+        const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+        const __m256i lo_nibbles = _mm256_and_si256(in, nibble);
+        const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break; // let the scalar loop deal with it
+        }
+        const __m256i eq_2f = _mm256_cmpeq_epi8(in, slash);
+        const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        const __m256i values = _mm256_add_epi8(in, roll);
+        const __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        out = _mm256_shuffle_epi8(out, pack);
+        out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+        _mm256_storeu_si256((__m256i *)(to + j), out);
+    }
+    return i;
+}
+
+static size_t ybase64_encode_blocks_none(const unsigned char * from, size_t from_len, unsigned char * to)
+{
+    (void)from; (void)from_len; (void)to;
+    return 0;
+}
+
+static size_t ybase64_decode_blocks_none(const unsigned char * from, size_t from_len, unsigned char * to, size_t to_len)
+{
+    (void)from; (void)from_len; (void)to; (void)to_len;
+    return 0;
+}
+
+static ybase64_encode_blocks_t ybase64_encode_blocks;
+static ybase64_decode_blocks_t ybase64_decode_blocks;
+static pthread_once_t ybase64_blocks_once = PTHREAD_ONCE_INIT;
+
+// pick the widest supported code path
+static void ybase64_select_blocks_once(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ybase64_decode_blocks = ybase64_decode_blocks_avx2;
+        ybase64_encode_blocks = ybase64_encode_blocks_avx2;
+    }
+    else if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3")) {
+        ybase64_decode_blocks = ybase64_decode_blocks_sse;
+        ybase64_encode_blocks = ybase64_encode_blocks_sse;
+    }
+    else {
+        ybase64_decode_blocks = ybase64_decode_blocks_none;
+        ybase64_encode_blocks = ybase64_encode_blocks_none;
+    }
+}
+
+// the selection runs once, concurrent first calls wait for it to finish
+static void ybase64_select_blocks(void)
+{
+    pthread_once(&ybase64_blocks_once, ybase64_select_blocks_once);
+}
+
+#endif
+
 //returned len includes \0
 size_t ybase64_encode( IN const void * from, 
                       IN const size_t from_len,
@@ -88,6 +302,12 @@ size_t ybase64_encode( IN const void * from,
     unsigned char * p_to = (unsigned char *)to;
     size_t i = 0, j = 0;
     
+#ifdef YBASE64_X86_SIMD
+    ybase64_select_blocks();
+    i = ybase64_encode_blocks(p_from, from_len, p_to);
+    j = i / 3 * 4;
+#endif
+    
     // use aligned bytes to omit most of conditional statements, means less CMPs & JMPs
     for (; i < aligned_len ;) {
         
@@ -279,6 +499,11 @@ size_t ybase64_decode( IN const char * from, //input must be an Base64 encoded t
     unsigned char d1, d2, d3, d4;
     unsigned int d;
     size_t i = 0, j = 0;
+#ifdef YBASE64_X86_SIMD
+    ybase64_select_blocks();
+    i = ybase64_decode_blocks(p_from, aligned_len, p_to, to_len);
+    j = i / 4 * 3;
+#endif
     for (; i < aligned_len; ) {        
         c1 = *(p_from + i);
         c2 = *(p_from + i + 1);
@@ -331,7 +556,7 @@ size_t ybase64_decode( IN const char * from, //input must be an Base64 encoded t
             d2 = base64_decoding_map[c2];
             d3 = base64_decoding_map[c3];
             
-            if (__ == d1 || __ == d2 || __ == d3 || d3 & 0x3c) {
+            if (__ == d1 || __ == d2 || __ == d3 || d3 & 0x03) {
                 return j;
             }
             